@@ -34,9 +34,12 @@ typedef DELEGATE_S1(void, _Bool) DELEGATE_T1(void, bool);
 typedef DELEGATE_S1(void, int) DELEGATE_T1(void, int);
 typedef DELEGATE_S1(void, unsigned) DELEGATE_T1(void, unsigned);
 typedef DELEGATE_S1(void, float) DELEGATE_T1(void, float);
+typedef DELEGATE_S0(unsigned) DELEGATE_T0(unsigned);
 typedef DELEGATE_S0(uint8_t) DELEGATE_T0(uint8);
+typedef DELEGATE_S1(uint8_t, uint16_t) DELEGATE_T1(uint8, uint16);
 typedef DELEGATE_S1(void, uint8_t) DELEGATE_T1(void, uint8);
 typedef DELEGATE_S2(void, int, uint8_t *) DELEGATE_T2(void, int, uint8p);
+typedef DELEGATE_S2(void, uint16_t, uint8_t) DELEGATE_T2(void, uint16, uint8);
 
 /* Convenience function for declaring anonymous structs. */
 
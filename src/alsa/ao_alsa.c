@@ -35,6 +35,7 @@
 #include "machine.h"
 #include "module.h"
 #include "sound.h"
+#include "sound_ring.h"
 #include "xroar.h"
 
 static _Bool init(void);
@@ -52,6 +53,14 @@ static snd_pcm_t *pcm_handle;
 static snd_pcm_uframes_t fragment_nframes;
 static void *audio_buffer;
 
+/* Where possible, fragments are queued in a ring and written to the device
+ * by an output thread, so the emulation thread never blocks in ALSA. */
+static struct sound_ring *ring;
+static _Bool threaded;
+static unsigned timeout_ms;
+
+static void write_pcm(void const *buffer);
+
 static _Bool init(void) {
 	const char *device = xroar_cfg.ao_device ? xroar_cfg.ao_device : "default";
 	int err;
@@ -213,11 +222,19 @@ static _Bool init(void) {
 			goto failed;
 	}
 
-	unsigned buffer_size = fragment_nframes * nchannels * sample_nbytes;
-	audio_buffer = xmalloc(buffer_size);
+	unsigned frame_nbytes = nchannels * sample_nbytes;
+	audio_buffer = xmalloc(fragment_nframes * frame_nbytes);
 	sound_init(audio_buffer, buffer_fmt, rate, nchannels, fragment_nframes);
 	LOG_DEBUG(1, "\t%u frags * %ld frames/frag = %ld frames buffer (%ldms)\n", nfragments, fragment_nframes, buffer_nframes, (buffer_nframes * 1000) / rate);
 
+	// The ring adds up to one more device buffer of latency
+	unsigned ring_nframes = (buffer_nframes > fragment_nframes) ? buffer_nframes : fragment_nframes;
+	uint8_t silence = (buffer_fmt == SOUND_FMT_U8) ? 0x80 : 0;
+	ring = sound_ring_new(ring_nframes, frame_nbytes, rate, silence);
+	timeout_ms = (ring_nframes * 1500) / rate + 1;
+	threaded = sound_ring_start_thread(ring, fragment_nframes, write_pcm);
+	LOG_DEBUG(2, "ALSA: writing %s\n", threaded ? "from a separate thread" : "synchronously");
+
 	/* snd_pcm_writei(pcm_handle, buffer, fragment_nframes); */
 	return 1;
 failed:
@@ -226,16 +243,28 @@ failed:
 }
 
 static void shutdown(void) {
+	sound_ring_stop_thread(ring);
+	sound_ring_log_stats(ring, "ALSA");
+	sound_ring_free(ring);
+	ring = NULL;
 	snd_pcm_close(pcm_handle);
 	free(audio_buffer);
 }
 
-static void *write_buffer(void *buffer) {
-	if (xroar_noratelimit)
-		return buffer;
+static void write_pcm(void const *buffer) {
 	if (snd_pcm_writei(pcm_handle, buffer, fragment_nframes) < 0) {
 		snd_pcm_prepare(pcm_handle);
 		snd_pcm_writei(pcm_handle, buffer, fragment_nframes);
 	}
+}
+
+static void *write_buffer(void *buffer) {
+	if (threaded) {
+		sound_ring_queue(ring, buffer, fragment_nframes, timeout_ms);
+		return buffer;
+	}
+	if (xroar_noratelimit)
+		return buffer;
+	write_pcm(buffer);
 	return buffer;
 }
@@ -18,27 +18,11 @@
 
 #include "config.h"
 
-#define _POSIX_C_SOURCE 200112L
-
-#include <signal.h>
-#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
-
-#ifdef HAVE_SDL
-#include <SDL.h>
-#else
-#include <errno.h>
-#include <time.h>
-#include <sys/time.h>
-#endif
 
-#include "events.h"
-#include "logging.h"
-#include "machine.h"
 #include "module.h"
+#include "pacer.h"
 #include "sound.h"
-#include "xroar.h"
 
 static _Bool init(void);
 static void *write_buffer(void *buffer);
@@ -49,62 +33,13 @@ SoundModule sound_null_module = {
 	.write_buffer = write_buffer,
 };
 
-#define CYCLES_PER_MS (OSCILLATOR_RATE / 1000)
-
-static event_ticks last_pause_cycle;
-static unsigned int last_pause_ms;
-
-static unsigned int current_time(void);
-static void sleep_ms(unsigned int ms);
-
 static _Bool init(void) {
 	sound_init(NULL, SOUND_FMT_NULL, 44100, 1, 1024);
-	last_pause_cycle = event_current_tick;
-	last_pause_ms = current_time();
+	pacer_reset();
 	return 1;
 }
 
-static unsigned int current_time(void) {
-#ifdef HAVE_SDL
-	return SDL_GetTicks();
-#else
-	struct timeval tp;
-	gettimeofday(&tp, NULL);
-	return (tp.tv_sec % 1000) * 1000 + (tp.tv_usec / 1000);
-#endif
-}
-
-static void sleep_ms(unsigned int ms) {
-#ifdef HAVE_SDL
-	SDL_Delay(ms);
-#else
-	struct timespec elapsed, tv;
-	elapsed.tv_sec = (ms) / 1000;
-	elapsed.tv_nsec = ((ms) % 1000) * 1000000;
-	do {
-		errno = 0;
-		tv.tv_sec = elapsed.tv_sec;
-		tv.tv_nsec = elapsed.tv_nsec;
-	} while (nanosleep(&tv, &elapsed) && errno == EINTR);
-#endif
-}
-
 static void *write_buffer(void *buffer) {
-	event_ticks elapsed_cycles = event_current_tick - last_pause_cycle;
-	unsigned int expected_elapsed_ms = elapsed_cycles / CYCLES_PER_MS;
-	unsigned int actual_elapsed_ms, difference_ms;
-	actual_elapsed_ms = current_time() - last_pause_ms;
-	difference_ms = expected_elapsed_ms - actual_elapsed_ms;
-	if (difference_ms >= 10) {
-		if (xroar_noratelimit || difference_ms > 1000) {
-			last_pause_ms = current_time();
-			last_pause_cycle = event_current_tick;
-		} else {
-			sleep_ms(difference_ms);
-			difference_ms = current_time() - last_pause_ms;
-			last_pause_ms += difference_ms;
-			last_pause_cycle += difference_ms * CYCLES_PER_MS;
-		}
-	}
+	pacer_wait();
 	return buffer;
 }
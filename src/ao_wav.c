@@ -0,0 +1,200 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Audio capture.  The mixed output is written to a file or pipe as a WAV
+ * stream.  Nothing waits on a device, so this runs as fast as the emulation
+ * (no rate limiting), and pairs with the headless video modules for batch
+ * recording.
+ *
+ * The RIFF and data chunk sizes aren't known until the end, so they are
+ * patched in at shutdown.  A pipe can't be rewound, so there they are left at
+ * their maximum, which most tools reading a stream accept. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+#include "logging.h"
+#include "module.h"
+#include "sound.h"
+#include "xroar.h"
+
+static _Bool init(void);
+static void shutdown(void);
+static void *write_buffer(void *buffer);
+
+SoundModule sound_wav_module = {
+	.common = { .name = "wav", .description = "WAV file audio",
+		    .init = init, .shutdown = shutdown },
+	.write_buffer = write_buffer,
+};
+
+#define WAV_HEADER_SIZE (44)
+
+static FILE *output;
+static _Bool output_is_pipe;
+static _Bool output_failed;
+static void *audio_buffer;
+static size_t fragment_nbytes;
+static uint32_t data_nbytes;
+
+// Kept to rewrite the header at shutdown
+static unsigned header_rate;
+static unsigned header_nchannels;
+static unsigned header_sample_nbytes;
+
+static void put_le16(uint8_t *p, unsigned v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+	put_le16(p, v & 0xffff);
+	put_le16(p + 2, v >> 16);
+}
+
+static _Bool write_header(unsigned rate, unsigned nchannels, unsigned sample_nbytes, uint32_t nbytes) {
+	uint8_t h[WAV_HEADER_SIZE] = {
+		'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+		'f', 'm', 't', ' ', 16, 0, 0, 0,
+	};
+	unsigned frame_nbytes = nchannels * sample_nbytes;
+	// A maximal data size means "unknown"; don't let the RIFF size wrap
+	uint32_t riff_nbytes = (nbytes < 0xffffffff - 36) ? nbytes + 36 : 0xffffffff;
+	put_le32(h + 4, riff_nbytes);
+	put_le16(h + 20, 1);  // PCM
+	put_le16(h + 22, nchannels);
+	put_le32(h + 24, rate);
+	put_le32(h + 28, rate * frame_nbytes);
+	put_le16(h + 32, frame_nbytes);
+	put_le16(h + 34, sample_nbytes * 8);
+	h[36] = 'd'; h[37] = 'a'; h[38] = 't'; h[39] = 'a';
+	put_le32(h + 40, nbytes);
+	return fwrite(h, sizeof(h), 1, output) == 1;
+}
+
+static _Bool init(void) {
+	if (xroar_cfg.ao_pipe) {
+		output = popen(xroar_cfg.ao_pipe, "w");
+		output_is_pipe = 1;
+	} else if (xroar_cfg.ao_file) {
+		output = fopen(xroar_cfg.ao_file, "wb");
+		output_is_pipe = 0;
+	} else {
+		LOG_WARN("WAV: no -ao-file or -ao-pipe specified\n");
+		return 0;
+	}
+	if (!output) {
+		LOG_ERROR("WAV: failed to open output\n");
+		return 0;
+	}
+	output_failed = 0;
+	setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+	unsigned rate = 48000;
+	if (xroar_cfg.ao_rate > 0)
+		rate = xroar_cfg.ao_rate;
+
+	// Stereo by default, so the Orchestra-90 is captured as it sounds
+	unsigned nchannels = 2;
+	if (xroar_cfg.ao_channels >= 1 && xroar_cfg.ao_channels <= 2)
+		nchannels = xroar_cfg.ao_channels;
+
+	// WAV only has unsigned 8-bit and little-endian 16-bit PCM
+	enum sound_fmt buffer_fmt = SOUND_FMT_S16_LE;
+	unsigned sample_nbytes = 2;
+	if (xroar_cfg.ao_format == SOUND_FMT_U8) {
+		buffer_fmt = SOUND_FMT_U8;
+		sample_nbytes = 1;
+	}
+
+	// Nobody is listening, so fragments can be large
+	unsigned fragment_nframes = 4096;
+	if (xroar_cfg.ao_fragment_ms > 0) {
+		fragment_nframes = (rate * xroar_cfg.ao_fragment_ms) / 1000;
+	} else if (xroar_cfg.ao_fragment_nframes > 0) {
+		fragment_nframes = xroar_cfg.ao_fragment_nframes;
+	}
+	if (fragment_nframes < 1)
+		fragment_nframes = 1;
+
+	header_rate = rate;
+	header_nchannels = nchannels;
+	header_sample_nbytes = sample_nbytes;
+	data_nbytes = 0;
+	if (!write_header(rate, nchannels, sample_nbytes, output_is_pipe ? 0xffffffff : 0)) {
+		LOG_WARN("WAV: write failed, no audio will be written\n");
+		output_failed = 1;
+	}
+
+	fragment_nbytes = fragment_nframes * nchannels * sample_nbytes;
+	audio_buffer = xmalloc(fragment_nbytes);
+	sound_init(audio_buffer, buffer_fmt, rate, nchannels, fragment_nframes);
+	LOG_DEBUG(1, "\t%u frames/fragment\n", fragment_nframes);
+	return 1;
+}
+
+static void write_frames(void const *buffer, size_t nbytes);
+
+static void shutdown(void) {
+	if (output) {
+		// Audio since the last full fragment
+		unsigned nframes = sound_render_pending();
+		write_frames(audio_buffer, nframes * header_nchannels * header_sample_nbytes);
+		if (output_is_pipe) {
+			pclose(output);
+		} else {
+			// Data chunk must be padded to an even length
+			if (data_nbytes & 1)
+				fputc(0, output);
+			if (fseek(output, 0, SEEK_SET) != 0 || !write_header(header_rate, header_nchannels, header_sample_nbytes, data_nbytes))
+				LOG_WARN("WAV: failed to finalise '%s'\n", xroar_cfg.ao_file);
+			fclose(output);
+		}
+		output = NULL;
+	}
+	free(audio_buffer);
+	audio_buffer = NULL;
+}
+
+static void write_frames(void const *buffer, size_t nbytes) {
+	if (output_failed || nbytes == 0)
+		return;
+	if (data_nbytes > 0xffffffff - WAV_HEADER_SIZE - nbytes) {
+		LOG_WARN("WAV: output reached 4GB, no further audio will be written\n");
+		output_failed = 1;
+		return;
+	}
+	if (fwrite(buffer, nbytes, 1, output) != 1) {
+		LOG_WARN("WAV: write failed, no further audio will be written\n");
+		output_failed = 1;
+		return;
+	}
+	data_nbytes += nbytes;
+}
+
+static void *write_buffer(void *buffer) {
+	write_frames(buffer, fragment_nbytes);
+	return buffer;
+}
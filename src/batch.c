@@ -0,0 +1,295 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each job is run in a child process forked from the runner before any
+ * emulator state is initialised, so jobs can't interfere with each other.
+ * Jobs are handed out in manifest order to whichever process slot frees up
+ * first, so long jobs don't hold up the rest of the queue. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifndef WINDOWS32
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "xalloc.h"
+
+#include "batch.h"
+#include "logging.h"
+#include "module.h"
+#include "xroar.h"
+
+#ifndef WINDOWS32
+
+struct batch_job {
+	int line;  // in manifest, used to identify the job
+	int argc;
+	char **argv;
+	pid_t pid;
+	struct timeval start;
+};
+
+/* Options passed to every job ahead of anything from the command line or
+ * manifest, so they can be overridden (e.g. to select a capture module). */
+static char *default_args[] = {
+	"-ui", "null", "-vo", "null", "-ao", "null", "-noratelimit",
+};
+#define NUM_DEFAULT_ARGS (int)(sizeof(default_args) / sizeof(default_args[0]))
+
+/* Emulated seconds a job may run for if neither the command line nor its
+ * manifest line gives -timeout, so that a job that never finishes can't hold
+ * up the batch forever.  Changed with -batch-timeout. */
+#define DEFAULT_JOB_TIMEOUT "300"
+
+/* Split a manifest line into arguments.  Arguments are separated by
+ * whitespace, and double quotes group an argument containing spaces. */
+
+static int split_args(char *line, char ***argvp) {
+	char **argv = NULL;
+	int argc = 0;
+	char *in = line;
+	while (*in) {
+		while (isspace((int)*in))
+			in++;
+		if (!*in || *in == '#')
+			break;
+		char *arg = in, *out = in;
+		_Bool quoted = 0;
+		while (*in && (quoted || !isspace((int)*in))) {
+			if (*in == '"') {
+				quoted = !quoted;
+				in++;
+				continue;
+			}
+			*(out++) = *(in++);
+		}
+		if (*in)
+			in++;
+		*out = 0;
+		argv = xrealloc(argv, (argc + 1) * sizeof(*argv));
+		argv[argc++] = xstrdup(arg);
+	}
+	*argvp = argv;
+	return argc;
+}
+
+static void free_jobs(struct batch_job *jobs, int njobs) {
+	for (int i = 0; i < njobs; i++) {
+		for (int j = 0; j < jobs[i].argc; j++)
+			free(jobs[i].argv[j]);
+		free(jobs[i].argv);
+	}
+	free(jobs);
+}
+
+static struct batch_job *read_manifest(const char *filename, int *njobs) {
+	FILE *fd = fopen(filename, "r");
+	if (!fd) {
+		LOG_ERROR("Failed to open batch manifest '%s'\n", filename);
+		*njobs = -1;
+		return NULL;
+	}
+	struct batch_job *jobs = NULL;
+	int n = 0;
+	int line = 0;
+	char buf[1024];
+	while (fgets(buf, sizeof(buf), fd)) {
+		line++;
+		// Don't run the rest of an overlong line as another job
+		if (!strchr(buf, '\n') && !feof(fd)) {
+			LOG_ERROR("Batch: %s: line %d: too long (limit %d characters)\n", filename, line, (int)sizeof(buf) - 2);
+			fclose(fd);
+			free_jobs(jobs, n);
+			*njobs = -1;
+			return NULL;
+		}
+		char **argv;
+		int argc = split_args(buf, &argv);
+		if (argc == 0)
+			continue;
+		jobs = xrealloc(jobs, (n + 1) * sizeof(*jobs));
+		jobs[n].line = line;
+		jobs[n].argc = argc;
+		jobs[n].argv = argv;
+		jobs[n].pid = 0;
+		n++;
+	}
+	fclose(fd);
+	*njobs = n;
+	return jobs;
+}
+
+/* Runs in the child process: everything main() would do, with the combined
+ * argument list. */
+
+static void run_job(struct batch_job *job, char *argv0, char *timeout, int ncommon, char **common, const char *log_dir) {
+	if (log_dir) {
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/job%d.log", log_dir, job->line);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			LOG_ERROR("Failed to open log file '%s'\n", path);
+			exit(EXIT_FAILURE);
+		}
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+	}
+	int argc = 1 + NUM_DEFAULT_ARGS + 2 + ncommon + job->argc;
+	char **argv = xmalloc((argc + 1) * sizeof(*argv));
+	int argn = 0;
+	argv[argn++] = argv0;
+	for (int i = 0; i < NUM_DEFAULT_ARGS; i++)
+		argv[argn++] = default_args[i];
+	argv[argn++] = "-timeout";
+	argv[argn++] = timeout;
+	for (int i = 0; i < ncommon; i++)
+		argv[argn++] = common[i];
+	for (int i = 0; i < job->argc; i++)
+		argv[argn++] = job->argv[i];
+	argv[argn] = NULL;
+	atexit(xroar_shutdown);
+	if (!xroar_init(argc, argv))
+		exit(EXIT_FAILURE);
+	if (ui_module->run) {
+		ui_module->run();
+	} else {
+		while (xroar_run())
+			;
+	}
+	exit(EXIT_SUCCESS);
+}
+
+int batch_main(int argc, char **argv) {
+	if (argc < 3) {
+		LOG_ERROR("Usage: %s -batch MANIFEST [OPTION]...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *manifest = argv[2];
+	long max_running = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *log_dir = NULL;
+	char *timeout = DEFAULT_JOB_TIMEOUT;
+
+	// Strip out runner options, leaving those common to all jobs.
+	char **common = xmalloc(argc * sizeof(*common));
+	int ncommon = 0;
+	for (int i = 3; i < argc; i++) {
+		if (0 == strcmp(argv[i], "-batch-jobs") && (i + 1) < argc) {
+			max_running = strtol(argv[++i], NULL, 0);
+		} else if (0 == strcmp(argv[i], "-batch-log") && (i + 1) < argc) {
+			log_dir = argv[++i];
+		} else if (0 == strcmp(argv[i], "-batch-timeout") && (i + 1) < argc) {
+			timeout = argv[++i];
+			if (strtod(timeout, NULL) <= 0.0) {
+				LOG_ERROR("Batch: -batch-timeout must be more than 0 seconds\n");
+				free(common);
+				return EXIT_FAILURE;
+			}
+		} else {
+			common[ncommon++] = argv[i];
+		}
+	}
+	if (max_running < 1)
+		max_running = 1;
+
+	int njobs;
+	struct batch_job *jobs = read_manifest(manifest, &njobs);
+	if (!jobs) {
+		free(common);
+		return (njobs < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	LOG_DEBUG(1, "Batch: %d jobs, up to %ld at a time\n", njobs, max_running);
+
+	// Flush before forking so buffered output isn't duplicated.
+	fflush(stdout);
+	fflush(stderr);
+
+	int next = 0, running = 0, failed = 0;
+	while (next < njobs || running > 0) {
+		if (next < njobs && running < max_running) {
+			struct batch_job *job = &jobs[next++];
+			gettimeofday(&job->start, NULL);
+			pid_t pid = fork();
+			if (pid == 0)
+				run_job(job, argv[0], timeout, ncommon, common, log_dir);
+			if (pid < 0) {
+				LOG_ERROR("Batch: line %d: fork failed\n", job->line);
+				failed++;
+				continue;
+			}
+			job->pid = pid;
+			running++;
+			continue;
+		}
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0)
+			break;
+		struct batch_job *job = NULL;
+		for (int i = 0; i < next; i++) {
+			if (jobs[i].pid == pid) {
+				job = &jobs[i];
+				break;
+			}
+		}
+		if (!job)
+			continue;
+		running--;
+		job->pid = 0;
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		double t = (now.tv_sec - job->start.tv_sec) + (now.tv_usec - job->start.tv_usec) / 1000000.;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+			LOG_DEBUG(1, "Batch: line %d: ok (%.2fs)\n", job->line, t);
+		} else {
+			failed++;
+			if (WIFSIGNALED(status)) {
+				LOG_ERROR("Batch: line %d: killed by signal %d (%.2fs)\n", job->line, WTERMSIG(status), t);
+			} else {
+				LOG_ERROR("Batch: line %d: exit status %d (%.2fs)\n", job->line, WEXITSTATUS(status), t);
+			}
+		}
+	}
+	LOG_DEBUG(1, "Batch: %d jobs, %d failed\n", njobs, failed);
+
+	free_jobs(jobs, njobs);
+	free(common);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+int batch_main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+	LOG_ERROR("Batch mode not supported on this platform\n");
+	return EXIT_FAILURE;
+}
+
+#endif
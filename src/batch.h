@@ -0,0 +1,23 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_BATCH_H_
+#define XROAR_BATCH_H_
+
+/* Batch mode: each line of a manifest file lists the command line options for
+ * one job.  Jobs are run headless and without rate limiting, each in its own
+ * process, with up to one process per host CPU running at a time.
+ *
+ * Invoked as "xroar -batch MANIFEST [options]".  Any further options apply to
+ * every job, except for the following, which control the runner itself:
+ *
+ *   -batch-jobs N     run at most N jobs at a time
+ *   -batch-log DIR    redirect the output of each job to DIR/jobLINE.log
+ *
+ * Returns an exit status: failure if any job failed. */
+
+int batch_main(int argc, char **argv);
+
+#endif  /* XROAR_BATCH_H_ */
@@ -41,6 +41,8 @@ static struct slist *wp_access_list = NULL;
 
 static struct slist *iter_next = NULL;
 
+_Bool bp_wp_enabled = 0;
+
 static void bp_instruction_hook(void *);
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -58,7 +60,7 @@ void bp_add(struct breakpoint *bp) {
 		return;
 	bp->address_end = bp->address;
 	bp_instruction_list = slist_prepend(bp_instruction_list, bp);
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	cpu->instruction_hook = DELEGATE_AS0(void, bp_instruction_hook, cpu);
 }
 
@@ -73,7 +75,7 @@ void bp_add_n(struct breakpoint *bp, int n) {
 		if ((bp[i].add_cond & BP_CRC_BAS) && (!has_bas || !crclist_match(bp[i].cond_crc_bas, crc_bas)))
 			continue;
 		if (!bp[i].handler_data) {
-			bp[i].handler_data = machine_get_cpu(0);
+			bp[i].handler_data = machine_get_cpu(xroar_machine, 0);
 		}
 		bp_add(&bp[i]);
 	}
@@ -84,7 +86,7 @@ void bp_remove(struct breakpoint *bp) {
 		iter_next = iter_next->next;
 	bp_instruction_list = slist_remove(bp_instruction_list, bp);
 	if (!bp_instruction_list) {
-		struct MC6809 *cpu = machine_get_cpu(0);
+		struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 		cpu->instruction_hook.func = NULL;
 	}
 }
@@ -136,7 +138,7 @@ static void trap_remove(struct slist **bp_list, unsigned addr, unsigned addr_end
 void bp_hbreak_add(unsigned addr, unsigned match_mask, unsigned match_cond) {
 	trap_add(&bp_instruction_list, addr, addr, match_mask, match_cond);
 	if (bp_instruction_list) {
-		struct MC6809 *cpu = machine_get_cpu(0);
+		struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 		cpu->instruction_hook = DELEGATE_AS0(void, bp_instruction_hook, cpu);
 	}
 }
@@ -144,7 +146,7 @@ void bp_hbreak_add(unsigned addr, unsigned match_mask, unsigned match_cond) {
 void bp_hbreak_remove(unsigned addr, unsigned match_mask, unsigned match_cond) {
 	trap_remove(&bp_instruction_list, addr, addr, match_mask, match_cond);
 	if (!bp_instruction_list) {
-		struct MC6809 *cpu = machine_get_cpu(0);
+		struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 		cpu->instruction_hook.func = NULL;
 	}
 }
@@ -163,6 +165,7 @@ void bp_wp_add(unsigned type, unsigned addr, unsigned nbytes, unsigned match_mas
 	default:
 		break;
 	}
+	bp_wp_enabled = wp_read_list || wp_write_list || wp_access_list;
 }
 
 void bp_wp_remove(unsigned type, unsigned addr, unsigned nbytes, unsigned match_mask, unsigned match_cond) {
@@ -179,6 +182,7 @@ void bp_wp_remove(unsigned type, unsigned addr, unsigned nbytes, unsigned match_
 	default:
 		break;
 	}
+	bp_wp_enabled = wp_read_list || wp_write_list || wp_access_list;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -188,7 +192,7 @@ void bp_wp_remove(unsigned type, unsigned addr, unsigned nbytes, unsigned match_
  * alter the original list. */
 
 static void bp_hook(struct slist *bp_list, unsigned address) {
-	unsigned sam_register = sam_get_register();
+	unsigned sam_register = sam_get_register(machine_get_sam(xroar_machine, 0));
 	unsigned cond = sam_register & 0x8400;
 	for (struct slist *iter = bp_list; iter; iter = iter_next) {
 		iter_next = iter->next;
@@ -101,6 +101,10 @@ void bp_hbreak_remove(unsigned addr, unsigned match_mask, unsigned match_cond);
 void bp_wp_add(unsigned type, unsigned addr, unsigned nbytes, unsigned match_mask, unsigned match_cond);
 void bp_wp_remove(unsigned type, unsigned addr, unsigned nbytes, unsigned match_mask, unsigned match_cond);
 
+/* Set while any watchpoints exist.  The machine tests this before calling the
+ * hooks below, so unwatched memory accesses don't pay for a list walk. */
+extern _Bool bp_wp_enabled;
+
 void bp_wp_read_hook(unsigned address);
 void bp_wp_write_hook(unsigned address);
 
@@ -16,16 +16,55 @@
  *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* Each queue is a pairing heap, but while it stays shallow it is kept as a
+ * chain of only children: every event has at most one child, due no earlier
+ * than itself.  That is a sorted list as well as a valid heap, so with the
+ * handful of events a machine usually has queued, queueing is a short walk as
+ * with a plain list, and popping or dequeueing just unlinks.
+ *
+ * An event that would go further down the chain than CHAIN_MAX, or below an
+ * event with siblings, is melded in at the root instead.  From then on the
+ * queue behaves as an ordinary pairing heap, until popping leaves it as a
+ * chain again.
+ *
+ * Build with -DEVENT_TRACE to log every queue operation to the file named by
+ * XROAR_EVENT_TRACE (default "events.trace"), for replay by tools/evbench. */
+
 #include "config.h"
 
 #include <stdlib.h>
+#ifdef EVENT_TRACE
+#include <stdio.h>
+#endif
 
 #include "xalloc.h"
 
 #include "events.h"
 #include "logging.h"
 
-event_ticks event_current_tick = 0;
+#define CHAIN_MAX (16)
+
+THREAD_LOCAL event_ticks event_current_tick = 0;
+
+#ifdef EVENT_TRACE
+
+static void trace_event(char op, struct event **list, struct event *event) {
+	static FILE *trace_file = NULL;
+	if (!trace_file) {
+		const char *filename = getenv("XROAR_EVENT_TRACE");
+		trace_file = fopen(filename ? filename : "events.trace", "w");
+		if (!trace_file) {
+			LOG_ERROR("Failed to open event trace\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	fprintf(trace_file, "%c %p %p %u %u\n", op, (void *)list, (void *)event, event->at_tick, event_current_tick);
+}
+
+#define TRACE_EVENT(op,list,event) trace_event((op), (list), (event))
+#else
+#define TRACE_EVENT(op,list,event)
+#endif
 
 struct event *event_new(DELEGATE_T0(void) delegate) {
 	struct event *new = xmalloc(sizeof(*new));
@@ -39,7 +78,10 @@ void event_init(struct event *event, DELEGATE_T0(void) delegate) {
 	event->delegate = delegate;
 	event->queued = 0;
 	event->list = NULL;
+	event->child = NULL;
 	event->next = NULL;
+	event->prev = NULL;
+	event->seq = 0;
 }
 
 void event_free(struct event *event) {
@@ -47,37 +89,147 @@ void event_free(struct event *event) {
 	free(event);
 }
 
+/* True if event a is due before event b.  Tick comparison allows for
+ * wrap-around, as long as all queued events are within half the range of
+ * event_ticks of each other. */
+
+static _Bool event_before(struct event const *a, struct event const *b) {
+	int dt = (int)(a->at_tick - b->at_tick);
+	if (dt != 0)
+		return dt < 0;
+	return (int)(a->seq - b->seq) < 0;
+}
+
+/* Combine two heaps, returning the new root.  Neither may be NULL. */
+
+static struct event *meld(struct event *a, struct event *b) {
+	if (event_before(b, a)) {
+		struct event *tmp = a;
+		a = b;
+		b = tmp;
+	}
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Standard two-pass pairing of a list of sibling heaps: meld pairs left to
+ * right, then meld the results right to left. */
+
+static struct event *merge_pairs(struct event *first) {
+	struct event *pairs = NULL;
+	while (first) {
+		struct event *a = first;
+		struct event *b = a->next;
+		if (b) {
+			first = b->next;
+			a = meld(a, b);
+		} else {
+			first = NULL;
+		}
+		/* build list of pairs in reverse, linked through next */
+		a->next = pairs;
+		pairs = a;
+	}
+	struct event *root = pairs;
+	if (root) {
+		pairs = root->next;
+		while (pairs) {
+			struct event *b = pairs;
+			pairs = b->next;
+			root = meld(root, b);
+		}
+		root->next = root->prev = NULL;
+	}
+	return root;
+}
+
+/* Breaks ties between events due at the same tick, so they dispatch in the
+ * order queued.  Only compared within one list, and a list is only used by
+ * the thread that has its machine selected, so each thread counts alone. */
+static THREAD_LOCAL unsigned queue_seq = 0;
+
 void event_queue(struct event **list, struct event *event) {
-	struct event **entry;
 	if (event->queued)
 		event_dequeue(event);
 	event->list = list;
 	event->queued = 1;
-	for (entry = list; *entry; entry = &((*entry)->next)) {
-		if ((int)((*entry)->at_tick - event->at_tick) > 0) {
-			event->next = *entry;
-			*entry = event;
+	event->seq = queue_seq++;
+	/* An event not in a queue always has its links cleared */
+	TRACE_EVENT('Q', list, event);
+	/* Walk down the chain to the first event due after this one.  This
+	 * event was queued last, so it goes after any due on the same tick. */
+	struct event *parent = NULL;
+	struct event *node = *list;
+	for (int depth = 0; node && (int)(event->at_tick - node->at_tick) >= 0; depth++) {
+		if (depth >= CHAIN_MAX || (node->child && node->child->next)) {
+			*list = meld(*list, event);
 			return;
 		}
+		parent = node;
+		node = node->child;
 	}
-	*entry = event;
-	event->next = NULL;
+	/* Insert it above that one */
+	event->prev = parent;
+	event->child = node;
+	if (node)
+		node->prev = event;
+	if (parent)
+		parent->child = event;
+	else
+		*list = event;
+}
+
+static void pop_root(struct event **list) {
+	struct event *event = *list;
+	*list = merge_pairs(event->child);
+	event->queued = 0;
+	event->child = NULL;
+}
+
+/* Called by event_pop() when the next event has siblings below it (or always
+ * when tracing). */
+
+struct event *event_pop_heap(struct event **list) {
+	struct event *event = *list;
+	TRACE_EVENT('X', list, event);
+	pop_root(list);
+	return event;
 }
 
 void event_dequeue(struct event *event) {
 	struct event **list = event->list;
-	struct event **entry;
-	event->queued = 0;
-	if (list == NULL)
+	if (!event->queued || list == NULL) {
+		event->queued = 0;
 		return;
+	}
+	TRACE_EVENT('D', list, event);
 	if (*list == event) {
-		*list = event->next;
+		pop_root(list);
 		return;
 	}
-	for (entry = list; *entry; entry = &((*entry)->next)) {
-		if ((*entry)->next == event) {
-			(*entry)->next = event->next;
-			return;
-		}
+	/* Whatever was below it takes its place: it's all due no earlier than
+	 * this event, so no later than its parent. */
+	struct event *prev = event->prev;
+	struct event *next = event->next;
+	struct event *sub = merge_pairs(event->child);
+	struct event *replace = next;
+	if (sub) {
+		sub->prev = prev;
+		sub->next = next;
+		if (next)
+			next->prev = sub;
+		replace = sub;
+	} else if (next) {
+		next->prev = prev;
 	}
+	if (prev->child == event)
+		prev->child = replace;
+	else
+		prev->next = replace;
+	event->queued = 0;
+	event->child = event->next = event->prev = NULL;
 }
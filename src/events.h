@@ -6,24 +6,39 @@
 #ifndef XROAR_EVENT_H_
 #define XROAR_EVENT_H_
 
+#include "config.h"
+
 #include <limits.h>
 
 #include "delegate.h"
 
 /* Maintains queues of events.  Each event has a tick number at which its
- * delegate is scheduled to run.  */
+ * delegate is scheduled to run.
+
+ * Each queue is a pairing heap: the list pointer always refers to the next
+ * event due (so checking for pending events is cheap), and queueing or
+ * dequeueing doesn't involve walking the whole queue.  While a queue is
+ * shallow it is kept sorted, as a plain list would be.  Events due on the
+ * same tick are dispatched in the order they were queued.  */
 
 typedef unsigned event_ticks;
 
-/* Current "time". */
-extern event_ticks event_current_tick;
+/* Current "time".  Each thread has its own: it belongs to whichever machine
+ * that thread is running (see machine_select()). */
+extern THREAD_LOCAL event_ticks event_current_tick;
 
 struct event {
 	event_ticks at_tick;
 	DELEGATE_T0(void) delegate;
 	_Bool queued;
 	struct event **list;
+	/* Heap linkage: first child, next sibling and previous sibling (or
+	 * parent, if this is the first child) */
+	struct event *child;
 	struct event *next;
+	struct event *prev;
+	/* Order of queueing, to keep events due on the same tick in order */
+	unsigned seq;
 };
 
 struct event *event_new(DELEGATE_T0(void));
@@ -32,15 +47,33 @@ void event_init(struct event *event, DELEGATE_T0(void));
 void event_free(struct event *event);
 void event_queue(struct event **list, struct event *event);
 void event_dequeue(struct event *event);
+struct event *event_pop_heap(struct event **list);
+
+/* Remove and return the next event due.  Unless it has more than one child,
+ * that's just an unlink, so do that much inline. */
+
+static inline struct event *event_pop(struct event **list) {
+#ifndef EVENT_TRACE
+	struct event *event = *list;
+	struct event *child = event->child;
+	if (!child || !child->next) {
+		*list = child;
+		if (child)
+			child->prev = NULL;
+		event->queued = 0;
+		event->child = NULL;
+		return event;
+	}
+#endif
+	return event_pop_heap(list);
+}
 
 static inline _Bool event_pending(struct event **list) {
 	return *list && (event_current_tick - (*list)->at_tick) <= (UINT_MAX/2);
 }
 
 static inline void event_dispatch_next(struct event **list) {
-	struct event *e = *list;
-	*list = e->next;
-	e->queued = 0;
+	struct event *e = event_pop(list);
 	DELEGATE_CALL0(e->delegate);
 }
 
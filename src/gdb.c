@@ -489,7 +489,7 @@ static void send_last_signal(int fd) {
 }
 
 static void send_general_registers(int fd) {
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	sprintf(packet, "%02x%02x%02x%02x%04x%04x%04x%04x%04x",
 		 cpu->reg_cc,
 		 MC6809_REG_A(cpu),
@@ -513,7 +513,7 @@ static void send_general_registers(int fd) {
 }
 
 static void set_general_registers(int fd, char *args) {
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	if (strlen(args) != 38) {
 		send_packet_string(fd, "E00");
 		return;
@@ -561,7 +561,7 @@ static void send_memory(int fd, char *args) {
 	if (send(fd, packet, 1, 0) < 0)
 		return;
 	for (unsigned i = 0; i < length; i++) {
-		uint8_t b = machine_read_byte(A++);
+		uint8_t b = machine_read_byte(xroar_machine, A++);
 		snprintf(packet, sizeof(packet), "%02x", b);
 		csum += packet[0];
 		csum += packet[1];
@@ -596,7 +596,7 @@ static void set_memory(int fd, char *args) {
 		int v = hex8(data);
 		if (v < 0)
 			goto error;
-		machine_write_byte(A, v);
+		machine_write_byte(xroar_machine, A, v);
 		A++;
 		data += 2;
 	}
@@ -607,7 +607,7 @@ error:
 }
 
 static void send_register(int fd, char *args) {
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	unsigned regnum = strtoul(args, NULL, 16);
 	unsigned value = 0;
 	int size = 0;
@@ -653,7 +653,7 @@ static void set_register(int fd, char *args) {
 		goto error;
 	unsigned regnum = strtoul(regnum_str, NULL, 16);
 	unsigned value = strtoul(args, NULL, 16);
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	struct HD6309 *hcpu = (struct HD6309 *)cpu;
 	if (regnum > 12)
 		goto error;
@@ -689,7 +689,7 @@ static void general_query(int fd, char *args) {
 			if (xroar_cfg.debug_gdb & XROAR_DEBUG_GDB_QUERY) {
 				LOG_PRINT("gdb: query: xroar.sam\n");
 			}
-			sprintf(packet, "%04x", sam_get_register());
+			sprintf(packet, "%04x", sam_get_register(machine_get_sam(xroar_machine, 0)));
 			send_packet(fd, packet, 4);
 		} else {
 			if (xroar_cfg.debug_gdb & XROAR_DEBUG_GDB_QUERY) {
@@ -719,7 +719,7 @@ static void general_set(int fd, char *args) {
 	if (0 == strncmp(set, "xroar.", 6)) {
 		set += 6;
 		if (0 == strcmp(set, "sam")) {
-			sam_set_register(hex16(args));
+			sam_set_register(machine_get_sam(xroar_machine, 0), hex16(args));
 			send_packet_string(fd, "OK");
 			return;
 		}
@@ -274,6 +274,9 @@ static void emulator_command(guint keyval, int shift) {
 	case GDK_KEY_a:
 		xroar_set_cross_colour(1, XROAR_CYCLE);
 		break;
+	case GDK_KEY_b:
+		xroar_rewind();
+		break;
 	case GDK_KEY_e:
 		xroar_toggle_cart();
 		break;
@@ -282,7 +285,7 @@ static void emulator_command(guint keyval, int shift) {
 		break;
 	case GDK_KEY_h:
 		if (shift)
-			machine_toggle_pause();
+			machine_toggle_pause(xroar_machine);
 		break;
 	case GDK_KEY_i:
 		if (shift)
@@ -379,7 +382,7 @@ static gboolean keypress(GtkWidget *widget, GdkEventKey *event, gpointer user_da
 		}
 	}
 	if (keyval == GDK_KEY_Pause) {
-		machine_toggle_pause();
+		machine_toggle_pause(xroar_machine);
 		return FALSE;
 	}
 	if (control) {
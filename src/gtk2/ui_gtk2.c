@@ -56,11 +56,15 @@ unsigned gtk2_window_w = 640, gtk2_window_h = 480;
 
 extern VideoModule video_gtkgl_module;
 extern VideoModule video_null_module;
+extern VideoModule video_capture_module;
+extern VideoModule video_crc_module;
 static VideoModule * const gtk2_video_module_list[] = {
 #ifdef HAVE_GTKGL
 	&video_gtkgl_module,
 #endif
 	&video_null_module,
+	&video_capture_module,
+	&video_crc_module,
 	NULL
 };
 
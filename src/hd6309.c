@@ -195,8 +195,8 @@ static uint16_t op_or16(struct MC6809 *cpu, uint16_t a, uint16_t b);
  */
 
 /* Dummy handlers */
-static uint8_t dummy_read_cycle(uint16_t a) { (void)a; return 0; }
-static void dummy_write_cycle(uint16_t a, uint8_t v) { (void)a; (void)v; }
+static uint8_t dummy_read_cycle(void *sptr, uint16_t a) { (void)sptr; (void)a; return 0; }
+static void dummy_write_cycle(void *sptr, uint16_t a, uint8_t v) { (void)sptr; (void)a; (void)v; }
 
 struct MC6809 *hd6309_new(void) {
 	struct HD6309 *hcpu = xzalloc(sizeof(*hcpu));
@@ -206,8 +206,8 @@ struct MC6809 *hd6309_new(void) {
 	cpu->run = hd6309_run;
 	cpu->jump = hd6309_jump;
 	// External handlers
-	cpu->read_cycle = dummy_read_cycle;
-	cpu->write_cycle = dummy_write_cycle;
+	cpu->read_cycle = DELEGATE_AS1(uint8, uint16, dummy_read_cycle, NULL);
+	cpu->write_cycle = DELEGATE_AS2(void, uint16, uint8, dummy_write_cycle, NULL);
 	hd6309_reset(cpu);
 	return cpu;
 }
@@ -324,6 +324,10 @@ static void hd6309_run(struct MC6809 *cpu) {
 			continue;
 
 		case hd6309_state_cwai_check_halt:
+			if (!cpu->halt && !(cpu->nmi_armed && cpu->nmi)
+			    && (!cpu->firq || (REG_CC & CC_F))
+			    && (!cpu->irq || (REG_CC & CC_I)))
+				idle_cycles(cpu);
 			NVMA_CYCLE;
 			if (cpu->halt) {
 				continue;
@@ -339,6 +343,8 @@ static void hd6309_run(struct MC6809 *cpu) {
 				hcpu->state = hd6309_state_label_b;
 				continue;
 			}
+			if (!cpu->halt && !cpu->nmi && !cpu->firq && !cpu->irq)
+				idle_cycles(cpu);
 			NVMA_CYCLE;
 			if (cpu->halt)
 				hcpu->state = hd6309_state_sync_check_halt;
@@ -99,7 +99,8 @@ int intel_hex_read(const char *filename, int autorun) {
 			if (type == 0) {
 				if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN_DATA)
 					log_hexdump_byte(log_hex, data);
-				machine_ram[addr] = data;
+				xroar_machine->ram[addr] = data;
+				xroar_machine->ram_dirty[addr >> 8] = 1;
 				addr++;
 			}
 		}
@@ -121,7 +122,7 @@ int intel_hex_read(const char *filename, int autorun) {
 		log_close(&log_hex);
 	if (exec != 0) {
 		if (autorun) {
-			struct MC6809 *cpu = machine_get_cpu(0);
+			struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 			if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 				LOG_PRINT("Intel HEX: EXEC $%04x - autorunning\n", exec);
 			cpu->jump(cpu, exec);
@@ -181,12 +182,12 @@ static int dragon_bin_load(FILE *fd, int autorun) {
 			LOG_WARN("Dragon BIN: short read\n");
 			break;
 		}
-		machine_write_byte((load + i) & 0xffff, data);
+		machine_write_byte(xroar_machine, (load + i) & 0xffff, data);
 		log_hexdump_byte(log_bin, data);
 	}
 	log_close(&log_bin);
 	if (autorun) {
-		struct MC6809 *cpu = machine_get_cpu(0);
+		struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 		if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 			LOG_PRINT("Dragon BIN: EXEC $%04x - autorunning\n", exec);
 		cpu->jump(cpu, exec);
@@ -223,7 +224,7 @@ static int coco_bin_load(FILE *fd, int autorun) {
 					LOG_WARN("CoCo BIN: short read in data chunk\n");
 					break;
 				}
-				machine_write_byte((load + i) & 0xffff, data);
+				machine_write_byte(xroar_machine, (load + i) & 0xffff, data);
 				log_hexdump_byte(log_bin, data);
 			}
 			log_close(&log_bin);
@@ -236,7 +237,7 @@ static int coco_bin_load(FILE *fd, int autorun) {
 				break;
 			}
 			if (autorun) {
-				struct MC6809 *cpu = machine_get_cpu(0);
+				struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 				if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 					LOG_PRINT("CoCo BIN: EXEC $%04x - autorunning\n", exec);
 				cpu->jump(cpu, exec);
@@ -248,7 +248,7 @@ static void type_command(struct MC6809 *cpu) {
 		}
 	}
 	/* Use CPU read routine to pull return address back off stack */
-	machine_op_rts(cpu);
+	machine_op_rts(xroar_machine);
 }
 
 void keyboard_queue_basic(const uint8_t *s) {
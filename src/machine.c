@@ -53,35 +53,82 @@
 #include "sam.h"
 #include "sound.h"
 #include "tape.h"
+#include "textscreen.h"
 #include "vdrive.h"
 #include "wd279x.h"
 #include "xroar.h"
 
-unsigned int machine_ram_size = 0x10000;  /* RAM in bytes, up to 64K */
-uint8_t machine_ram[0x10000];
-static uint8_t *machine_rom;
-static uint8_t rom0[0x4000];
-static uint8_t rom1[0x4000];
-static struct MC6809 *CPU0 = NULL;
-static struct MC6821 *PIA0, *PIA1;
-static struct MC6847 *VDG0;
-struct cart *machine_cart = NULL;
 _Bool has_bas, has_extbas, has_altbas, has_combined;
 uint32_t crc_bas, crc_extbas, crc_altbas, crc_combined;
-static uint8_t ext_charset[0x1000];
 _Bool has_ext_charset;
 uint32_t crc_ext_charset;
-static _Bool inverted_text = 0;
-
-/* Useful configuration side-effect tracking */
-static _Bool unexpanded_dragon32 = 0;
-static enum {
-	RAM_ORGANISATION_4K,
-	RAM_ORGANISATION_16K,
-	RAM_ORGANISATION_64K
-} ram_organisation = RAM_ORGANISATION_64K;
-static uint16_t ram_mask = 0xffff;
-static _Bool have_acia = 0;
+
+/* Memory map, rebuilt whenever SAM address decode, RAM or ROM configuration
+ * changes.  Pages that read or write plain RAM or ROM carry a direct pointer.
+ * Anything else (I/O, cartridge, non-linear RAM organisation) has NULL and
+ * goes through the full decode in read_cycle() & write_cycle(). */
+struct machine_page {
+	uint8_t const *read;
+	uint8_t *write;
+	uint8_t *dirty;  // flag to set on write
+	_Bool write_cart;  // write also presented to cartridge
+	_Bool fast;  // SAM fast cycle
+};
+
+struct machine_private {
+	struct machine public;
+
+	/* ROMs */
+	uint8_t *rom;
+	uint8_t rom0[0x4000];
+	uint8_t rom1[0x4000];
+	uint8_t ext_charset[0x1000];
+	_Bool inverted_text;
+
+	/* Useful configuration side-effect tracking */
+	_Bool is_coco;
+	_Bool is_dragon64;
+	_Bool unexpanded_dragon32;
+	enum {
+		RAM_ORGANISATION_4K,
+		RAM_ORGANISATION_16K,
+		RAM_ORGANISATION_64K
+	} ram_organisation;
+	uint16_t ram_mask;
+	_Bool have_acia;
+
+	/* Memory map */
+	struct machine_page page_map[256];
+	uint8_t page_unmapped[0x100];  // reads past end of RAM
+	uint8_t page_discard[0x100];  // writes that don't reach RAM
+	uint8_t page_discard_dirty;
+	uint8_t *page_map_rom;  // ROM bank mapped when last rebuilt
+	/* Interrupt vectors (0xffe0-0xffff) always read ROM.  The CPU's dummy
+	 * VMA cycles read 0xffff, so these are handled separately from the
+	 * rest of the I/O page. */
+	uint8_t const *page_vectors;
+	_Bool page_vectors_fast;
+
+	/* CPU execution stops when this event is dispatched.  machine_run()
+	 * advances its tick by the requested number of cycles, so any overrun
+	 * carries over into the next run. */
+	struct event run_end_event;
+
+	/* Set whenever the PIA interrupt outputs may have changed since they
+	 * were last passed on to the CPU.  Saves re-asserting IRQ & FIRQ on
+	 * every cycle. */
+	_Bool irq_lines_dirty;
+
+	/* Last value on the data bus */
+	uint8_t read_D;
+
+	_Bool single_step;
+	int stop_signal;
+};
+
+/* The machine whose time base is live in each thread's event_current_tick
+ * and MACHINE_EVENT_LIST. */
+static THREAD_LOCAL struct machine_private *selected_machine = NULL;
 
 static struct {
 	const char *bas;
@@ -96,16 +143,19 @@ static struct {
 static struct slist *config_list = NULL;
 static int num_configs = 0;
 
-static void initialise_ram(void);
+static void initialise_ram(struct machine_private *mp);
+static void machine_run_end(void *);
 
-static int cycles;
-static uint8_t read_cycle(uint16_t A);
-static void write_cycle(uint16_t A, uint8_t D);
+static uint8_t read_cycle(void *sptr, uint16_t A);
+static void read_cycle_slow(struct machine_private *mp, uint16_t A);
+static void write_cycle(void *sptr, uint16_t A, uint8_t D);
+static void write_cycle_slow(struct machine_private *mp, uint16_t A, uint8_t D);
+static unsigned idle_cycles(void *sptr);
 static void vdg_fetch_handler(void *sptr, int nbytes, uint8_t *dest);
+static void update_page_map(struct machine_private *mp);
+static void update_page_map_delegate(void *);
 
 static void machine_instruction_posthook(void *);
-static _Bool single_step = 0;
-static int stop_signal = 0;
 
 /**************************************************************************/
 
@@ -298,7 +348,8 @@ void machine_config_print_all(void) {
 
 /* ---------------------------------------------------------------------- */
 
-static void keyboard_update(void) {
+static void keyboard_update(struct machine_private *mp) {
+	struct MC6821 *PIA0 = mp->public.pia0;
 	unsigned buttons = ~(joystick_read_buttons() & 3);
 	struct keyboard_state state = {
 		.row_source = PIA0->a.out_sink,
@@ -312,7 +363,9 @@ static void keyboard_update(void) {
 	PIA0->b.in_sink = state.col_sink;
 }
 
-static void joystick_update(void) {
+static void joystick_update(struct machine_private *mp) {
+	struct MC6821 *PIA0 = mp->public.pia0;
+	struct MC6821 *PIA1 = mp->public.pia1;
 	int port = (PIA0->b.control_register & 0x08) >> 3;
 	int axis = (PIA0->a.control_register & 0x08) >> 3;
 	int dac_value = (PIA1->a.out_sink & 0xfc) + 2;
@@ -323,35 +376,43 @@ static void joystick_update(void) {
 		PIA0->a.in_sink &= 0x7f;
 }
 
-static void update_sound_mux_source(void) {
+static void update_sound_mux_source(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA0 = mp->public.pia0;
 	unsigned source = ((PIA0->b.control_register & (1<<3)) >> 2)
 	                  | ((PIA0->a.control_register & (1<<3)) >> 3);
 	sound_set_mux_source(source);
 }
 
-static void update_vdg_mode(void) {
+static void update_vdg_mode(struct machine_private *mp) {
+	struct MC6821 *PIA1 = mp->public.pia1;
 	unsigned vmode = (PIA1->b.out_source & PIA1->b.out_sink) & 0xf8;
 	// ¬INT/EXT = GM0
 	vmode |= (vmode & 0x10) << 4;
-	mc6847_set_mode(VDG0, vmode);
+	mc6847_set_mode(mp->public.vdg, vmode);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-static void pia0a_data_preread(void) {
-	keyboard_update();
-	joystick_update();
+static void pia0a_data_preread(void *sptr) {
+	struct machine_private *mp = sptr;
+	keyboard_update(mp);
+	joystick_update(mp);
 }
 
-#define pia0a_data_postwrite NULL
 #define pia0a_control_postwrite update_sound_mux_source
 
-#define pia0b_data_preread keyboard_update
-#define pia0b_data_postwrite NULL
+static void pia0b_data_preread(void *sptr) {
+	keyboard_update(sptr);
+}
+
 #define pia0b_control_postwrite update_sound_mux_source
 
-static void pia0b_data_preread_coco64k(void) {
-	keyboard_update();
+static void pia0b_data_preread_coco64k(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA0 = mp->public.pia0;
+	struct MC6821 *PIA1 = mp->public.pia1;
+	keyboard_update(mp);
 	/* PB6 of PIA0 is linked to PB2 of PIA1 on 64K CoCos */
 	if ((PIA1->b.out_source & PIA1->b.out_sink) & (1<<2)) {
 		PIA0->b.in_source |= (1<<6);
@@ -362,31 +423,36 @@ static void pia0b_data_preread_coco64k(void) {
 	}
 }
 
-#define pia1a_data_preread NULL
-
-static void pia1a_data_postwrite(void) {
+static void pia1a_data_postwrite(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA0 = mp->public.pia0;
+	struct MC6821 *PIA1 = mp->public.pia1;
 	sound_set_dac_level((float)(PIA_VALUE_A(PIA1) & 0xfc) / 252.);
 	tape_update_output(PIA1->a.out_sink & 0xfc);
-	if (IS_DRAGON) {
-		keyboard_update();
+	if (!mp->is_coco) {
+		keyboard_update(mp);
 		printer_strobe(PIA_VALUE_A(PIA1) & 0x02, PIA_VALUE_B(PIA0));
 	}
 }
 
-static void pia1a_control_postwrite(void) {
-	tape_update_motor(PIA1->a.control_register & 0x08);
+static void pia1a_control_postwrite(void *sptr) {
+	struct machine_private *mp = sptr;
+	tape_update_motor(mp->public.pia1->a.control_register & 0x08);
 }
 
-#define pia1b_data_preread NULL
-
-static void pia1b_data_preread_dragon(void) {
+static void pia1b_data_preread_dragon(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA1 = mp->public.pia1;
 	if (printer_busy())
 		PIA1->b.in_sink |= 0x01;
 	else
 		PIA1->b.in_sink &= ~0x01;
 }
 
-static void pia1b_data_preread_coco64k(void) {
+static void pia1b_data_preread_coco64k(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA0 = mp->public.pia0;
+	struct MC6821 *PIA1 = mp->public.pia1;
 	/* PB6 of PIA0 is linked to PB2 of PIA1 on 64K CoCos */
 	if ((PIA0->b.out_source & PIA0->b.out_sink) & (1<<6)) {
 		PIA1->b.in_source |= (1<<2);
@@ -397,89 +463,156 @@ static void pia1b_data_preread_coco64k(void) {
 	}
 }
 
-static void pia1b_data_postwrite(void) {
-	if (IS_DRAGON64) {
+static void pia1b_data_postwrite(void *sptr) {
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA1 = mp->public.pia1;
+	if (mp->is_dragon64) {
 		_Bool is_32k = PIA_VALUE_B(PIA1) & 0x04;
 		if (is_32k) {
-			machine_rom = rom0;
+			mp->rom = mp->rom0;
 			keyboard_set_chord_mode(keyboard_chord_mode_dragon_32k_basic);
 		} else {
-			machine_rom = rom1;
+			mp->rom = mp->rom1;
 			keyboard_set_chord_mode(keyboard_chord_mode_dragon_64k_basic);
 		}
+		if (mp->rom != mp->page_map_rom)
+			update_page_map(mp);
 	}
 	// Single-bit sound
 	_Bool sbs_enabled = !((PIA1->b.out_source ^ PIA1->b.out_sink) & (1<<1));
 	_Bool sbs_level = PIA1->b.out_source & PIA1->b.out_sink & (1<<1);
 	sound_set_sbs(sbs_enabled, sbs_level);
 	// VDG mode
-	update_vdg_mode();
+	update_vdg_mode(mp);
 }
 
-static void pia1b_control_postwrite(void) {
-	sound_set_mux_enabled(PIA1->b.control_register & 0x08);
+static void pia1b_control_postwrite(void *sptr) {
+	struct machine_private *mp = sptr;
+	sound_set_mux_enabled(mp->public.pia1->b.control_register & 0x08);
 }
 
-void machine_init(void) {
-	sam_init();
+/* Process-wide peripherals, shared by all machines */
 
+void machine_init(void) {
 	vdrive_init();
 	tape_init();
 }
 
 void machine_shutdown(void) {
-	machine_remove_cart();
 	tape_shutdown();
 	vdrive_shutdown();
 }
 
+/* A new machine starts at the current time on the calling thread, with no
+ * events queued and no devices beyond the SAM.  machine_configure() creates
+ * the rest. */
+
+struct machine *machine_new(void) {
+	struct machine_private *mp = xzalloc(sizeof(*mp));
+	struct machine *m = &mp->public;
+	m->ram_size = 0x10000;
+	m->sam = sam_new();
+	m->sam->map_changed = DELEGATE_AS0(void, update_page_map_delegate, mp);
+	m->event_tick = event_current_tick;
+	m->event_list = NULL;
+	mp->ram_organisation = RAM_ORGANISATION_64K;
+	mp->ram_mask = 0xffff;
+	mp->irq_lines_dirty = 1;
+	event_init(&mp->run_end_event, DELEGATE_AS0(void, machine_run_end, mp));
+	mp->run_end_event.at_tick = m->event_tick;
+	return m;
+}
+
+void machine_free(struct machine *m) {
+	if (!m)
+		return;
+	struct machine_private *mp = (struct machine_private *)m;
+	machine_remove_cart(m);
+	// Anything still queued won't be run, and mustn't refer to this list
+	while (m->event_list)
+		(void)event_pop(&m->event_list);
+	if (selected_machine == mp)
+		machine_select(NULL);
+	if (m->cpu)
+		m->cpu->free(m->cpu);
+	if (m->pia0)
+		mc6821_free(m->pia0);
+	if (m->pia1)
+		mc6821_free(m->pia1);
+	if (m->vdg)
+		mc6847_free(m->vdg);
+	sam_free(m->sam);
+	free(mp);
+}
+
+/* Makes 'm' the machine whose time base this thread is using: its tick
+ * becomes event_current_tick, and MACHINE_EVENT_LIST refers to its event
+ * list.  The previously selected machine's tick is saved. */
+
+void machine_select(struct machine *m) {
+	struct machine_private *mp = (struct machine_private *)m;
+	if (mp == selected_machine)
+		return;
+	if (selected_machine)
+		selected_machine->public.event_tick = event_current_tick;
+	selected_machine = mp;
+	if (mp) {
+		event_current_tick = m->event_tick;
+		xroar_machine_events = &m->event_list;
+	} else {
+		xroar_machine_events = NULL;
+	}
+}
+
 /* VDG edge delegates */
 
 static void vdg_hs(void *sptr, _Bool level) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	if (level)
-		mc6821_set_cx1(&PIA0->a);
+		mc6821_set_cx1(&mp->public.pia0->a);
 	else
-		mc6821_reset_cx1(&PIA0->a);
-	sam_vdg_hsync(level);
+		mc6821_reset_cx1(&mp->public.pia0->a);
+	sam_vdg_hsync(mp->public.sam, level);
 }
 
 // PAL CoCos invert HS
 static void vdg_hs_pal_coco(void *sptr, _Bool level) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	if (level)
-		mc6821_reset_cx1(&PIA0->a);
+		mc6821_reset_cx1(&mp->public.pia0->a);
 	else
-		mc6821_set_cx1(&PIA0->a);
-	sam_vdg_hsync(level);
+		mc6821_set_cx1(&mp->public.pia0->a);
+	sam_vdg_hsync(mp->public.sam, level);
 }
 
 static void vdg_fs(void *sptr, _Bool level) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	if (level) {
-		mc6821_set_cx1(&PIA0->b);
+		mc6821_set_cx1(&mp->public.pia0->b);
 	} else {
-		mc6821_reset_cx1(&PIA0->b);
+		mc6821_reset_cx1(&mp->public.pia0->b);
+		textscreen_frame();
 	}
-	sam_vdg_fsync(level);
+	sam_vdg_fsync(mp->public.sam, level);
 }
 
 /* Dragon parallel printer line delegate. */
 
 //ACK is active low
 static void printer_ack(void *sptr, _Bool ack) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	if (ack)
-		mc6821_reset_cx1(&PIA1->a);
+		mc6821_reset_cx1(&mp->public.pia1->a);
 	else
-		mc6821_set_cx1(&PIA1->a);
+		mc6821_set_cx1(&mp->public.pia1->a);
 }
 
 /* Sound output can feed back into the single bit sound pin when it's
  * configured as an input. */
 
 static void single_bit_feedback(void *sptr, _Bool level) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
+	struct MC6821 *PIA1 = mp->public.pia1;
 	if (level) {
 		PIA1->b.in_source &= ~(1<<1);
 		PIA1->b.in_sink &= ~(1<<1);
@@ -492,110 +625,113 @@ static void single_bit_feedback(void *sptr, _Bool level) {
 /* Tape audio delegate */
 
 static void update_audio_from_tape(void *sptr, float value) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	sound_set_tape_level(value);
 	if (value >= 0.5)
-		PIA1->a.in_sink &= ~(1<<0);
+		mp->public.pia1->a.in_sink &= ~(1<<0);
 	else
-		PIA1->a.in_sink |= (1<<0);
+		mp->public.pia1->a.in_sink |= (1<<0);
 }
 
 /* Catridge signalling */
 
 static void cart_firq(void *sptr, _Bool level) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	if (level)
-		mc6821_set_cx1(&PIA1->b);
+		mc6821_set_cx1(&mp->public.pia1->b);
 	else
-		mc6821_reset_cx1(&PIA1->b);
+		mc6821_reset_cx1(&mp->public.pia1->b);
 }
 
 static void cart_nmi(void *sptr, _Bool level) {
-	(void)sptr;
-	MC6809_NMI_SET(CPU0, level);
+	struct machine_private *mp = sptr;
+	MC6809_NMI_SET(mp->public.cpu, level);
 }
 
 static void cart_halt(void *sptr, _Bool level) {
-	(void)sptr;
-	MC6809_HALT_SET(CPU0, level);
+	struct machine_private *mp = sptr;
+	MC6809_HALT_SET(mp->public.cpu, level);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void machine_configure(struct machine_config *mc) {
+void machine_configure(struct machine *m, struct machine_config *mc) {
 	if (!mc) return;
+	struct machine_private *mp = (struct machine_private *)m;
+	machine_select(m);
 	machine_config_complete(mc);
 	if (mc->description) {
 		LOG_DEBUG(1, "Machine: %s\n", mc->description);
 	}
+	m->config = mc;
+	mp->is_coco = (mc->architecture == ARCH_COCO);
+	mp->is_dragon64 = (mc->architecture == ARCH_DRAGON64);
+	_Bool is_dragon32 = (mc->architecture == ARCH_DRAGON32);
 	// CPU
-	if (CPU0) {
-		CPU0->free(CPU0);
-		CPU0 = NULL;
+	if (m->cpu) {
+		m->cpu->free(m->cpu);
+		m->cpu = NULL;
 	}
 	switch (mc->cpu) {
 	case CPU_MC6809: default:
-		CPU0 = mc6809_new();
+		m->cpu = mc6809_new();
 		break;
 	case CPU_HD6309:
-		CPU0 = hd6309_new();
+		m->cpu = hd6309_new();
 		break;
 	}
-	CPU0->read_cycle = read_cycle;
-	CPU0->write_cycle = write_cycle;
+	m->cpu->read_cycle = DELEGATE_AS1(uint8, uint16, read_cycle, mp);
+	m->cpu->write_cycle = DELEGATE_AS2(void, uint16, uint8, write_cycle, mp);
+	m->cpu->idle_cycles = DELEGATE_AS0(unsigned, idle_cycles, mp);
 	// PIAs
-	if (PIA0) {
-		mc6821_free(PIA0);
-		PIA0 = NULL;
-	}
-	if (PIA1) {
-		mc6821_free(PIA1);
-		PIA1 = NULL;
-	}
-	PIA0 = mc6821_new();
-	PIA0->a.data_preread = pia0a_data_preread;
-	PIA0->a.data_postwrite = pia0a_data_postwrite;
-	PIA0->a.control_postwrite = pia0a_control_postwrite;
-	PIA0->b.data_preread = pia0b_data_preread;
-	PIA0->b.data_postwrite = pia0b_data_postwrite;
-	PIA0->b.control_postwrite = pia0b_control_postwrite;
-	PIA1 = mc6821_new();
-	PIA1->a.data_preread = pia1a_data_preread;
-	PIA1->a.data_postwrite = pia1a_data_postwrite;
-	PIA1->a.control_postwrite = pia1a_control_postwrite;
-	PIA1->b.data_preread = pia1b_data_preread;
-	PIA1->b.data_postwrite = pia1b_data_postwrite;
-	PIA1->b.control_postwrite = pia1b_control_postwrite;
+	if (m->pia0) {
+		mc6821_free(m->pia0);
+		m->pia0 = NULL;
+	}
+	if (m->pia1) {
+		mc6821_free(m->pia1);
+		m->pia1 = NULL;
+	}
+	m->pia0 = mc6821_new();
+	m->pia0->a.data_preread = DELEGATE_AS0(void, pia0a_data_preread, mp);
+	m->pia0->a.control_postwrite = DELEGATE_AS0(void, pia0a_control_postwrite, mp);
+	m->pia0->b.data_preread = DELEGATE_AS0(void, pia0b_data_preread, mp);
+	m->pia0->b.control_postwrite = DELEGATE_AS0(void, pia0b_control_postwrite, mp);
+	m->pia1 = mc6821_new();
+	m->pia1->a.data_postwrite = DELEGATE_AS0(void, pia1a_data_postwrite, mp);
+	m->pia1->a.control_postwrite = DELEGATE_AS0(void, pia1a_control_postwrite, mp);
+	m->pia1->b.data_postwrite = DELEGATE_AS0(void, pia1b_data_postwrite, mp);
+	m->pia1->b.control_postwrite = DELEGATE_AS0(void, pia1b_control_postwrite, mp);
 
 	// Single-bit sound feedback
 #ifndef FAST_SOUND
-	sound_sbs_feedback = DELEGATE_AS1(void, bool, single_bit_feedback, NULL);
+	sound_sbs_feedback = DELEGATE_AS1(void, bool, single_bit_feedback, mp);
 #endif
 
 	// Tape
-	tape_update_audio = DELEGATE_AS1(void, float, update_audio_from_tape, NULL);
+	tape_update_audio = DELEGATE_AS1(void, float, update_audio_from_tape, mp);
 
 	// VDG
-	if (VDG0)
-		mc6847_free(VDG0);
-	VDG0 = mc6847_new(mc->vdg_type == VDG_6847T1);
+	if (m->vdg)
+		mc6847_free(m->vdg);
+	m->vdg = mc6847_new(mc->vdg_type == VDG_6847T1);
 
-	if (IS_COCO && IS_PAL) {
-		VDG0->signal_hs = DELEGATE_AS1(void, bool, vdg_hs_pal_coco, NULL);
+	if (mp->is_coco && mc->tv_standard == TV_PAL) {
+		m->vdg->signal_hs = DELEGATE_AS1(void, bool, vdg_hs_pal_coco, mp);
 	} else {
-		VDG0->signal_hs = DELEGATE_AS1(void, bool, vdg_hs, NULL);
+		m->vdg->signal_hs = DELEGATE_AS1(void, bool, vdg_hs, mp);
 	}
-	VDG0->signal_fs = DELEGATE_AS1(void, bool, vdg_fs, NULL);
-	VDG0->fetch_bytes = DELEGATE_AS2(void, int, uint8p, vdg_fetch_handler, NULL);
-	mc6847_set_inverted_text(VDG0, inverted_text);
+	m->vdg->signal_fs = DELEGATE_AS1(void, bool, vdg_fs, mp);
+	m->vdg->fetch_bytes = DELEGATE_AS2(void, int, uint8p, vdg_fetch_handler, mp);
+	mc6847_set_inverted_text(m->vdg, mp->inverted_text);
 
 	// Printer
-	printer_signal_ack = DELEGATE_AS1(void, bool, printer_ack, NULL);
+	printer_signal_ack = DELEGATE_AS1(void, bool, printer_ack, mp);
 
 	/* Load appropriate ROMs */
-	memset(rom0, 0, sizeof(rom0));
-	memset(rom1, 0, sizeof(rom1));
-	memset(ext_charset, 0, sizeof(ext_charset));
+	memset(mp->rom0, 0, sizeof(mp->rom0));
+	memset(mp->rom1, 0, sizeof(mp->rom1));
+	memset(mp->ext_charset, 0, sizeof(mp->ext_charset));
 
 	/*
 	 * CoCo ROMs are always considered to be in two parts: BASIC and
@@ -621,9 +757,9 @@ void machine_configure(struct machine_config *mc) {
 	if (!mc->noextbas && mc->extbas_rom) {
 		char *tmp = romlist_find(mc->extbas_rom);
 		if (tmp) {
-			int size = machine_load_rom(tmp, rom0, sizeof(rom0));
+			int size = machine_load_rom(tmp, mp->rom0, sizeof(mp->rom0));
 			if (size > 0) {
-				if (IS_DRAGON)
+				if (!mp->is_coco)
 					has_combined = 1;
 				else
 					has_extbas = 1;
@@ -641,7 +777,7 @@ void machine_configure(struct machine_config *mc) {
 	if (!mc->nobas && mc->bas_rom) {
 		char *tmp = romlist_find(mc->bas_rom);
 		if (tmp) {
-			int size = machine_load_rom(tmp, rom0 + 0x2000, sizeof(rom0) - 0x2000);
+			int size = machine_load_rom(tmp, mp->rom0 + 0x2000, sizeof(mp->rom0) - 0x2000);
 			if (size > 0)
 				has_bas = 1;
 			free(tmp);
@@ -652,20 +788,20 @@ void machine_configure(struct machine_config *mc) {
 	if (!mc->noaltbas && mc->altbas_rom) {
 		char *tmp = romlist_find(mc->altbas_rom);
 		if (tmp) {
-			int size = machine_load_rom(tmp, rom1, sizeof(rom1));
+			int size = machine_load_rom(tmp, mp->rom1, sizeof(mp->rom1));
 			if (size > 0)
 				has_altbas = 1;
 			free(tmp);
 		}
 	}
-	machine_ram_size = mc->ram * 1024;
+	m->ram_size = mc->ram * 1024;
 	/* This will be under PIA control on a Dragon 64 */
-	machine_rom = rom0;
+	mp->rom = mp->rom0;
 
 	if (mc->ext_charset_rom) {
 		char *tmp = romlist_find(mc->ext_charset_rom);
 		if (tmp) {
-			int size = machine_load_rom(tmp, ext_charset, sizeof(ext_charset));
+			int size = machine_load_rom(tmp, mp->ext_charset, sizeof(mp->ext_charset));
 			if (size > 0)
 				has_ext_charset = 1;
 			free(tmp);
@@ -675,132 +811,135 @@ void machine_configure(struct machine_config *mc) {
 	/* CRCs */
 	if (has_combined) {
 		_Bool forced = 0;
-		if (IS_DRAGON64 && xroar_cfg.force_crc_match) {
+		if (mp->is_dragon64 && xroar_cfg.force_crc_match) {
 			crc_combined = 0x84f68bf9;  // Dragon 64 Extended BASIC
 			forced = 1;
-		} else if (IS_DRAGON32 && xroar_cfg.force_crc_match) {
+		} else if (is_dragon32 && xroar_cfg.force_crc_match) {
 			crc_combined = 0xe3879310;  // Dragon 32 Extended BASIC
 			forced = 1;
 		} else {
-			crc_combined = crc32_block(CRC32_RESET, rom0, 0x4000);
+			crc_combined = crc32_block(CRC32_RESET, mp->rom0, 0x4000);
 		}
 		(void)forced;  // avoid warning if no logging
 		LOG_DEBUG(1, "\t32K mode BASIC CRC = 0x%08x%s\n", crc_combined, forced ? " (forced)" : "");
 	}
 	if (has_altbas) {
 		_Bool forced = 0;
-		if (IS_DRAGON64 && xroar_cfg.force_crc_match) {
+		if (mp->is_dragon64 && xroar_cfg.force_crc_match) {
 			crc_altbas = 0x17893a42;  // Dragon 64 64K mode Extended BASIC
 			forced = 1;
 		} else {
-			crc_altbas = crc32_block(CRC32_RESET, rom1, 0x4000);
+			crc_altbas = crc32_block(CRC32_RESET, mp->rom1, 0x4000);
 		}
 		(void)forced;  // avoid warning if no logging
 		LOG_DEBUG(1, "\t64K mode BASIC CRC = 0x%08x%s\n", crc_altbas, forced ? " (forced)" : "");
 	}
 	if (has_bas) {
 		_Bool forced = 0;
-		if (IS_COCO && xroar_cfg.force_crc_match) {
+		if (mp->is_coco && xroar_cfg.force_crc_match) {
 			crc_bas = 0xd8f4d15e;  // CoCo BASIC 1.3
 			forced = 1;
 		} else {
-			crc_bas = crc32_block(CRC32_RESET, rom0 + 0x2000, 0x2000);
+			crc_bas = crc32_block(CRC32_RESET, mp->rom0 + 0x2000, 0x2000);
 		}
 		(void)forced;  // avoid warning if no logging
 		LOG_DEBUG(1, "\tBASIC CRC = 0x%08x%s\n", crc_bas, forced ? " (forced)" : "");
 	}
 	if (has_extbas) {
 		_Bool forced = 0;
-		if (IS_COCO && xroar_cfg.force_crc_match) {
+		if (mp->is_coco && xroar_cfg.force_crc_match) {
 			crc_extbas = 0xa82a6254;  // CoCo Extended BASIC 1.1
 			forced = 1;
 		} else {
-			crc_extbas = crc32_block(CRC32_RESET, rom0, 0x2000);
+			crc_extbas = crc32_block(CRC32_RESET, mp->rom0, 0x2000);
 		}
 		(void)forced;  // avoid warning if no logging
 		LOG_DEBUG(1, "\tExtended BASIC CRC = 0x%08x%s\n", crc_extbas, forced ? " (forced)" : "");
 	}
 	if (has_ext_charset) {
-		crc_ext_charset = crc32_block(CRC32_RESET, ext_charset, 0x1000);
+		crc_ext_charset = crc32_block(CRC32_RESET, mp->ext_charset, 0x1000);
 		LOG_DEBUG(1, "\tExternal charset CRC = 0x%08x\n", crc_ext_charset);
 	}
 
 	/* VDG external charset */
 	if (has_ext_charset)
-		mc6847_set_ext_charset(VDG0, ext_charset);
+		mc6847_set_ext_charset(m->vdg, mp->ext_charset);
 	else
-		mc6847_set_ext_charset(VDG0, NULL);
+		mc6847_set_ext_charset(m->vdg, NULL);
 
 	/* Default all PIA connections to unconnected (no source, no sink) */
-	PIA0->b.in_source = 0;
-	PIA1->b.in_source = 0;
-	PIA0->a.in_sink = PIA0->b.in_sink = 0xff;
-	PIA1->a.in_sink = PIA1->b.in_sink = 0xff;
+	m->pia0->b.in_source = 0;
+	m->pia1->b.in_source = 0;
+	m->pia0->a.in_sink = m->pia0->b.in_sink = 0xff;
+	m->pia1->a.in_sink = m->pia1->b.in_sink = 0xff;
 	/* Machine-specific PIA connections */
-	if (IS_DRAGON) {
+	if (!mp->is_coco) {
 		/* Centronics printer port - !BUSY */
-		PIA1->b.in_source |= (1<<0);
+		m->pia1->b.in_source |= (1<<0);
 	}
-	if (IS_DRAGON64) {
-		have_acia = 1;
-		PIA1->b.in_source |= (1<<2);
-	} else if (IS_COCO && machine_ram_size <= 0x1000) {
+	if (mp->is_dragon64) {
+		mp->have_acia = 1;
+		m->pia1->b.in_source |= (1<<2);
+	} else if (mp->is_coco && m->ram_size <= 0x1000) {
 		/* 4K CoCo ties PB2 of PIA1 low */
-		PIA1->b.in_sink &= ~(1<<2);
-	} else if (IS_COCO && machine_ram_size <= 0x4000) {
+		m->pia1->b.in_sink &= ~(1<<2);
+	} else if (mp->is_coco && m->ram_size <= 0x4000) {
 		/* 16K CoCo pulls PB2 of PIA1 high */
-		PIA1->b.in_source |= (1<<2);
+		m->pia1->b.in_source |= (1<<2);
 	}
-	PIA0->b.data_preread = pia0b_data_preread;
-	if (IS_DRAGON) {
+	if (!mp->is_coco) {
 		/* Dragons need to poll printer BUSY state */
-		PIA1->b.data_preread = pia1b_data_preread_dragon;
+		m->pia1->b.data_preread = DELEGATE_AS0(void, pia1b_data_preread_dragon, mp);
 	}
-	if (IS_COCO && machine_ram_size > 0x4000) {
-		/* 64K CoCo connects PB6 of PIA0 to PB2 of PIA1->
+	if (mp->is_coco && m->ram_size > 0x4000) {
+		/* 64K CoCo connects PB6 of PIA0 to PB2 of PIA1.
 		 * Deal with this through a postwrite. */
-		PIA0->b.data_preread = pia0b_data_preread_coco64k;
-		PIA1->b.data_preread = pia1b_data_preread_coco64k;
+		m->pia0->b.data_preread = DELEGATE_AS0(void, pia0b_data_preread_coco64k, mp);
+		m->pia1->b.data_preread = DELEGATE_AS0(void, pia1b_data_preread_coco64k, mp);
 	}
 
-	if (IS_DRAGON) {
+	if (!mp->is_coco) {
 		keyboard_set_chord_mode(keyboard_chord_mode_dragon_32k_basic);
 	} else {
 		keyboard_set_chord_mode(keyboard_chord_mode_coco_basic);
 	}
 
-	unexpanded_dragon32 = 0;
-	ram_mask = 0xffff;
+	mp->unexpanded_dragon32 = 0;
+	mp->ram_mask = 0xffff;
 
-	if (IS_COCO) {
-		if (machine_ram_size <= 0x2000) {
-			ram_organisation = RAM_ORGANISATION_4K;
-			ram_mask = 0x3f3f;
-		} else if (machine_ram_size <= 0x4000) {
-			ram_organisation = RAM_ORGANISATION_16K;
+	if (mp->is_coco) {
+		if (m->ram_size <= 0x2000) {
+			mp->ram_organisation = RAM_ORGANISATION_4K;
+			mp->ram_mask = 0x3f3f;
+		} else if (m->ram_size <= 0x4000) {
+			mp->ram_organisation = RAM_ORGANISATION_16K;
 		} else {
-			ram_organisation = RAM_ORGANISATION_64K;
-			if (machine_ram_size <= 0x8000)
-				ram_mask = 0x7fff;
+			mp->ram_organisation = RAM_ORGANISATION_64K;
+			if (m->ram_size <= 0x8000)
+				mp->ram_mask = 0x7fff;
 		}
 	}
 
-	if (IS_DRAGON) {
-		ram_organisation = RAM_ORGANISATION_64K;
-		if (IS_DRAGON32 && machine_ram_size <= 0x8000) {
-			unexpanded_dragon32 = 1;
-			ram_mask = 0x7fff;
+	if (!mp->is_coco) {
+		mp->ram_organisation = RAM_ORGANISATION_64K;
+		if (is_dragon32 && m->ram_size <= 0x8000) {
+			mp->unexpanded_dragon32 = 1;
+			mp->ram_mask = 0x7fff;
 		}
 	}
 
+	update_page_map(mp);
+
 #ifndef FAST_SOUND
 	machine_select_fast_sound(xroar_cfg.fast_sound);
 #endif
 }
 
-void machine_reset(_Bool hard) {
-	xroar_set_keymap(xroar_machine_config->keymap);
-	switch (xroar_machine_config->tv_standard) {
+void machine_reset(struct machine *m, _Bool hard) {
+	struct machine_private *mp = (struct machine_private *)m;
+	machine_select(m);
+	xroar_set_keymap(m->config->keymap);
+	switch (m->config->tv_standard) {
 	case TV_PAL: default:
 		xroar_set_cross_colour(1, CROSS_COLOUR_OFF);
 		break;
@@ -809,94 +948,118 @@ void machine_reset(_Bool hard) {
 		break;
 	}
 	if (hard) {
-		initialise_ram();
+		initialise_ram(mp);
 	}
-	mc6821_reset(PIA0);
-	mc6821_reset(PIA1);
-	if (machine_cart && machine_cart->reset) {
-		machine_cart->reset(machine_cart);
+	mc6821_reset(m->pia0);
+	mc6821_reset(m->pia1);
+	if (m->cart && m->cart->reset) {
+		m->cart->reset(m->cart);
 	}
-	sam_reset();
-	CPU0->reset(CPU0);
+	sam_reset(m->sam);
+	m->cpu->reset(m->cpu);
 #ifdef TRACE
 	mc6809_trace_reset();
 	hd6309_trace_reset();
 #endif
-	mc6847_reset(VDG0);
+	mc6847_reset(m->vdg);
 	tape_reset();
+	mp->irq_lines_dirty = 1;
 }
 
-int machine_run(int ncycles) {
-	stop_signal = 0;
-	cycles += ncycles;
-	CPU0->running = 1;
-	CPU0->run(CPU0);
-	return stop_signal;
+int machine_run(struct machine *m, int ncycles) {
+	struct machine_private *mp = (struct machine_private *)m;
+	machine_select(m);
+	mp->stop_signal = 0;
+	mp->run_end_event.at_tick += ncycles;
+	event_queue(&m->event_list, &mp->run_end_event);
+	mp->irq_lines_dirty = 1;
+	m->cpu->running = 1;
+	m->cpu->run(m->cpu);
+	return mp->stop_signal;
 }
 
-void machine_single_step(void) {
-	single_step = 1;
-	CPU0->running = 0;
-	CPU0->instruction_posthook = DELEGATE_AS0(void, machine_instruction_posthook, CPU0);
+static void machine_run_end(void *sptr) {
+	struct machine_private *mp = sptr;
+	mp->public.cpu->running = 0;
+}
+
+void machine_single_step(struct machine *m) {
+	struct machine_private *mp = (struct machine_private *)m;
+	machine_select(m);
+	mp->single_step = 1;
+	mp->irq_lines_dirty = 1;
+	m->cpu->running = 0;
+	m->cpu->instruction_posthook = DELEGATE_AS0(void, machine_instruction_posthook, mp);
 	do {
-		CPU0->run(CPU0);
-	} while (single_step);
-	update_vdg_mode();
+		m->cpu->run(m->cpu);
+	} while (mp->single_step);
+	update_vdg_mode(mp);
 	if (xroar_cfg.trace_enabled)
-		CPU0->instruction_posthook.func = NULL;
+		m->cpu->instruction_posthook.func = NULL;
 }
 
 /*
  * Stop emulation and set stop_signal to reflect the reason.
  */
 
-void machine_signal(int sig) {
-	update_vdg_mode();
-	stop_signal = sig;
-	CPU0->running = 0;
+void machine_signal(struct machine *m, int sig) {
+	struct machine_private *mp = (struct machine_private *)m;
+	update_vdg_mode(mp);
+	mp->stop_signal = sig;
+	m->cpu->running = 0;
 }
 
-void machine_set_trace(_Bool trace_on) {
-	if (trace_on || single_step)
-		CPU0->instruction_posthook = DELEGATE_AS0(void, machine_instruction_posthook, CPU0);
+void machine_set_trace(struct machine *m, _Bool trace_on) {
+	struct machine_private *mp = (struct machine_private *)m;
+	if (trace_on || mp->single_step)
+		m->cpu->instruction_posthook = DELEGATE_AS0(void, machine_instruction_posthook, mp);
 	else
-		CPU0->instruction_posthook.func = NULL;
+		m->cpu->instruction_posthook.func = NULL;
 }
 
 /*
  * Device inspection.
  */
 
-int machine_num_cpus(void) {
+int machine_num_cpus(struct machine *m) {
+	(void)m;
 	return 1;
 }
 
-int machine_num_pias(void) {
+int machine_num_pias(struct machine *m) {
+	(void)m;
 	return 2;
 }
 
-struct MC6809 *machine_get_cpu(int n) {
+struct MC6809 *machine_get_cpu(struct machine *m, int n) {
 	if (n != 0)
 		return NULL;
-	return CPU0;
+	return m->cpu;
 }
 
-struct MC6821 *machine_get_pia(int n) {
+struct MC6821 *machine_get_pia(struct machine *m, int n) {
 	if (n == 0)
-		return PIA0;
+		return m->pia0;
 	if (n == 1)
-		return PIA1;
+		return m->pia1;
 	return NULL;
 }
 
+struct MC6883 *machine_get_sam(struct machine *m, int n) {
+	if (n != 0)
+		return NULL;
+	return m->sam;
+}
+
 /*
  * Used when single-stepping or tracing.
  */
 
 static void machine_instruction_posthook(void *sptr) {
-	struct MC6809 *cpu = sptr;
+	struct machine_private *mp = sptr;
+	struct MC6809 *cpu = mp->public.cpu;
 	if (xroar_cfg.trace_enabled) {
-		switch (xroar_machine_config->cpu) {
+		switch (mp->public.config->cpu) {
 		case CPU_MC6809: default:
 			mc6809_trace_print(cpu);
 			break;
@@ -905,92 +1068,251 @@ static void machine_instruction_posthook(void *sptr) {
 			break;
 		}
 	}
-	single_step = 0;
+	mp->single_step = 0;
 }
 
-static uint16_t decode_Z(uint16_t Z) {
-	switch (ram_organisation) {
+static uint16_t decode_Z(struct machine_private *mp, uint16_t Z) {
+	switch (mp->ram_organisation) {
 	case RAM_ORGANISATION_4K:
 		return (Z & 0x3f) | ((Z & 0x3f00) >> 2) | ((~Z & 0x8000) >> 3);
 	case RAM_ORGANISATION_16K:
 		return (Z & 0x7f) | ((Z & 0x7f00) >> 1) | ((~Z & 0x8000) >> 1);
 	case RAM_ORGANISATION_64K: default:
-		return Z & ram_mask;
+		return Z & mp->ram_mask;
 	}
 }
 
+_Bool machine_text_vram(struct machine *m, uint8_t *dest) {
+	struct machine_private *mp = (struct machine_private *)m;
+	unsigned vmode = m->pia1->b.out_source & m->pia1->b.out_sink;
+	unsigned sam_reg = sam_get_register(m->sam);
+	// A/G set, or SAM not in alphanumeric/semigraphics mode
+	if ((vmode & 0x80) || (sam_reg & 7) != 0)
+		return 0;
+	uint16_t base = (sam_reg & 0x03f8) << 6;
+	for (int i = 0; i < 512; i++)
+		dest[i] = m->ram[decode_Z(mp, sam_vdg_translate(m->sam, base + i))];
+	return 1;
+}
+
+static void update_cpu_irq_lines(struct machine_private *mp) {
+	mp->irq_lines_dirty = 0;
+	MC6809_IRQ_SET(mp->public.cpu, mp->public.pia0->a.irq | mp->public.pia0->b.irq);
+	MC6809_FIRQ_SET(mp->public.cpu, mp->public.pia1->a.irq | mp->public.pia1->b.irq);
+}
+
+/* Advance time by one CPU cycle.  The head of the machine event queue (which
+ * always includes the end of the current run) acts as the deadline: until it
+ * is reached, a cycle is just a tick count and one comparison against it.
+ * Interrupt lines are only re-evaluated after events have run or a device may
+ * have changed them. */
+static void cpu_cycle(struct machine_private *mp, int ncycles) {
+	event_current_tick += ncycles;
+	if (event_pending(&mp->public.event_list)) {
+		event_run_queue(&mp->public.event_list);
+		mp->irq_lines_dirty = 1;
+	}
+	if (mp->irq_lines_dirty)
+		update_cpu_irq_lines(mp);
+}
+
 /* Interface to SAM to decode and translate address */
-static _Bool do_cpu_cycle(uint16_t A, _Bool RnW, int *S, uint16_t *Z) {
+static _Bool do_cpu_cycle(struct machine_private *mp, uint16_t A, _Bool RnW, int *S, uint16_t *Z) {
 	uint16_t tmp_Z;
 	int ncycles;
-	_Bool is_ram_access = sam_run(A, RnW, S, &tmp_Z, &ncycles);
+	_Bool is_ram_access = sam_run(mp->public.sam, A, RnW, S, &tmp_Z, &ncycles);
 	if (is_ram_access) {
-		*Z = decode_Z(tmp_Z);
+		*Z = decode_Z(mp, tmp_Z);
 	}
-	cycles -= ncycles;
-	if (cycles <= 0) CPU0->running = 0;
-	event_current_tick += ncycles;
-	event_run_queue(&MACHINE_EVENT_LIST);
-	MC6809_IRQ_SET(CPU0, PIA0->a.irq | PIA0->b.irq);
-	MC6809_FIRQ_SET(CPU0, PIA1->a.irq | PIA1->b.irq);
+	cpu_cycle(mp, ncycles);
 	return is_ram_access;
 }
 
+/* Translated RAM address for the start of a page, if the rest of the page
+ * follows on linearly (true for all but the smaller RAM organisations). */
+static _Bool ram_page_base(struct machine_private *mp, uint16_t A, uint16_t *Z) {
+	int S;
+	uint16_t tmp_Z;
+	if (!sam_run(mp->public.sam, A, 1, &S, &tmp_Z, NULL))
+		return 0;
+	uint16_t base = decode_Z(mp, tmp_Z);
+	if (base & 0xff)
+		return 0;
+	for (unsigned b = 1; b < 0x100; b <<= 1) {
+		sam_run(mp->public.sam, A | b, 1, &S, &tmp_Z, NULL);
+		if (decode_Z(mp, tmp_Z) != (base | b))
+			return 0;
+	}
+	*Z = base;
+	return 1;
+}
+
+static void update_page_map(struct machine_private *mp) {
+	memset(mp->page_unmapped, 0xff, sizeof(mp->page_unmapped));
+	mp->page_map_rom = mp->rom;
+	for (unsigned page = 0; page < 0xff; page++) {
+		uint16_t A = page << 8;
+		struct machine_page *p = &mp->page_map[page];
+		int S_read, S_write;
+		uint16_t Z;
+		(void)sam_run(mp->public.sam, A, 1, &S_read, &Z, NULL);
+		_Bool is_ram_write = sam_run(mp->public.sam, A, 0, &S_write, &Z, NULL);
+		_Bool linear = ram_page_base(mp, A, &Z);
+		p->fast = sam_is_fast_cycle(mp->public.sam, A);
+		p->read = NULL;
+		p->write = NULL;
+		p->write_cart = 0;
+		switch (S_read) {
+		case 0:
+			if (linear)
+				p->read = (Z < mp->public.ram_size) ? mp->public.ram + Z : mp->page_unmapped;
+			break;
+		case 1:
+		case 2:
+			if (mp->rom)
+				p->read = mp->rom + (A & 0x3f00);
+			break;
+		default:
+			break;
+		}
+		if (is_ram_write && !linear)
+			continue;
+		switch (S_write) {
+		case 1: case 2: case 3:
+			if (!mp->unexpanded_dragon32) {
+				p->write = is_ram_write ? mp->public.ram + Z : mp->page_discard;
+				p->dirty = is_ram_write ? &mp->public.ram_dirty[Z >> 8] : &mp->page_discard_dirty;
+			}
+			break;
+		case 7:
+			p->write = mp->public.ram + Z;
+			p->dirty = &mp->public.ram_dirty[Z >> 8];
+			p->write_cart = 1;
+			break;
+		default:
+			break;
+		}
+	}
+	/* Page 0xff contains I/O and the SAM control register */
+	mp->page_map[0xff].read = NULL;
+	mp->page_map[0xff].write = NULL;
+	mp->page_vectors = mp->rom ? mp->rom + 0x3f00 : NULL;
+	mp->page_vectors_fast = sam_is_fast_cycle(mp->public.sam, 0xffe0);
+}
+
+static void update_page_map_delegate(void *sptr) {
+	update_page_map(sptr);
+}
+
 /* Same as do_cpu_cycle, but for debugging accesses */
-static _Bool debug_cpu_cycle(uint16_t A, _Bool RnW, int *S, uint16_t *Z) {
+static _Bool debug_cpu_cycle(struct machine_private *mp, uint16_t A, _Bool RnW, int *S, uint16_t *Z) {
 	uint16_t tmp_Z;
-	_Bool is_ram_access = sam_run(A, RnW, S, &tmp_Z, NULL);
+	_Bool is_ram_access = sam_run(mp->public.sam, A, RnW, S, &tmp_Z, NULL);
 	if (is_ram_access) {
-		*Z = decode_Z(tmp_Z);
+		*Z = decode_Z(mp, tmp_Z);
 	}
-	MC6809_IRQ_SET(CPU0, PIA0->a.irq | PIA0->b.irq);
-	MC6809_FIRQ_SET(CPU0, PIA1->a.irq | PIA1->b.irq);
+	update_cpu_irq_lines(mp);
 	return is_ram_access;
 }
 
-static uint8_t read_D = 0;
+static uint8_t read_cycle(void *sptr, uint16_t A) {
+	struct machine_private *mp = sptr;
+	struct machine_page const *page = &mp->page_map[A >> 8];
+	if (page->read) {
+		uint8_t const *data = page->read;
+		cpu_cycle(mp, sam_cycle_ncycles(mp->public.sam, page->fast));
+		mp->read_D = data[A & 0xff];
+	} else if (A >= 0xffe0 && mp->page_vectors) {
+		cpu_cycle(mp, sam_cycle_ncycles(mp->public.sam, mp->page_vectors_fast));
+		mp->read_D = mp->page_vectors[A & 0xff];
+	} else {
+		read_cycle_slow(mp, A);
+	}
+#ifdef TRACE
+	if (xroar_cfg.trace_enabled) {
+		switch (mp->public.config->cpu) {
+		case CPU_MC6809: default:
+			mc6809_trace_byte(mp->read_D, A);
+			break;
+		case CPU_HD6309:
+			hd6309_trace_byte(mp->read_D, A);
+			break;
+		}
+	}
+#endif
+	if (bp_wp_enabled)
+		bp_wp_read_hook(A);
+	return mp->read_D;
+}
+
+/* While the CPU waits in SYNC or CWAI, it only performs dummy reads of 0xffff.
+ * Until the next machine event is due, nothing can change but the time, so
+ * skip straight to the cycle before it.  The first cycle at a new MPU rate,
+ * or after a device has touched the interrupt lines, is left to happen
+ * normally. */
+static unsigned idle_cycles(void *sptr) {
+	struct machine_private *mp = sptr;
+	if (!mp->public.event_list || !mp->page_vectors || bp_wp_enabled || mp->irq_lines_dirty)
+		return 0;
+#ifdef TRACE
+	if (xroar_cfg.trace_enabled)
+		return 0;
+#endif
+	if (mp->public.sam->running_fast != mp->page_vectors_fast)
+		return 0;
+	event_ticks remaining = mp->public.event_list->at_tick - event_current_tick;
+	if (remaining == 0 || remaining > (UINT_MAX/2))
+		return 0;
+	int step = mp->page_vectors_fast ? SAM_CPU_FAST_DIVISOR : SAM_CPU_SLOW_DIVISOR;
+	unsigned n = (remaining - 1) / step;
+	if (mp->page_vectors_fast && (n & 1))
+		mp->public.sam->odd_cycle = !mp->public.sam->odd_cycle;
+	event_current_tick += n * step;
+	return n;
+}
 
-static uint8_t read_cycle(uint16_t A) {
+/* Full address decode for reads from I/O or unusually mapped pages */
+static void read_cycle_slow(struct machine_private *mp, uint16_t A) {
 	int S;
 	uint16_t Z = 0;
-	_Bool is_ram_access = do_cpu_cycle(A, 1, &S, &Z);
+	_Bool is_ram_access = do_cpu_cycle(mp, A, 1, &S, &Z);
 	/* Thanks to CrAlt on #coco_chat for verifying that RAM accesses
 	 * produce a different "null" result on his 16K CoCo */
 	if (is_ram_access)
-		read_D = 0xff;
+		mp->read_D = 0xff;
 	switch (S) {
 		case 0:
-			if (Z < machine_ram_size)
-				read_D = machine_ram[Z];
+			if (Z < mp->public.ram_size)
+				mp->read_D = mp->public.ram[Z];
 			break;
 		case 1:
 		case 2:
-			read_D = machine_rom[A & 0x3fff];
+			mp->read_D = mp->rom[A & 0x3fff];
 			break;
 		case 3:
-			if (machine_cart)
-				machine_cart->read(machine_cart, A, 0, &read_D);
+			if (mp->public.cart)
+				mp->public.cart->read(mp->public.cart, A, 0, &mp->read_D);
 			break;
 		case 4:
-			if (IS_COCO) {
-				read_D = mc6821_read(PIA0, A & 3);
+			if (mp->is_coco) {
+				mp->read_D = mc6821_read(mp->public.pia0, A & 3);
 			} else {
 				if ((A & 4) == 0) {
-					read_D = mc6821_read(PIA0, A & 3);
+					mp->read_D = mc6821_read(mp->public.pia0, A & 3);
 				} else {
-					if (have_acia) {
+					if (mp->have_acia) {
 						/* XXX Dummy ACIA reads */
 						switch (A & 3) {
 						default:
 						case 0:  /* Receive Data */
 						case 3:  /* Control */
-							read_D = 0x00;
+							mp->read_D = 0x00;
 							break;
 						case 2:  /* Command */
-							read_D = 0x02;
+							mp->read_D = 0x02;
 							break;
 						case 1:  /* Status */
-							read_D = 0x10;
+							mp->read_D = 0x10;
 							break;
 						}
 					}
@@ -998,145 +1320,149 @@ static uint8_t read_cycle(uint16_t A) {
 			}
 			break;
 		case 5:
-			read_D = mc6821_read(PIA1, A & 3);
+			mp->read_D = mc6821_read(mp->public.pia1, A & 3);
 			break;
 		case 6:
-			if (machine_cart)
-				machine_cart->read(machine_cart, A, 1, &read_D);
+			if (mp->public.cart)
+				mp->public.cart->read(mp->public.cart, A, 1, &mp->read_D);
 			break;
 		default:
 			break;
 	}
-#ifdef TRACE
-	if (xroar_cfg.trace_enabled) {
-		switch (xroar_machine_config->cpu) {
-		case CPU_MC6809: default:
-			mc6809_trace_byte(read_D, A);
-			break;
-		case CPU_HD6309:
-			hd6309_trace_byte(read_D, A);
-			break;
+	/* Device accesses may change interrupt lines */
+	if (S >= 3)
+		mp->irq_lines_dirty = 1;
+}
+
+static void write_cycle(void *sptr, uint16_t A, uint8_t D) {
+	struct machine_private *mp = sptr;
+	struct machine_page const *page = &mp->page_map[A >> 8];
+	if (page->write) {
+		uint8_t *data = page->write;
+		cpu_cycle(mp, sam_cycle_ncycles(mp->public.sam, page->fast));
+		if (page->write_cart && mp->public.cart) {
+			// Should call cart's write() whatever the address and
+			// set P2 accordingly, but for now this enables orch90:
+			mp->public.cart->write(mp->public.cart, A, 0, D);
+			mp->irq_lines_dirty = 1;
 		}
+		data[A & 0xff] = D;
+		*page->dirty = 1;
+	} else {
+		write_cycle_slow(mp, A, D);
 	}
-#endif
-	bp_wp_read_hook(A);
-	return read_D;
+	if (bp_wp_enabled)
+		bp_wp_write_hook(A);
 }
 
-static void write_cycle(uint16_t A, uint8_t D) {
+/* Full address decode for writes to I/O or unusually mapped pages */
+static void write_cycle_slow(struct machine_private *mp, uint16_t A, uint8_t D) {
 	int S;
 	uint16_t Z = 0;
 	// Changing the SAM VDG mode can affect its idea of the current VRAM
 	// address, so get the VDG output up to date:
 	if (A >= 0xffc0 && A < 0xffc6) {
-		update_vdg_mode();
+		update_vdg_mode(mp);
 	}
-	_Bool is_ram_access = do_cpu_cycle(A, 0, &S, &Z);
-	if ((S & 4) || unexpanded_dragon32) {
+	_Bool is_ram_access = do_cpu_cycle(mp, A, 0, &S, &Z);
+	if ((S & 4) || mp->unexpanded_dragon32) {
 		switch (S) {
 			case 1:
 			case 2:
-				D = machine_rom[A & 0x3fff];
+				D = mp->rom[A & 0x3fff];
 				break;
 			case 3:
-				if (machine_cart)
-					machine_cart->write(machine_cart, A, 0, D);
+				if (mp->public.cart)
+					mp->public.cart->write(mp->public.cart, A, 0, D);
 				break;
 			case 4:
-				if (IS_COCO) {
-					mc6821_write(PIA0, A & 3, D);
+				if (mp->is_coco) {
+					mc6821_write(mp->public.pia0, A & 3, D);
 				} else {
 					if ((A & 4) == 0) {
-						mc6821_write(PIA0, A & 3, D);
+						mc6821_write(mp->public.pia0, A & 3, D);
 					}
 				}
 				break;
 			case 5:
-				mc6821_write(PIA1, A & 3, D);
+				mc6821_write(mp->public.pia1, A & 3, D);
 				break;
 			case 6:
-				if (machine_cart)
-					machine_cart->write(machine_cart, A, 1, D);
+				if (mp->public.cart)
+					mp->public.cart->write(mp->public.cart, A, 1, D);
 				break;
 			// Should call cart's write() whatever the address and
 			// set P2 accordingly, but for now this enables orch90:
 			case 7:
-				if (machine_cart)
-					machine_cart->write(machine_cart, A, 0, D);
+				if (mp->public.cart)
+					mp->public.cart->write(mp->public.cart, A, 0, D);
 				break;
 			default:
 				break;
 		}
+		/* Device accesses may change interrupt lines */
+		if (S >= 3)
+			mp->irq_lines_dirty = 1;
 	}
 	if (is_ram_access) {
-		machine_ram[Z] = D;
+		mp->public.ram[Z] = D;
+		mp->public.ram_dirty[Z >> 8] = 1;
 	}
-	bp_wp_write_hook(A);
 }
 
 static void vdg_fetch_handler(void *sptr, int nbytes, uint8_t *dest) {
-	(void)sptr;
+	struct machine_private *mp = sptr;
 	while (nbytes > 0) {
 		uint16_t V = 0;
 		_Bool valid;
-		int n = sam_vdg_bytes(nbytes, &V, &valid);
+		int n = sam_vdg_bytes(mp->public.sam, nbytes, &V, &valid);
 		if (dest) {
 			if (valid) {
-				V = decode_Z(V);
-			}
-			uint8_t *src = machine_ram + V;
-			if (has_ext_charset) {
-				/* omit INV in attrs */
-				for (int i = n; i; i--) {
-					*(dest++) = *(src);
-					*(dest++) = *(src++) & 0x80;
-				}
-			} else {
-				/* duplicate data as attrs */
-				for (int i = n; i; i--) {
-					*(dest++) = *(src);
-					*(dest++) = *(src++);
-				}
+				V = decode_Z(mp, V);
 			}
+			/* each call covers a contiguous run of RAM */
+			memcpy(dest, mp->public.ram + V, n);
+			dest += n;
 		}
 		nbytes -= n;
 	}
 }
 
-void machine_toggle_pause(void) {
-	CPU0->halt = !CPU0->halt;
+void machine_toggle_pause(struct machine *m) {
+	m->cpu->halt = !m->cpu->halt;
 }
 
 /* Read a byte without advancing clock.  Used for debugging & breakpoints. */
 
-uint8_t machine_read_byte(uint16_t A) {
-	uint8_t D = read_D;
+uint8_t machine_read_byte(struct machine *m, uint16_t A) {
+	struct machine_private *mp = (struct machine_private *)m;
+	uint8_t D = mp->read_D;
 	int S;
 	uint16_t Z = 0;
-	_Bool is_ram_access = debug_cpu_cycle(A, 1, &S, &Z);
+	_Bool is_ram_access = debug_cpu_cycle(mp, A, 1, &S, &Z);
 	if (is_ram_access)
 		D = 0xff;
 	switch (S) {
 		case 0:
-			if (Z < machine_ram_size)
-				D = machine_ram[Z];
+			if (Z < mp->public.ram_size)
+				D = mp->public.ram[Z];
 			break;
 		case 1:
 		case 2:
-			D = machine_rom[A & 0x3fff];
+			D = mp->rom[A & 0x3fff];
 			break;
 		case 3:
-			if (machine_cart)
-				machine_cart->read(machine_cart, A, 0, &D);
+			if (mp->public.cart)
+				mp->public.cart->read(mp->public.cart, A, 0, &D);
 			break;
 		case 4:
-			if (IS_COCO) {
-				D = mc6821_read(PIA0, A & 3);
+			if (mp->is_coco) {
+				D = mc6821_read(mp->public.pia0, A & 3);
 			} else {
 				if ((A & 4) == 0) {
-					D = mc6821_read(PIA0, A & 3);
+					D = mc6821_read(mp->public.pia0, A & 3);
 				} else {
-					if (have_acia) {
+					if (mp->have_acia) {
 						/* XXX Dummy ACIA reads */
 						switch (A & 3) {
 						default:
@@ -1156,68 +1482,75 @@ uint8_t machine_read_byte(uint16_t A) {
 			}
 			break;
 		case 5:
-			D = mc6821_read(PIA1, A & 3);
+			D = mc6821_read(mp->public.pia1, A & 3);
 			break;
 		case 6:
-			if (machine_cart)
-				machine_cart->read(machine_cart, A, 1, &D);
+			if (mp->public.cart)
+				mp->public.cart->read(mp->public.cart, A, 1, &D);
 			break;
 		default:
 			break;
 	}
+	if (S >= 3)
+		mp->irq_lines_dirty = 1;
 	return D;
 }
 
 /* Write a byte without advancing clock.  Used for debugging & breakpoints. */
 
-void machine_write_byte(uint16_t A, uint8_t D) {
+void machine_write_byte(struct machine *m, uint16_t A, uint8_t D) {
+	struct machine_private *mp = (struct machine_private *)m;
 	int S;
 	uint16_t Z = 0;
 	// Changing the SAM VDG mode can affect its idea of the current VRAM
 	// address, so get the VDG output up to date:
 	if (A >= 0xffc0 && A < 0xffc6) {
-		update_vdg_mode();
+		update_vdg_mode(mp);
 	}
-	_Bool is_ram_access = debug_cpu_cycle(A, 0, &S, &Z);
-	if ((S & 4) || unexpanded_dragon32) {
+	_Bool is_ram_access = debug_cpu_cycle(mp, A, 0, &S, &Z);
+	if ((S & 4) || mp->unexpanded_dragon32) {
 		switch (S) {
 			case 1:
 			case 2:
-				D = machine_rom[A & 0x3fff];
+				D = mp->rom[A & 0x3fff];
 				break;
 			case 3:
-				if (machine_cart)
-					machine_cart->write(machine_cart, A, 0, D);
+				if (mp->public.cart)
+					mp->public.cart->write(mp->public.cart, A, 0, D);
 				break;
 			case 4:
-				if (IS_COCO) {
-					mc6821_write(PIA0, A & 3, D);
+				if (mp->is_coco) {
+					mc6821_write(mp->public.pia0, A & 3, D);
 				} else {
 					if ((A & 4) == 0) {
-						mc6821_write(PIA0, A & 3, D);
+						mc6821_write(mp->public.pia0, A & 3, D);
 					}
 				}
 				break;
 			case 5:
-				mc6821_write(PIA1, A & 3, D);
+				mc6821_write(mp->public.pia1, A & 3, D);
 				break;
 			case 6:
-				if (machine_cart)
-					machine_cart->write(machine_cart, A, 1, D);
+				if (mp->public.cart)
+					mp->public.cart->write(mp->public.cart, A, 1, D);
 				break;
 			default:
 				break;
 		}
+		if (S >= 3)
+			mp->irq_lines_dirty = 1;
 	}
 	if (is_ram_access) {
-		machine_ram[Z] = D;
+		mp->public.ram[Z] = D;
+		mp->public.ram_dirty[Z >> 8] = 1;
 	}
 }
 
 /* simulate an RTS without otherwise affecting machine state */
-void machine_op_rts(struct MC6809 *cpu) {
-	unsigned int new_pc = machine_read_byte(cpu->reg_s) << 8;
-	new_pc |= machine_read_byte(cpu->reg_s + 1);
+void machine_op_rts(struct machine *m) {
+	struct MC6809 *cpu = m->cpu;
+	unsigned int new_pc = machine_read_byte(m, cpu->reg_s) << 8;
+	new_pc |= machine_read_byte(m, cpu->reg_s + 1);
 	cpu->reg_s += 2;
 	cpu->reg_pc = new_pc;
 }
@@ -1235,40 +1568,42 @@ void machine_select_fast_sound(_Bool fast) {
 }
 #endif
 
-void machine_set_inverted_text(_Bool invert) {
-	inverted_text = invert;
-	mc6847_set_inverted_text(VDG0, invert);
+void machine_set_inverted_text(struct machine *m, _Bool invert) {
+	struct machine_private *mp = (struct machine_private *)m;
+	mp->inverted_text = invert;
+	mc6847_set_inverted_text(m->vdg, invert);
 }
 
-void machine_insert_cart(struct cart *c) {
-	machine_remove_cart();
+void machine_insert_cart(struct machine *m, struct cart *c) {
+	machine_remove_cart(m);
 	if (c) {
 		assert(c->read != NULL);
 		assert(c->write != NULL);
-		machine_cart = c;
-		c->signal_firq = DELEGATE_AS1(void, bool, cart_firq, NULL);
-		c->signal_nmi = DELEGATE_AS1(void, bool, cart_nmi, NULL);
-		c->signal_halt = DELEGATE_AS1(void, bool, cart_halt, NULL);
+		m->cart = c;
+		c->signal_firq = DELEGATE_AS1(void, bool, cart_firq, m);
+		c->signal_nmi = DELEGATE_AS1(void, bool, cart_nmi, m);
+		c->signal_halt = DELEGATE_AS1(void, bool, cart_halt, m);
 	}
 }
 
-void machine_remove_cart(void) {
-	cart_free(machine_cart);
-	machine_cart = NULL;
+void machine_remove_cart(struct machine *m) {
+	cart_free(m->cart);
+	m->cart = NULL;
 }
 
 /* Intialise RAM contents */
-static void initialise_ram(void) {
+static void initialise_ram(struct machine_private *mp) {
 	int loc = 0, val = 0xff;
 	/* Don't know why, but RAM seems to start in this state: */
 	while (loc < 0x10000) {
-		machine_ram[loc++] = val;
-		machine_ram[loc++] = val;
-		machine_ram[loc++] = val;
-		machine_ram[loc++] = val;
+		mp->public.ram[loc++] = val;
+		mp->public.ram[loc++] = val;
+		mp->public.ram[loc++] = val;
+		mp->public.ram[loc++] = val;
 		if ((loc & 0xff) != 0)
 			val ^= 0xff;
 	}
+	memset(mp->public.ram_dirty, 1, sizeof(mp->public.ram_dirty));
 }
 
 /**************************************************************************/
@@ -9,9 +9,13 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "events.h"
+
 struct cart;
 struct MC6809;
 struct MC6821;
+struct MC6847;
+struct MC6883;
 
 /* Dragon 64s and later Dragon 32s used a 14.218MHz crystal
  * (ref: "Dragon 64 differences", Graham E. Kinns and then a motherboard) */
@@ -87,9 +91,36 @@ struct machine_config {
 	_Bool cart_enabled;
 };
 
-extern unsigned int machine_ram_size;  /* RAM in bytes, up to 64K */
-extern uint8_t machine_ram[0x10000];
-extern struct cart *machine_cart;
+/* One emulated machine, with its own RAM, devices and time base.  The
+ * peripherals outside the machine proper (sound, tape, disk drives, printer,
+ * keyboard & joystick) are still process-wide: they schedule their events on
+ * whichever machine is selected and connect to whichever was configured last.
+ * Running more than one machine, and especially running machines on separate
+ * threads, is therefore not supported yet. */
+
+struct machine {
+	struct machine_config *config;
+	struct MC6809 *cpu;
+	struct MC6821 *pia0, *pia1;
+	struct MC6847 *vdg;
+	struct MC6883 *sam;
+	struct cart *cart;
+
+	unsigned int ram_size;  /* RAM in bytes, up to 64K */
+	uint8_t ram[0x10000];
+	/* Set for each 256-byte page of ram as it is written to.  Anything
+	 * else modifying RAM directly should set these too.  Cleared by the
+	 * rewind module whenever it captures state. */
+	uint8_t ram_dirty[0x100];
+
+	/* Events queued against this machine's time.  While the machine is
+	 * selected, MACHINE_EVENT_LIST refers to event_list and
+	 * event_current_tick is its time; event_tick holds the time
+	 * otherwise. */
+	struct event *event_list;
+	event_ticks event_tick;
+};
+
 extern _Bool has_bas, has_extbas, has_altbas, has_combined;
 extern uint32_t crc_bas, crc_extbas, crc_altbas, crc_combined;
 
@@ -106,38 +137,53 @@ struct machine_config *machine_config_first_working(void);
 void machine_config_complete(struct machine_config *mc);
 void machine_config_print_all(void);
 
+/* Set up & tear down the process-wide peripherals: */
 void machine_init(void);
 void machine_shutdown(void);
-void machine_configure(struct machine_config *mc);  /* apply config */
-void machine_reset(_Bool hard);
-int machine_run(int ncycles);
-void machine_single_step(void);
-void machine_toggle_pause(void);
 
-void machine_signal(int sig);
+struct machine *machine_new(void);
+void machine_free(struct machine *m);
+
+/* Select the machine whose time base this thread uses (NULL for none).  A
+ * machine must only be selected on one thread at a time.  Configuring,
+ * resetting and running a machine select it. */
+void machine_select(struct machine *m);
+
+void machine_configure(struct machine *m, struct machine_config *mc);  /* apply config */
+void machine_reset(struct machine *m, _Bool hard);
+int machine_run(struct machine *m, int ncycles);
+void machine_single_step(struct machine *m);
+void machine_toggle_pause(struct machine *m);
+
+void machine_signal(struct machine *m, int sig);
 void machine_trap(void *data);
 
-void machine_set_trace(_Bool trace_on);
+void machine_set_trace(struct machine *m, _Bool trace_on);
 
-int machine_num_cpus(void);
-int machine_num_pias(void);
-struct MC6809 *machine_get_cpu(int n);
-struct MC6821 *machine_get_pia(int n);
+int machine_num_cpus(struct machine *m);
+int machine_num_pias(struct machine *m);
+struct MC6809 *machine_get_cpu(struct machine *m, int n);
+struct MC6821 *machine_get_pia(struct machine *m, int n);
+struct MC6883 *machine_get_sam(struct machine *m, int n);
 
 /* simplified read & write byte for convenience functions */
-uint8_t machine_read_byte(uint16_t A);
-void machine_write_byte(uint16_t A, uint8_t D);
+uint8_t machine_read_byte(struct machine *m, uint16_t A);
+void machine_write_byte(struct machine *m, uint16_t A, uint8_t D);
 /* simulate an RTS without otherwise affecting machine state */
-void machine_op_rts(struct MC6809 *cpu);
+void machine_op_rts(struct machine *m);
 
 void machine_set_fast_sound(_Bool fast);
 void machine_select_fast_sound(_Bool fast);
 void machine_update_sound(void);
 
-void machine_set_inverted_text(_Bool);
+void machine_set_inverted_text(struct machine *m, _Bool);
+
+/* Copy the 512 bytes of VRAM displayed by an alphanumeric mode to 'dest'.
+ * Returns false if the VDG or SAM is not in such a mode. */
+_Bool machine_text_vram(struct machine *m, uint8_t *dest);
 
-void machine_insert_cart(struct cart *c);
-void machine_remove_cart(void);
+void machine_insert_cart(struct machine *m, struct cart *c);
+void machine_remove_cart(struct machine *m);
 
 int machine_load_rom(const char *path, uint8_t *dest, size_t max_size);
 
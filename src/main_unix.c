@@ -20,16 +20,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef HAVE_SDL
 # include <SDL.h>
 #endif
 
+#include "batch.h"
 #include "module.h"
 #include "xroar.h"
 #include "logging.h"
 
 int main(int argc, char **argv) {
+	// If the very first argument is -batch, run jobs from a manifest.
+	if (argc > 1 && 0 == strcmp(argv[1], "-batch"))
+		return batch_main(argc, argv);
 	atexit(xroar_shutdown);
 	if (!xroar_init(argc, argv))
 		exit(EXIT_FAILURE);
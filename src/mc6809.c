@@ -154,8 +154,8 @@ static uint8_t op_discard(struct MC6809 *cpu, uint8_t a, uint8_t b);
  */
 
 /* Dummy handlers */
-static uint8_t dummy_read_cycle(uint16_t a) { (void)a; return 0; }
-static void dummy_write_cycle(uint16_t a, uint8_t v) { (void)a; (void)v; }
+static uint8_t dummy_read_cycle(void *sptr, uint16_t a) { (void)sptr; (void)a; return 0; }
+static void dummy_write_cycle(void *sptr, uint16_t a, uint8_t v) { (void)sptr; (void)a; (void)v; }
 
 struct MC6809 *mc6809_new(void) {
 	struct MC6809 *cpu = xzalloc(sizeof(*cpu));
@@ -164,8 +164,8 @@ struct MC6809 *mc6809_new(void) {
 	cpu->run = mc6809_run;
 	cpu->jump = mc6809_jump;
 	// External handlers
-	cpu->read_cycle = dummy_read_cycle;
-	cpu->write_cycle = dummy_write_cycle;
+	cpu->read_cycle = DELEGATE_AS1(uint8, uint16, dummy_read_cycle, NULL);
+	cpu->write_cycle = DELEGATE_AS2(void, uint16, uint8, dummy_write_cycle, NULL);
 	mc6809_reset(cpu);
 	return cpu;
 }
@@ -279,6 +279,10 @@ static void mc6809_run(struct MC6809 *cpu) {
 			continue;
 
 		case mc6809_state_cwai_check_halt:
+			if (!cpu->halt && !(cpu->nmi_armed && cpu->nmi)
+			    && (!cpu->firq || (REG_CC & CC_F))
+			    && (!cpu->irq || (REG_CC & CC_I)))
+				idle_cycles(cpu);
 			NVMA_CYCLE;
 			if (cpu->halt) {
 				continue;
@@ -294,6 +298,8 @@ static void mc6809_run(struct MC6809 *cpu) {
 				cpu->state = mc6809_state_label_b;
 				continue;
 			}
+			if (!cpu->halt && !cpu->nmi && !cpu->firq && !cpu->irq)
+				idle_cycles(cpu);
 			NVMA_CYCLE;
 			if (cpu->halt)
 				cpu->state = mc6809_state_sync_check_halt;
@@ -61,15 +61,20 @@ struct MC6809 {
 	/* External handlers */
 
 	/* Return result of a byte read cycle */
-	uint8_t (*read_cycle)(uint16_t addr);
+	DELEGATE_T1(uint8, uint16) read_cycle;
 	/* Perform a byte write cycle */
-	void (*write_cycle)(uint16_t addr, uint8_t value);
+	DELEGATE_T2(void, uint16, uint8) write_cycle;
 	/* Called just before instruction fetch if non-NULL */
 	DELEGATE_T0(void) instruction_hook;
 	/* Called after instruction is executed */
 	DELEGATE_T0(void) instruction_posthook;
 	/* Called just before an interrupt vector is read */
 	DELEGATE_T1(void, int) interrupt_hook;
+	/* Optional.  Called while waiting in SYNC or CWAI with no interrupt
+	 * pending, when all the CPU would do is dummy cycles.  Performs as
+	 * many as it can without anything else changing and returns how many
+	 * (may be 0). */
+	DELEGATE_T0(unsigned) idle_cycles;
 
 	/* Internal state */
 
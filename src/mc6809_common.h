@@ -4,6 +4,7 @@ static uint8_t fetch_byte(struct MC6809 *cpu, uint16_t a);
 static void store_byte(struct MC6809 *cpu, uint16_t a, uint8_t d);
 #define peek_byte(c,a) ((void)fetch_byte(c,a))
 #define NVMA_CYCLE (peek_byte(cpu, 0xffff))
+static void idle_cycles(struct MC6809 *cpu);
 
 /* Read & write various addressing modes */
 
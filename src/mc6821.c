@@ -91,30 +91,30 @@ void mc6821_reset_cx1(struct MC6821_side *side) {
 
 #define UPDATE_OUTPUT_A(p) do { \
 		p.out_sink = ~(~p.output_register & p.direction_register); \
-		if (p.data_postwrite) p.data_postwrite(); \
+		DELEGATE_SAFE_CALL0(p.data_postwrite); \
 	} while (0)
 
 #define UPDATE_OUTPUT_B(p) do { \
 		p.out_source = p.output_register & p.direction_register; \
 		p.out_sink = p.output_register | ~p.direction_register; \
-		if (p.data_postwrite) p.data_postwrite(); \
+		DELEGATE_SAFE_CALL0(p.data_postwrite); \
 	} while (0)
 
 void mc6821_update_state(struct MC6821 *pia) {
 	UPDATE_OUTPUT_A(pia->a);
 	UPDATE_OUTPUT_B(pia->b);
-	if (pia->a.control_postwrite) pia->a.control_postwrite();
-	if (pia->b.control_postwrite) pia->b.control_postwrite();
+	DELEGATE_SAFE_CALL0(pia->a.control_postwrite);
+	DELEGATE_SAFE_CALL0(pia->b.control_postwrite);
 }
 
 #define READ_DR(p) do { \
-		if (p.data_preread) p.data_preread(); \
+		DELEGATE_SAFE_CALL0(p.data_preread); \
 		p.interrupt_received = 0; \
 		p.irq = 0; \
 	} while (0)
 
 #define READ_CR(p) do { \
-		if (p.control_preread) p.control_preread(); \
+		DELEGATE_SAFE_CALL0(p.control_preread); \
 	} while (0)
 
 uint8_t mc6821_read(struct MC6821 *pia, uint16_t A) {
@@ -157,7 +157,7 @@ uint8_t mc6821_read(struct MC6821 *pia, uint16_t A) {
 		} else { \
 			p.irq = 0; \
 		} \
-		if (p.control_postwrite) p.control_postwrite(); \
+		DELEGATE_SAFE_CALL0(p.control_postwrite); \
 	} while (0)
 
 void mc6821_write(struct MC6821 *pia, uint16_t A, uint8_t D) {
@@ -33,6 +33,7 @@
 #include "mc6847.h"
 #include "module.h"
 #include "vdg_bitmaps.h"
+#include "vo_thread.h"
 #include "xroar.h"
 
 // Convert VDG timing to SAM cycles:
@@ -44,6 +45,39 @@ enum vdg_render_mode {
 	VDG_RENDER_RG,
 };
 
+/* Rendering is decoupled from emulation through a log.  As the beam passes,
+ * VRAM is fetched and everything else that affects the picture is recorded:
+ * each point the line so far is to be rendered, mode changes, the end of each
+ * line and vsync.  Replaying the log performs exactly the rendering that
+ * would have been done at the time, so the output is identical.
+ *
+ * Normally the log is replayed at every HS fall.  With -vdg-deferred, it is
+ * replayed once per frame (at FS), or whenever it fills. */
+
+enum vdg_log_type {
+	VDG_LOG_RENDER,  // render line up to beam position 'value'
+	VDG_LOG_MODE,    // apply mode 'value'
+	VDG_LOG_LINE,    // end of scanline 'value'
+	VDG_LOG_VSYNC,
+};
+
+struct vdg_log_entry {
+	uint8_t type;
+	_Bool output;  // LINE: pass line to video module
+	uint8_t nbytes;  // LINE: number of bytes of VRAM fetched
+	unsigned value;
+};
+
+#define VDG_LOG_SIZE (2048)
+
+/* Fetched VRAM is kept per line, enough for a frame of active lines.  The VDG
+ * can run off the end of what it has fetched (e.g., if a line switches to
+ * fewer bytes per line part way through), and then sees whatever was left in
+ * the buffer from earlier lines, so each new line starts as a copy of the
+ * last. */
+#define VDG_VRAM_LINE (42)
+#define VDG_VRAM_LINES (256)
+
 struct MC6847_private {
 	struct MC6847 public;
 
@@ -85,9 +119,25 @@ struct MC6847_private {
 	uint8_t pixel_data[VDG_LINE_DURATION];
 	unsigned row;
 
-	uint8_t vram[84];
-	uint8_t *vram_ptr;
-	unsigned vram_nbytes;
+	/* Each line as last passed to the video module, used to skip lines
+	 * that are unchanged from the previous frame */
+	_Bool line_valid[VDG_FRAME_DURATION];
+	uint8_t line_data[VDG_FRAME_DURATION][VDG_LINE_DURATION];
+
+	/* Fetched VRAM data.  Attributes are derived from each byte as it is
+	 * rendered: with an external charset, INV is not connected. */
+	uint8_t vram[VDG_VRAM_LINES][VDG_VRAM_LINE];
+	uint8_t *vram_ptr;  // next byte to render
+	unsigned vram_render;  // line being rendered
+	unsigned vram_fetch;  // line being fetched
+	unsigned vram_pending;  // lines fetched but not yet rendered
+	unsigned vram_nbytes;  // bytes fetched this scanline
+	_Bool vram_overrun;  // logged rendering may read beyond vram_nbytes
+	_Bool fetch_32byte;  // is_32byte, as of the latest mode change
+
+	/* Pending rendering */
+	struct vdg_log_entry log[VDG_LOG_SIZE];
+	unsigned log_length;
 
 	uint8_t *ext_charset;
 
@@ -107,34 +157,73 @@ static void do_hs_fall(void *);
 static void do_hs_rise(void *);
 static void do_hs_fall_pal_coco(void *);
 
-static void render_scanline(struct MC6847_private *vdg);
+static void fetch_scanline(struct MC6847_private *vdg);
+static struct vdg_log_entry *log_append(struct MC6847_private *vdg, int type);
+static void replay_log(struct MC6847_private *vdg);
+static void render_scanline(struct MC6847_private *vdg, unsigned beam_to);
+static void end_scanline(struct MC6847_private *vdg, struct vdg_log_entry const *e);
+static void output_scanline(struct MC6847_private *vdg, unsigned scanline);
+static void apply_mode(struct MC6847_private *vdg, unsigned mode);
 
 #define SCANLINE(s) ((s) % VDG_FRAME_DURATION)
 
+/* Lookup tables used to render a whole VRAM byte at once, as 8 pixels (32
+ * bytes per line) or 16 pixels (16 bytes per line).  Two-colour modes use a
+ * mask selecting foreground over background, CG modes an offset from the
+ * first colour of the set.  Entries are in pixel order, and are read as
+ * 64-bit words so that byte order matches on any host. */
+
+#define LUT_M(v,b) (((v) & (b)) ? 0xff : 0)
+#define LUT_C(v,s) (((v) >> (s)) & 3)
+
+#define LUT_MASK_8(v) { \
+	LUT_M(v,0x80), LUT_M(v,0x40), LUT_M(v,0x20), LUT_M(v,0x10), \
+	LUT_M(v,0x08), LUT_M(v,0x04), LUT_M(v,0x02), LUT_M(v,0x01) }
+#define LUT_MASK_16(v) { \
+	LUT_M(v,0x80), LUT_M(v,0x80), LUT_M(v,0x40), LUT_M(v,0x40), \
+	LUT_M(v,0x20), LUT_M(v,0x20), LUT_M(v,0x10), LUT_M(v,0x10), \
+	LUT_M(v,0x08), LUT_M(v,0x08), LUT_M(v,0x04), LUT_M(v,0x04), \
+	LUT_M(v,0x02), LUT_M(v,0x02), LUT_M(v,0x01), LUT_M(v,0x01) }
+#define LUT_CG_8(v) { \
+	LUT_C(v,6), LUT_C(v,6), LUT_C(v,4), LUT_C(v,4), \
+	LUT_C(v,2), LUT_C(v,2), LUT_C(v,0), LUT_C(v,0) }
+#define LUT_CG_16(v) { \
+	LUT_C(v,6), LUT_C(v,6), LUT_C(v,6), LUT_C(v,6), \
+	LUT_C(v,4), LUT_C(v,4), LUT_C(v,4), LUT_C(v,4), \
+	LUT_C(v,2), LUT_C(v,2), LUT_C(v,2), LUT_C(v,2), \
+	LUT_C(v,0), LUT_C(v,0), LUT_C(v,0), LUT_C(v,0) }
+
+#define LUT_4(f,v) f(v), f((v)+1), f((v)+2), f((v)+3)
+#define LUT_16(f,v) LUT_4(f,v), LUT_4(f,(v)+4), LUT_4(f,(v)+8), LUT_4(f,(v)+12)
+#define LUT_64(f,v) LUT_16(f,v), LUT_16(f,(v)+16), LUT_16(f,(v)+32), LUT_16(f,(v)+48)
+#define LUT_256(f) LUT_64(f,0), LUT_64(f,64), LUT_64(f,128), LUT_64(f,192)
+
+static uint8_t const lut_mask_8[256][8] = { LUT_256(LUT_MASK_8) };
+static uint8_t const lut_mask_16[256][16] = { LUT_256(LUT_MASK_16) };
+static uint8_t const lut_cg_8[256][8] = { LUT_256(LUT_CG_8) };
+static uint8_t const lut_cg_16[256][16] = { LUT_256(LUT_CG_16) };
+
+#define BROADCAST(c) ((uint64_t)(c) * UINT64_C(0x0101010101010101))
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 static void do_hs_fall(void *data) {
 	struct MC6847_private *vdg = data;
 	// Finish rendering previous scanline
-	if (vdg->frame == 0) {
-		if (vdg->scanline < VDG_ACTIVE_AREA_START) {
-			if (vdg->scanline == 0) {
-				memset(vdg->pixel_data + VDG_LEFT_BORDER_START, vdg->border_colour, VDG_tAVB);
-			}
-			video_module->render_scanline(vdg->pixel_data);
-		} else if (vdg->scanline >= VDG_ACTIVE_AREA_START && vdg->scanline < VDG_ACTIVE_AREA_END) {
-			render_scanline(vdg);
-			vdg->row++;
-			if (vdg->row > 11)
-				vdg->row = 0;
-			video_module->render_scanline(vdg->pixel_data);
-			vdg->pixel = vdg->pixel_data + VDG_LEFT_BORDER_START;
-		} else if (vdg->scanline >= VDG_ACTIVE_AREA_END) {
-			if (vdg->scanline == VDG_ACTIVE_AREA_END) {
-				memset(vdg->pixel_data + VDG_LEFT_BORDER_START, vdg->border_colour, VDG_tAVB);
-			}
-			video_module->render_scanline(vdg->pixel_data);
-		}
+	if (vdg->frame == 0 && vdg->scanline >= VDG_ACTIVE_AREA_START && vdg->scanline < VDG_ACTIVE_AREA_END) {
+		fetch_scanline(vdg);
+	}
+	struct vdg_log_entry *e = log_append(vdg, VDG_LOG_LINE);
+	e->value = vdg->scanline;
+	e->output = (vdg->frame == 0);
+	e->nbytes = vdg->vram_nbytes;
+	if (vdg->vram_nbytes > 0) {
+		if (vdg->vram_pending >= VDG_VRAM_LINES - 2)
+			replay_log(vdg);
+		unsigned next = (vdg->vram_fetch + 1) % VDG_VRAM_LINES;
+		memcpy(vdg->vram[next], vdg->vram[vdg->vram_fetch], VDG_VRAM_LINE);
+		vdg->vram_fetch = next;
+		vdg->vram_pending++;
 	}
 
 	// HS falling edge.
@@ -172,17 +261,8 @@ static void do_hs_fall(void *data) {
 
 	// Next scanline
 	vdg->scanline = SCANLINE(vdg->scanline + 1);
-	vdg->beam_pos = 0;
 	vdg->vram_nbytes = 0;
-	vdg->vram_ptr = vdg->vram;
-	vdg->vram_bit = 0;
-	vdg->lborder_remaining = VDG_tLB;
-	vdg->vram_remaining = vdg->is_32byte ? 32 : 16;
-	vdg->rborder_remaining = VDG_tRB;
-
-	if (vdg->scanline == VDG_ACTIVE_AREA_START) {
-		vdg->row = 0;
-	}
+	vdg->vram_overrun = 0;
 
 	if (vdg->scanline == VDG_ACTIVE_AREA_END) {
 		// FS falling edge
@@ -195,10 +275,136 @@ static void do_hs_fall(void *data) {
 		vdg->frame--;
 		if (vdg->frame < 0)
 			vdg->frame = xroar_frameskip;
-		if (vdg->frame == 0)
+		if (vdg->frame == 0) {
+			log_append(vdg, VDG_LOG_VSYNC);
+			replay_log(vdg);
+		}
+	}
+
+	if (!xroar_cfg.vdg_deferred)
+		replay_log(vdg);
+}
+
+/* Fetch VRAM up to the current beam position, and log that the line is to be
+ * rendered that far. */
+
+static void fetch_scanline(struct MC6847_private *vdg) {
+	unsigned beam_to = (event_current_tick - vdg->scanline_start) >> 1;
+	if (beam_to >= 102) {
+		unsigned nbytes, max;
+		if (vdg->fetch_32byte) {
+			nbytes = (beam_to - 102) >> 3;
+			max = 42;
+		} else {
+			nbytes = (beam_to - 102) >> 4;
+			max = 22;
+		}
+		if (nbytes > max)
+			nbytes = max;
+		if (nbytes > vdg->vram_nbytes) {
+			// Rendering logged so far might have run past the data
+			// fetched, and must see the buffer as it was.
+			if (vdg->vram_overrun)
+				replay_log(vdg);
+			DELEGATE_CALL2(vdg->public.fetch_bytes, nbytes - vdg->vram_nbytes, vdg->vram[vdg->vram_fetch] + vdg->vram_nbytes);
+			vdg->vram_nbytes = nbytes;
+		}
+	}
+	// At most one byte is rendered per 8 pixels
+	if (beam_to > VDG_ACTIVE_LINE_START && ((beam_to - VDG_ACTIVE_LINE_START + 7) >> 3) > vdg->vram_nbytes)
+		vdg->vram_overrun = 1;
+	struct vdg_log_entry *e = log_append(vdg, VDG_LOG_RENDER);
+	e->value = beam_to;
+}
+
+static struct vdg_log_entry *log_append(struct MC6847_private *vdg, int type) {
+	if (vdg->log_length == VDG_LOG_SIZE)
+		replay_log(vdg);
+	struct vdg_log_entry *e = &vdg->log[vdg->log_length++];
+	e->type = type;
+	return e;
+}
+
+static void replay_log(struct MC6847_private *vdg) {
+	for (unsigned i = 0; i < vdg->log_length; i++) {
+		struct vdg_log_entry const *e = &vdg->log[i];
+		switch (e->type) {
+		case VDG_LOG_RENDER:
+			render_scanline(vdg, e->value);
+			break;
+		case VDG_LOG_MODE:
+			apply_mode(vdg, e->value);
+			break;
+		case VDG_LOG_LINE:
+			end_scanline(vdg, e);
+			break;
+		case VDG_LOG_VSYNC:
+			vo_thread_sync();
 			video_module->vsync();
+			break;
+		}
+	}
+	vdg->log_length = 0;
+	vdg->vram_pending = 0;
+	vdg->vram_overrun = 0;
+}
+
+static void end_scanline(struct MC6847_private *vdg, struct vdg_log_entry const *e) {
+	unsigned scanline = e->value;
+	if (e->output) {
+		if (scanline < VDG_ACTIVE_AREA_START) {
+			if (scanline == 0) {
+				memset(vdg->pixel_data + VDG_LEFT_BORDER_START, vdg->border_colour, VDG_tAVB);
+			}
+			output_scanline(vdg, scanline);
+		} else if (scanline < VDG_ACTIVE_AREA_END) {
+			vdg->row++;
+			if (vdg->row > 11)
+				vdg->row = 0;
+			output_scanline(vdg, scanline);
+			vdg->pixel = vdg->pixel_data + VDG_LEFT_BORDER_START;
+		} else {
+			if (scanline == VDG_ACTIVE_AREA_END) {
+				memset(vdg->pixel_data + VDG_LEFT_BORDER_START, vdg->border_colour, VDG_tAVB);
+			}
+			output_scanline(vdg, scanline);
+		}
+	}
+
+	// Next scanline
+	vdg->beam_pos = 0;
+	if (e->nbytes > 0)
+		vdg->vram_render = (vdg->vram_render + 1) % VDG_VRAM_LINES;
+	vdg->vram_ptr = vdg->vram[vdg->vram_render];
+	vdg->vram_bit = 0;
+	vdg->lborder_remaining = VDG_tLB;
+	vdg->vram_remaining = vdg->is_32byte ? 32 : 16;
+	vdg->rborder_remaining = VDG_tRB;
+
+	if (SCANLINE(scanline + 1) == VDG_ACTIVE_AREA_START) {
+		vdg->row = 0;
 	}
+}
 
+/* Pass the current line to the video module.  If the module can retain lines
+ * between frames, and the line is the same as the last one passed for this
+ * scanline, it is told so instead of having to convert it again. */
+
+static void output_scanline(struct MC6847_private *vdg, unsigned scanline) {
+	if (video_module->render_unchanged) {
+		if (video_module->redraw) {
+			memset(vdg->line_valid, 0, sizeof(vdg->line_valid));
+			video_module->redraw = 0;
+		}
+		uint8_t *line = vdg->line_data[scanline];
+		if (vdg->line_valid[scanline] && memcmp(line, vdg->pixel_data, VDG_LINE_DURATION) == 0) {
+			vo_thread_render_unchanged();
+			return;
+		}
+		memcpy(line, vdg->pixel_data, VDG_LINE_DURATION);
+		vdg->line_valid[scanline] = 1;
+	}
+	vo_thread_render_scanline(vdg->pixel_data);
 }
 
 static void do_hs_rise(void *data) {
@@ -225,25 +431,7 @@ static void do_hs_fall_pal_coco(void *data) {
 	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_fall_event);
 }
 
-static void render_scanline(struct MC6847_private *vdg) {
-	unsigned beam_to = (event_current_tick - vdg->scanline_start) >> 1;
-	if (vdg->is_32byte && beam_to >= 102) {
-		unsigned nbytes = (beam_to - 102) >> 3;
-		if (nbytes > 42)
-			nbytes = 42;
-		if (nbytes > vdg->vram_nbytes) {
-			DELEGATE_CALL2(vdg->public.fetch_bytes, nbytes - vdg->vram_nbytes, vdg->vram + vdg->vram_nbytes*2);
-			vdg->vram_nbytes = nbytes;
-		}
-	} else if (!vdg->is_32byte && beam_to >= 102) {
-		unsigned nbytes = (beam_to - 102) >> 4;
-		if (nbytes > 22)
-			nbytes = 22;
-		if (nbytes > vdg->vram_nbytes) {
-			DELEGATE_CALL2(vdg->public.fetch_bytes, nbytes - vdg->vram_nbytes, vdg->vram + vdg->vram_nbytes*2);
-			vdg->vram_nbytes = nbytes;
-		}
-	}
+static void render_scanline(struct MC6847_private *vdg, unsigned beam_to) {
 	beam_to -= VDG_LEFT_BORDER_START;
 	if (beam_to > (UINT_MAX/2))
 		return;
@@ -265,7 +453,7 @@ static void render_scanline(struct MC6847_private *vdg) {
 	while (vdg->vram_remaining > 0) {
 		if (vdg->vram_bit == 0) {
 			vdg->vram_g_data = *(vdg->vram_ptr++);
-			uint8_t attr = *(vdg->vram_ptr++);
+			uint8_t attr = vdg->ext_charset ? (vdg->vram_g_data & 0x80) : vdg->vram_g_data;
 			vdg->vram_bit = 8;
 			vdg->nA_S = attr & 0x80;
 
@@ -323,6 +511,48 @@ static void render_scanline(struct MC6847_private *vdg) {
 			}
 		}
 
+		// Fast path: if the whole byte is to be rendered, nothing can
+		// change part way through it.
+		unsigned nbyte_pixels = vdg->is_32byte ? 8 : 16;
+		if (vdg->vram_bit == 8 && (vdg->beam_pos + nbyte_pixels) <= beam_to) {
+			uint8_t const *lut;
+			uint64_t fg, bg;
+			switch (vdg->render_mode) {
+			case VDG_RENDER_SG:
+				lut = vdg->is_32byte ? lut_mask_8[vdg->vram_sg_data] : lut_mask_16[vdg->vram_sg_data];
+				fg = BROADCAST(vdg->s_fg_colour);
+				bg = BROADCAST(vdg->s_bg_colour);
+				break;
+			case VDG_RENDER_CG: default:
+				lut = vdg->is_32byte ? lut_cg_8[vdg->vram_g_data] : lut_cg_16[vdg->vram_g_data];
+				fg = bg = BROADCAST(vdg->cg_colours);
+				break;
+			case VDG_RENDER_RG:
+				lut = vdg->is_32byte ? lut_mask_8[vdg->vram_g_data] : lut_mask_16[vdg->vram_g_data];
+				fg = BROADCAST(vdg->fg_colour);
+				bg = BROADCAST(vdg->bg_colour);
+				break;
+			}
+			for (unsigned i = 0; i < nbyte_pixels / 8; i++) {
+				uint64_t l, p;
+				memcpy(&l, lut + i * 8, 8);
+				if (vdg->render_mode == VDG_RENDER_CG)
+					p = l + fg;
+				else
+					p = (l & fg) | (~l & bg);
+				memcpy(vdg->pixel, &p, 8);
+				vdg->pixel += 8;
+			}
+			vdg->beam_pos += nbyte_pixels;
+			vdg->vram_bit = 0;
+			vdg->vram_remaining--;
+			vdg->vram_g_data = 0;
+			vdg->vram_sg_data = 0;
+			if (vdg->beam_pos >= beam_to)
+				return;
+			continue;
+		}
+
 		if (vdg->is_32byte) {
 			switch (vdg->render_mode) {
 			case VDG_RENDER_SG:
@@ -398,7 +628,7 @@ static void render_scanline(struct MC6847_private *vdg) {
 struct MC6847 *mc6847_new(_Bool t1) {
 	struct MC6847_private *vdg = xzalloc(sizeof(*vdg));
 	vdg->is_t1 = t1;
-	vdg->vram_ptr = vdg->vram;
+	vdg->vram_ptr = vdg->vram[0];
 	vdg->pixel = vdg->pixel_data + VDG_LEFT_BORDER_START;
 	vdg->public.signal_hs = DELEGATE_DEFAULT1(void, bool);
 	vdg->public.signal_fs = DELEGATE_DEFAULT1(void, bool);
@@ -417,6 +647,8 @@ void mc6847_free(struct MC6847 *vdgp) {
 
 void mc6847_reset(struct MC6847 *vdgp) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	replay_log(vdg);
+	vo_thread_sync();
 	video_module->vsync();
 	memset(vdg->pixel_data, VDG_BLACK, sizeof(vdg->pixel_data));
 	vdg->pixel = vdg->pixel_data + VDG_LEFT_BORDER_START;
@@ -429,8 +661,13 @@ void mc6847_reset(struct MC6847 *vdgp) {
 	// 6847T1 doesn't appear to do bright orange:
 	vdg->bright_orange = vdg->is_t1 ? VDG_ORANGE : VDG_BRIGHT_ORANGE;
 	mc6847_set_mode(vdgp, 0);
+	replay_log(vdg);
 	vdg->beam_pos = 0;
-	vdg->vram_ptr = vdg->vram;
+	if (vdg->vram_fetch != 0)
+		memcpy(vdg->vram[0], vdg->vram[vdg->vram_fetch], VDG_VRAM_LINE);
+	vdg->vram_render = vdg->vram_fetch = 0;
+	vdg->vram_nbytes = 0;
+	vdg->vram_ptr = vdg->vram[0];
 	vdg->vram_bit = 0;
 	vdg->lborder_remaining = VDG_tLB;
 	vdg->vram_remaining = vdg->is_32byte ? 32 : 16;
@@ -439,6 +676,7 @@ void mc6847_reset(struct MC6847 *vdgp) {
 
 void mc6847_set_inverted_text(struct MC6847 *vdgp, _Bool invert) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	replay_log(vdg);
 	vdg->inverted_text = invert;
 }
 
@@ -446,9 +684,17 @@ void mc6847_set_mode(struct MC6847 *vdgp, unsigned mode) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
 	/* Render scanline so far before changing modes */
 	if (vdg->frame == 0 && vdg->scanline >= VDG_ACTIVE_AREA_START && vdg->scanline < VDG_ACTIVE_AREA_END) {
-		render_scanline(vdg);
+		fetch_scanline(vdg);
 	}
+	// Bytes per line affects fetching, so is needed immediately
+	unsigned GM = (mode >> 4) & 7;
+	_Bool GM0 = mode & 0x10;
+	vdg->fetch_32byte = !(mode & 0x80) || !(GM == 0 || (GM0 && GM != 7));
+	struct vdg_log_entry *e = log_append(vdg, VDG_LOG_MODE);
+	e->value = mode;
+}
 
+static void apply_mode(struct MC6847_private *vdg, unsigned mode) {
 	unsigned GM = (mode >> 4) & 7;
 	vdg->GM0 = mode & 0x10;
 	vdg->CSS = mode & 0x08;
@@ -490,5 +736,6 @@ void mc6847_set_mode(struct MC6847 *vdgp, unsigned mode) {
 
 void mc6847_set_ext_charset(struct MC6847 *vdgp, uint8_t *rom) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	replay_log(vdg);
 	vdg->ext_charset = rom;
 }
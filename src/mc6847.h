@@ -58,7 +58,7 @@ struct MC6847 {
 	DELEGATE_T1(void, bool) signal_hs;
 	DELEGATE_T1(void, bool) signal_fs;
 	/* External handler to fetch data for display.  First arg is number of bytes,
-	 * second a pointer to a buffer to receive them. */
+	 * second a pointer to a buffer to receive them, one byte each. */
 	DELEGATE_T2(void, int, uint8p) fetch_bytes;
 };
 
@@ -87,6 +87,7 @@ extern SoundModule sound_sdl_module;
 extern SoundModule sound_alsa_module;
 extern SoundModule sound_jack_module;
 extern SoundModule sound_null_module;
+extern SoundModule sound_wav_module;
 static SoundModule * const default_sound_module_list[] = {
 #ifdef HAVE_MACOSX_AUDIO
 	&sound_macosx_module,
@@ -117,12 +118,17 @@ static SoundModule * const default_sound_module_list[] = {
 #ifdef HAVE_NULL_AUDIO
 	&sound_null_module,
 #endif
+	&sound_wav_module,
 	NULL
 };
 
 extern VideoModule video_null_module;
+extern VideoModule video_capture_module;
+extern VideoModule video_crc_module;
 static VideoModule * const default_video_module_list[] = {
 	&video_null_module,
+	&video_capture_module,
+	&video_crc_module,
 	NULL
 };
 
@@ -35,6 +35,13 @@ typedef struct {
 	int (* const set_fullscreen)(_Bool fullscreen);
 	_Bool is_fullscreen;
 	void (*render_scanline)(uint8_t const *scanline_data);
+	/* Optional: called instead of render_scanline() for a line that is
+	 * the same as at that position in the previous frame.  Only for
+	 * modules that keep their framebuffer contents between frames. */
+	void (* const render_unchanged)(void);
+	/* Set by the module when lines it has kept are no longer valid (e.g.,
+	 * the palette changed), so that the next frame is rendered in full. */
+	_Bool redraw;
 	void (* const vsync)(void);
 	void (* const refresh)(void);
 	void (* const update_cross_colour_phase)(void);
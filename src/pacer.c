@@ -0,0 +1,182 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Pacing to the nanosecond.  Each call converts emulated time into an
+ * absolute deadline on a monotonic clock, carrying the remainder so that
+ * rounding never accumulates into drift.  Emulation sleeps until the
+ * deadline, optionally stopping short to spin for the last few microseconds
+ * (-pacer-spin), as a sleep tends to overshoot by more than that.  If it
+ * falls more than a second behind, it doesn't try to catch up.
+ *
+ * Where POSIX clock_gettime() and clock_nanosleep() aren't available, SDL's
+ * (or failing that, gettimeofday()'s) clock is used with relative sleeps:
+ * still no drift, but coarser. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef WINDOWS32
+#include <unistd.h>
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK >= 0 \
+	&& defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION >= 0
+#define PACER_POSIX_CLOCK
+#endif
+#endif
+
+#ifndef PACER_POSIX_CLOCK
+#ifdef HAVE_SDL
+#include <SDL.h>
+#else
+#include <sys/time.h>
+#endif
+#endif
+
+#include "events.h"
+#include "logging.h"
+#include "machine.h"
+#include "pacer.h"
+#include "xroar.h"
+
+#define NS_PER_S (1000000000ULL)
+
+// Further behind than this, and pacing restarts
+#define MAX_LAG_NS (NS_PER_S)
+
+static _Bool running = 0;
+static event_ticks last_tick;
+static uint64_t deadline_ns;
+static uint64_t deadline_rem;  // in units of 1/OSCILLATOR_RATE ns
+
+// Wake-up lateness, for jitter stats
+static struct {
+	unsigned nwaits;
+	unsigned nresets;
+	double sum_us;
+	double sum_sq_us;
+	double max_us;
+} stats;
+
+/* Monotonic time in ns from an arbitrary origin */
+
+static uint64_t now_ns(void) {
+#if defined(PACER_POSIX_CLOCK)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+#elif defined(HAVE_SDL)
+	// Extend SDL's wrapping millisecond count
+	static uint32_t last_ms;
+	static uint64_t total_ms;
+	uint32_t ms = SDL_GetTicks();
+	total_ms += (uint32_t)(ms - last_ms);
+	last_ms = ms;
+	return total_ms * 1000000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * NS_PER_S + (uint64_t)tv.tv_usec * 1000;
+#endif
+}
+
+static void sleep_until(uint64_t t) {
+#if defined(PACER_POSIX_CLOCK)
+	struct timespec ts;
+	ts.tv_sec = t / NS_PER_S;
+	ts.tv_nsec = t % NS_PER_S;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+#else
+	uint64_t now = now_ns();
+	if (t <= now)
+		return;
+#if defined(HAVE_SDL)
+	// Round up: without -pacer-spin, waking early would leave a busy wait
+	SDL_Delay((t - now + 999999) / 1000000);
+#else
+	struct timespec ts, rem;
+	ts.tv_sec = (t - now) / NS_PER_S;
+	ts.tv_nsec = (t - now) % NS_PER_S;
+	while (nanosleep(&ts, &rem) != 0 && errno == EINTR)
+		ts = rem;
+#endif
+#endif
+}
+
+void pacer_reset(void) {
+	last_tick = event_current_tick;
+	deadline_ns = now_ns();
+	deadline_rem = 0;
+	running = 1;
+}
+
+void pacer_wait(void) {
+	if (!running || xroar_noratelimit) {
+		pacer_reset();
+		return;
+	}
+
+	// Advance the deadline by the emulated time since the last call
+	uint64_t t = (uint64_t)(event_ticks)(event_current_tick - last_tick) * NS_PER_S + deadline_rem;
+	last_tick = event_current_tick;
+	deadline_ns += t / OSCILLATOR_RATE;
+	deadline_rem = t % OSCILLATOR_RATE;
+
+	uint64_t now = now_ns();
+	if (deadline_ns <= now) {
+		if (now - deadline_ns > MAX_LAG_NS) {
+			stats.nresets++;
+			pacer_reset();
+		}
+		return;
+	}
+
+	uint64_t spin_ns = 0;
+	if (xroar_cfg.pacer_spin_us > 0)
+		spin_ns = (uint64_t)xroar_cfg.pacer_spin_us * 1000;
+	if (deadline_ns - now > spin_ns)
+		sleep_until(deadline_ns - spin_ns);
+	if (spin_ns > 0) {
+		do {
+			now = now_ns();
+		} while (now < deadline_ns);
+	} else {
+		now = now_ns();
+	}
+
+	double late_us = (double)(int64_t)(now - deadline_ns) / 1000.;
+	stats.nwaits++;
+	stats.sum_us += late_us;
+	stats.sum_sq_us += late_us * late_us;
+	if (late_us > stats.max_us)
+		stats.max_us = late_us;
+}
+
+void pacer_shutdown(void) {
+	if (stats.nwaits == 0)
+		return;
+	double mean = stats.sum_us / stats.nwaits;
+	double var = stats.sum_sq_us / stats.nwaits - mean * mean;
+	LOG_DEBUG(2, "Pacer: %u waits, woke late by %.1fus mean, %.1fus sd, %.1fus max; %u resets\n", stats.nwaits, mean, (var > 0.) ? sqrt(var) : 0., stats.max_us, stats.nresets);
+	running = 0;
+}
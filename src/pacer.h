@@ -0,0 +1,24 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_PACER_H_
+#define XROAR_PACER_H_
+
+/* Keeps emulation to real time by the system clock, for when nothing else
+ * does (e.g., no audio device, or one whose writes don't block).  With
+ * -pacer-spin, the end of each wait is spent polling the clock instead of
+ * sleeping, for tighter timing at the cost of CPU. */
+
+/* Restart pacing from the current tick and time */
+void pacer_reset(void);
+
+/* Called regularly from the emulation thread.  Sleeps if emulated time is
+ * ahead of real time. */
+void pacer_wait(void);
+
+/* Log wake-up jitter stats at debug level */
+void pacer_shutdown(void);
+
+#endif  /* XROAR_PACER_H_ */
@@ -32,6 +32,7 @@
 #include "machine.h"
 #include "module.h"
 #include "sound.h"
+#include "sound_ring.h"
 #include "xroar.h"
 
 static _Bool init(void);
@@ -47,8 +48,17 @@ SoundModule sound_pulse_module = {
 static pa_simple *pa;
 static void *audio_buffer;
 
+static unsigned fragment_nframes;
 static size_t fragment_nbytes;
 
+/* Where possible, fragments are queued in a ring and written to the server
+ * by an output thread, so the emulation thread never blocks in PulseAudio. */
+static struct sound_ring *ring;
+static _Bool threaded;
+static unsigned timeout_ms;
+
+static void write_pa(void const *buffer);
+
 static _Bool init(void) {
 	const char *device = xroar_cfg.ao_device;
 	pa_sample_spec ss = {
@@ -88,7 +98,6 @@ static _Bool init(void) {
 	/* PulseAudio abstracts a bit further, so fragments don't really come
 	 * into it.  Use any specified value as "tlength". */
 
-	int fragment_nframes;
 	if (xroar_cfg.ao_fragment_ms > 0) {
 		fragment_nframes = (rate * xroar_cfg.ao_fragment_ms) / 1000;
 	} else if (xroar_cfg.ao_fragment_nframes > 0) {
@@ -112,7 +121,13 @@ static _Bool init(void) {
 	fragment_nbytes = fragment_nframes * sample_nbytes * nchannels;
 	audio_buffer = xmalloc(fragment_nbytes);
 	sound_init(audio_buffer, request_fmt, rate, nchannels, fragment_nframes);
-	LOG_DEBUG(1, "\t%dms (%d samples) buffer\n", (fragment_nframes * 1000) / rate, fragment_nframes);
+	LOG_DEBUG(1, "\t%ums (%u samples) buffer\n", (fragment_nframes * 1000) / rate, fragment_nframes);
+
+	// The ring adds up to one more fragment of latency
+	ring = sound_ring_new(fragment_nframes, frame_nbytes, rate, 0);
+	timeout_ms = (fragment_nframes * 1500) / rate + 1;
+	threaded = sound_ring_start_thread(ring, fragment_nframes, write_pa);
+	LOG_DEBUG(2, "Pulse: writing %s\n", threaded ? "from a separate thread" : "synchronously");
 	return 1;
 failed:
 	return 0;
@@ -120,15 +135,27 @@ failed:
 
 static void shutdown(void) {
 	int error;
+	sound_ring_stop_thread(ring);
+	sound_ring_log_stats(ring, "Pulse");
+	sound_ring_free(ring);
+	ring = NULL;
 	pa_simple_flush(pa, &error);
 	pa_simple_free(pa);
 	free(audio_buffer);
 }
 
-static void *write_buffer(void *buffer) {
+static void write_pa(void const *buffer) {
 	int error;
+	pa_simple_write(pa, buffer, fragment_nbytes, &error);
+}
+
+static void *write_buffer(void *buffer) {
+	if (threaded) {
+		sound_ring_queue(ring, buffer, fragment_nframes, timeout_ms);
+		return buffer;
+	}
 	if (xroar_noratelimit)
 		return buffer;
-	pa_simple_write(pa, buffer, fragment_nbytes, &error);
+	write_pa(buffer);
 	return buffer;
 }
@@ -0,0 +1,305 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* RAM is handled as an undo log.  A shadow copy holds RAM as it was at the
+ * newest capture.  When the next capture is made, each page written in the
+ * meantime has its shadow (i.e., old) contents stored with that capture
+ * before the shadow is brought up to date.  Rewinding copies back any pages
+ * written since the newest capture, then applies stored pages newest first
+ * until the requested capture is reached.
+ *
+ * Because each capture only holds what is needed to step back to the one
+ * before it, the oldest capture can be discarded at no extra cost. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "xalloc.h"
+
+#include "events.h"
+#include "hd6309.h"
+#include "logging.h"
+#include "machine.h"
+#include "mc6809.h"
+#include "mc6821.h"
+#include "rewind.h"
+#include "sam.h"
+#include "xroar.h"
+
+struct rewind_page {
+	uint8_t page;
+	uint8_t data[0x100];
+};
+
+struct rewind_state {
+	struct rewind_state *prev, *next;
+	size_t size;  // accounted against the memory budget
+	union {
+		struct MC6809 mc6809;
+		struct HD6309 hd6309;
+	} cpu;
+	struct MC6821 pia[2];
+	unsigned sam_register;
+	_Bool sam_running_fast;
+	_Bool sam_odd_cycle;
+	// Page contents as they were at the previous capture
+	unsigned npages;
+	struct rewind_page pages[];
+};
+
+static size_t budget;
+static unsigned interval_ms;
+static event_ticks interval;
+
+static uint8_t *shadow;  // RAM as at the newest capture
+static struct rewind_state *oldest, *newest;
+static unsigned nstates;
+static size_t total_size;
+static event_ticks last_capture_tick;
+
+/* Captures are only valid for the CPU instance & RAM configuration they were
+ * made with: anything else flushes the ring. */
+static struct MC6809 *state_cpu;
+static size_t state_cpu_size;
+static unsigned state_ram_size;
+
+/* Statistics, reported on exit */
+static unsigned stat_ncaptures;
+static unsigned stat_npages;
+static double stat_capture_us;
+static size_t stat_peak_size;
+
+static void flush(void);
+static void drop_oldest(void);
+static void capture(void);
+static void restore(struct rewind_state const *s);
+
+void rewind_init(void) {
+	budget = (size_t)xroar_cfg.rewind_kb * 1024;
+	interval_ms = (xroar_cfg.rewind_ms > 0) ? xroar_cfg.rewind_ms : 20;
+	interval = (OSCILLATOR_RATE / 1000) * interval_ms;
+	if (budget == 0)
+		return;
+	shadow = xmalloc(0x10000);
+	last_capture_tick = event_current_tick;
+	LOG_DEBUG(2, "Rewind: %uK, capturing every %ums\n", xroar_cfg.rewind_kb, interval_ms);
+}
+
+void rewind_shutdown(void) {
+	if (!shadow)
+		return;
+	if (stat_ncaptures > 0) {
+		LOG_DEBUG(2, "Rewind: %u captures, %.1f pages & %.1fus each on average\n", stat_ncaptures, (double)stat_npages / stat_ncaptures, stat_capture_us / stat_ncaptures);
+		LOG_DEBUG(2, "Rewind: %u states covering %.2fs in %uK (peak %uK)\n", nstates, nstates ? (nstates - 1) * interval_ms / 1000. : 0., (unsigned)(total_size / 1024), (unsigned)(stat_peak_size / 1024));
+	}
+	flush();
+	free(shadow);
+	shadow = NULL;
+}
+
+void rewind_update(void) {
+	if (!shadow)
+		return;
+	if ((event_ticks)(event_current_tick - last_capture_tick) < interval)
+		return;
+	last_capture_tick = event_current_tick;
+	struct timeval t0, t1;
+	gettimeofday(&t0, NULL);
+	capture();
+	gettimeofday(&t1, NULL);
+	stat_ncaptures++;
+	stat_capture_us += (t1.tv_sec - t0.tv_sec) * 1000000. + (t1.tv_usec - t0.tv_usec);
+	if (total_size > stat_peak_size)
+		stat_peak_size = total_size;
+}
+
+_Bool rewind_back(unsigned ms) {
+	if (!newest)
+		return 0;
+	if (machine_get_cpu(xroar_machine, 0) != state_cpu || xroar_machine->ram_size != state_ram_size) {
+		flush();
+		return 0;
+	}
+	unsigned steps = (ms + interval_ms - 1) / interval_ms;
+	// Undo writes since the newest capture
+	for (unsigned p = 0; p < 0x100; p++) {
+		if (xroar_machine->ram_dirty[p]) {
+			memcpy(xroar_machine->ram + (p << 8), shadow + (p << 8), 0x100);
+			xroar_machine->ram_dirty[p] = 0;
+		}
+	}
+	unsigned n = 0;
+	while (steps > 1 && newest != oldest) {
+		struct rewind_state *s = newest;
+		for (unsigned i = 0; i < s->npages; i++) {
+			unsigned p = s->pages[i].page;
+			memcpy(xroar_machine->ram + (p << 8), s->pages[i].data, 0x100);
+			memcpy(shadow + (p << 8), s->pages[i].data, 0x100);
+		}
+		newest = s->prev;
+		newest->next = NULL;
+		total_size -= s->size;
+		nstates--;
+		free(s);
+		steps--;
+		n++;
+	}
+	restore(newest);
+	last_capture_tick = event_current_tick;
+	LOG_DEBUG(2, "Rewind: restored state from %.2fs ago\n", n * interval_ms / 1000.);
+	return 1;
+}
+
+static void flush(void) {
+	while (oldest) {
+		struct rewind_state *s = oldest;
+		oldest = s->next;
+		free(s);
+	}
+	newest = NULL;
+	nstates = 0;
+	total_size = 0;
+}
+
+/* The new oldest state's pages would only be needed to step back past it, so
+ * they're freed too. */
+
+static void drop_oldest(void) {
+	struct rewind_state *s = oldest;
+	oldest = s->next;
+	oldest->prev = NULL;
+	total_size -= s->size;
+	nstates--;
+	free(s);
+	if (oldest->npages > 0) {
+		s = xrealloc(oldest, sizeof(*s));
+		s->npages = 0;
+		total_size -= s->size - sizeof(*s);
+		s->size = sizeof(*s);
+		if (s->next)
+			s->next->prev = s;
+		else
+			newest = s;
+		oldest = s;
+	}
+}
+
+static void capture(void) {
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
+	if (cpu != state_cpu || xroar_machine->ram_size != state_ram_size) {
+		flush();
+		state_cpu = cpu;
+		state_cpu_size = (xroar_machine_config->cpu == CPU_HD6309) ? sizeof(struct HD6309) : sizeof(struct MC6809);
+		state_ram_size = xroar_machine->ram_size;
+	}
+
+	unsigned npages = 0;
+	if (newest) {
+		for (unsigned p = 0; p < 0x100; p++) {
+			if (xroar_machine->ram_dirty[p])
+				npages++;
+		}
+	} else {
+		// First capture: nothing to step back to
+		memcpy(shadow, xroar_machine->ram, 0x10000);
+		memset(xroar_machine->ram_dirty, 0, sizeof(xroar_machine->ram_dirty));
+	}
+
+	size_t size = sizeof(struct rewind_state) + npages * sizeof(struct rewind_page);
+	struct rewind_state *s = xmalloc(size);
+	s->size = size;
+	s->npages = npages;
+	struct rewind_page *page = s->pages;
+	for (unsigned p = 0; npages > 0 && p < 0x100; p++) {
+		if (!xroar_machine->ram_dirty[p])
+			continue;
+		page->page = p;
+		memcpy(page->data, shadow + (p << 8), 0x100);
+		memcpy(shadow + (p << 8), xroar_machine->ram + (p << 8), 0x100);
+		xroar_machine->ram_dirty[p] = 0;
+		page++;
+	}
+	stat_npages += npages;
+
+	memcpy(&s->cpu, cpu, state_cpu_size);
+	s->pia[0] = *machine_get_pia(xroar_machine, 0);
+	s->pia[1] = *machine_get_pia(xroar_machine, 1);
+	struct MC6883 *sam = machine_get_sam(xroar_machine, 0);
+	s->sam_register = sam_get_register(sam);
+	s->sam_running_fast = sam->running_fast;
+	s->sam_odd_cycle = sam->odd_cycle;
+
+	s->next = NULL;
+	s->prev = newest;
+	if (newest)
+		newest->next = s;
+	else
+		oldest = s;
+	newest = s;
+	nstates++;
+	total_size += size;
+	while (total_size > budget && oldest != newest)
+		drop_oldest();
+}
+
+static void restore_pia_side(struct MC6821_side *side, struct MC6821_side const *saved) {
+	side->control_register = saved->control_register;
+	side->direction_register = saved->direction_register;
+	side->output_register = saved->output_register;
+	side->interrupt_received = saved->interrupt_received;
+	side->irq = saved->irq;
+}
+
+static void restore(struct rewind_state const *s) {
+	struct MC6809 *cpu = state_cpu;
+	struct MC6809 cur = *cpu;
+	struct MC6809 const *saved = &s->cpu.mc6809;
+	memcpy(cpu, &s->cpu, state_cpu_size);
+	// Hooks may have been changed (e.g. by trace mode) since capture
+	cpu->instruction_hook = cur.instruction_hook;
+	cpu->instruction_posthook = cur.instruction_posthook;
+	cpu->interrupt_hook = cur.interrupt_hook;
+	cpu->running = cur.running;
+	// Interrupt timing is relative to the CPU's own cycle count
+	cpu->cycle = cur.cycle;
+	cpu->nmi_cycle = cur.cycle + (saved->nmi_cycle - saved->cycle);
+	cpu->firq_cycle = cur.cycle + (saved->firq_cycle - saved->cycle);
+	cpu->irq_cycle = cur.cycle + (saved->irq_cycle - saved->cycle);
+
+	// Calling the postwrite hooks brings dependent state (VDG mode, sound
+	// source, Dragon 64 ROM select) into line with the restored outputs.
+	for (int i = 0; i < 2; i++) {
+		struct MC6821 *pia = machine_get_pia(xroar_machine, i);
+		restore_pia_side(&pia->a, &s->pia[i].a);
+		restore_pia_side(&pia->b, &s->pia[i].b);
+		mc6821_update_state(pia);
+		DELEGATE_SAFE_CALL0(pia->a.data_postwrite);
+		DELEGATE_SAFE_CALL0(pia->b.data_postwrite);
+	}
+
+	struct MC6883 *sam = machine_get_sam(xroar_machine, 0);
+	sam_set_register(sam, s->sam_register);
+	sam->running_fast = s->sam_running_fast;
+	sam->odd_cycle = s->sam_odd_cycle;
+}
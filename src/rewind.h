@@ -0,0 +1,28 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_REWIND_H_
+#define XROAR_REWIND_H_
+
+/* In-memory rewind.  Machine state is captured every xroar_cfg.rewind_ms
+ * milliseconds of emulated time into a ring limited to xroar_cfg.rewind_kb
+ * kilobytes, dropping the oldest captures to stay within it.  Only RAM pages
+ * written since the previous capture (see ram_dirty in struct machine) are stored.
+ *
+ * CPU, PIA and SAM state is captured along with RAM.  Cartridge, tape and
+ * disk state is not, and neither is the position of the video beam. */
+
+void rewind_init(void);
+void rewind_shutdown(void);
+
+/* Capture state if the interval has elapsed.  Must only be called between
+ * calls to machine_run(), never from an event. */
+void rewind_update(void);
+
+/* Restore the state captured about 'ms' milliseconds of emulated time ago, or
+ * the oldest available.  Returns false if nothing has been captured. */
+_Bool rewind_back(unsigned ms);
+
+#endif  /* XROAR_REWIND_H_ */
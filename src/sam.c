@@ -21,12 +21,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-#include "sam.h"
-
-/* Internal cycle flag, for determining when a slow CPU cycle needs to be
- * extended to interleave with VDG properly. */
+#include "xalloc.h"
 
-static _Bool odd_cycle;
+#include "delegate.h"
+#include "sam.h"
 
 /* Constants for tracking VDG address counter */
 static int const vdg_mod_xdivs[8] = { 1, 3, 1, 2, 1, 1, 1, 1 };
@@ -42,50 +40,67 @@ static int const ram_col_shifts[4] = { 2, 1, 0, 0 };
 static uint16_t const ram_col_masks[4] = { 0x3f00, 0x7f00, 0xff00, 0xff00 };
 static uint16_t const ram_ras1_bits[4] = { 0x1000, 0x4000, 0, 0 };
 
-/* VDG address counter */
-static uint16_t vdg_base;
-static uint16_t vdg_address;
-static int vdg_mod_xdiv;
-static int vdg_mod_ydiv;
-static int vdg_mod_add;
-static uint16_t vdg_mod_clear;
-static int vdg_xcount;
-static int vdg_ycount;
-
-/* Address multiplexer */
-static uint16_t ram_row_mask;
-static int ram_col_shift;
-static uint16_t ram_col_mask;
-static uint16_t ram_ras1_bit;
-static uint16_t ram_ras1;
-static uint16_t ram_page_bit;
-
-/* Address decode */
-static _Bool map_type_1;
-
-/* SAM control register */
-static uint_fast16_t sam_register;
-
-/* MPU rate */
-static _Bool mpu_rate_fast;
-static _Bool mpu_rate_ad;
-static _Bool running_fast = 0;
-
-static void update_from_register(void);
-
-void sam_reset(void) {
-	sam_set_register(0);
-	sam_vdg_fsync(1);
-	odd_cycle = 0;
+struct MC6883_private {
+	struct MC6883 public;
+
+	/* SAM control register */
+	uint_fast16_t reg;
+
+	/* Address decode */
+	_Bool map_type_1;
+
+	/* Address multiplexer */
+	uint16_t ram_row_mask;
+	int ram_col_shift;
+	uint16_t ram_col_mask;
+	uint16_t ram_ras1_bit;
+	uint16_t ram_ras1;
+	uint16_t ram_page_bit;
+
+	/* MPU rate */
+	_Bool mpu_rate_fast;
+	_Bool mpu_rate_ad;
+
+	/* VDG address counter */
+	uint16_t vdg_base;
+	uint16_t vdg_address;
+	int vdg_mod_xdiv;
+	int vdg_mod_ydiv;
+	int vdg_mod_add;
+	uint16_t vdg_mod_clear;
+	int vdg_xcount;
+	int vdg_ycount;
+};
+
+/* Bits of the control register affecting address decode or MPU rate */
+#define SAM_MAP_BITS (0xfc00)
+
+static void update_from_register(struct MC6883_private *sam);
+
+struct MC6883 *sam_new(void) {
+	struct MC6883_private *sam = xzalloc(sizeof(*sam));
+	sam->public.map_changed = DELEGATE_DEFAULT0(void);
+	update_from_register(sam);
+	return (struct MC6883 *)sam;
+}
+
+void sam_free(struct MC6883 *samp) {
+	free(samp);
+}
+
+void sam_reset(struct MC6883 *samp) {
+	sam_set_register(samp, 0);
+	sam_vdg_fsync(samp, 1);
+	samp->odd_cycle = 0;
 }
 
 #define VRAM_TRANSLATE(a) ( \
-		((a << ram_col_shift) & ram_col_mask) \
-		| (a & ram_row_mask) \
-		| (!(a & ram_ras1_bit) ? ram_ras1 : 0) \
+		((a << sam->ram_col_shift) & sam->ram_col_mask) \
+		| (a & sam->ram_row_mask) \
+		| (!(a & sam->ram_ras1_bit) ? sam->ram_ras1 : 0) \
 	)
 
-#define RAM_TRANSLATE(a) (VRAM_TRANSLATE(a) | ram_page_bit)
+#define RAM_TRANSLATE(a) (VRAM_TRANSLATE(a) | sam->ram_page_bit)
 
 /* The primary function of the SAM: translates an address (A) plus Read/!Write
  * flag (RnW) into an S value and RAM address (Z).  Writes to the SAM control
@@ -93,20 +108,20 @@ void sam_reset(void) {
  * clock would be use for this access is written to ncycles.  Returns 1 when
  * the access is to a RAM area, 0 otherwise. */
 
-_Bool sam_run(uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles) {
+_Bool sam_run(struct MC6883 *samp, uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
 	_Bool is_ram_access;
 	_Bool fast_cycle;
-	if (A < 0x8000 || (map_type_1 && A < 0xff00)) {
+	if (A < 0x8000 || (sam->map_type_1 && A < 0xff00)) {
 		*Z = RAM_TRANSLATE(A);
 		is_ram_access = 1;
-		fast_cycle = mpu_rate_fast;
 	} else {
-		fast_cycle = mpu_rate_fast || mpu_rate_ad;
 		is_ram_access = 0;
 	}
+	fast_cycle = sam_is_fast_cycle(samp, A);
 	if (A < 0x8000) {
 		*S = RnW ? 0 : 7;
-	} else if (map_type_1 && RnW && A < 0xff00) {
+	} else if (sam->map_type_1 && RnW && A < 0xff00) {
 		*S = 0;
 	} else if (A < 0xa000) {
 		*S = 1;
@@ -116,7 +131,6 @@ _Bool sam_run(uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles) {
 		*S = 3;
 	} else if (A < 0xff20) {
 		*S = 4;
-		fast_cycle = mpu_rate_fast;
 	} else if (A < 0xff40) {
 		*S = 5;
 	} else if (A < 0xff60) {
@@ -126,83 +140,73 @@ _Bool sam_run(uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles) {
 		if (!RnW && A >= 0xffc0) {
 			uint_fast16_t b = 1 << ((A >> 1) & 0x0f);
 			if (A & 1) {
-				sam_register |= b;
+				sam->reg |= b;
 			} else {
-				sam_register &= ~b;
+				sam->reg &= ~b;
 			}
-			update_from_register();
+			update_from_register(sam);
+			if (b & SAM_MAP_BITS)
+				DELEGATE_CALL0(samp->map_changed);
 		}
 	} else {
 		*S = 2;
 	}
 
-	if (!ncycles)
-		return is_ram_access;
-
-	if (running_fast) {
-		if (fast_cycle) {
-			// Fast cycle, may become un-interleaved
-			*ncycles = SAM_CPU_FAST_DIVISOR;
-			odd_cycle = !odd_cycle;
-		} else {
-			// Transition fast to slow
-			if (odd_cycle) {
-				// Re-interleave
-				*ncycles = SAM_CPU_SLOW_DIVISOR + SAM_CPU_FAST_DIVISOR;
-				odd_cycle = 0;
-			} else {
-				*ncycles = SAM_CPU_SLOW_DIVISOR;
-			}
-			running_fast = 0;
-		}
-	} else {
-		if (fast_cycle) {
-			// Transition slow to fast
-			*ncycles = SAM_CPU_SLOW_DIVISOR;
-			running_fast = 1;
-		} else {
-			// Slow cycle
-			*ncycles = SAM_CPU_SLOW_DIVISOR;
-		}
-	}
+	if (ncycles)
+		*ncycles = sam_cycle_ncycles(samp, fast_cycle);
 
 	return is_ram_access;
 }
 
-static void vdg_address_add(int n) {
-	uint16_t new_B = vdg_address + n;
-	if ((vdg_address ^ new_B) & 0x10) {
-		vdg_xcount = (vdg_xcount + 1) % vdg_mod_xdiv;
-		if (vdg_xcount != 0) {
+/* Whether a CPU access to A is a fast cycle at the current MPU rate.  Within
+ * any 256-byte page this is constant, except in the page at 0xff00: accesses
+ * to 0xff00-0xff1f are not sped up by the address-dependent rate. */
+
+_Bool sam_is_fast_cycle(struct MC6883 const *samp, uint16_t A) {
+	struct MC6883_private const *sam = (struct MC6883_private const *)samp;
+	if (A < 0x8000 || (sam->map_type_1 && A < 0xff00))
+		return sam->mpu_rate_fast;
+	if (A >= 0xff00 && A < 0xff20)
+		return sam->mpu_rate_fast;
+	return sam->mpu_rate_fast || sam->mpu_rate_ad;
+}
+
+static void vdg_address_add(struct MC6883_private *sam, int n) {
+	uint16_t new_B = sam->vdg_address + n;
+	if ((sam->vdg_address ^ new_B) & 0x10) {
+		sam->vdg_xcount = (sam->vdg_xcount + 1) % sam->vdg_mod_xdiv;
+		if (sam->vdg_xcount != 0) {
 			new_B -= 0x10;
 		} else {
-			if ((vdg_address ^ new_B) & 0x20) {
-				vdg_ycount = (vdg_ycount + 1) % vdg_mod_ydiv;
-				if (vdg_ycount != 0) {
+			if ((sam->vdg_address ^ new_B) & 0x20) {
+				sam->vdg_ycount = (sam->vdg_ycount + 1) % sam->vdg_mod_ydiv;
+				if (sam->vdg_ycount != 0) {
 					new_B -= 0x20;
 				}
 			}
 		}
 	}
-	vdg_address = new_B;
+	sam->vdg_address = new_B;
 }
 
-void sam_vdg_hsync(_Bool level) {
+void sam_vdg_hsync(struct MC6883 *samp, _Bool level) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
 	if (level)
 		return;
 	/* The top cleared bit will, if a transition to low occurs, increment
 	 * the bits above it.  This dummy fetch will achieve the same effective
 	 * result. */
-	vdg_address_add(vdg_mod_add);
-	vdg_address &= vdg_mod_clear;
+	vdg_address_add(sam, sam->vdg_mod_add);
+	sam->vdg_address &= sam->vdg_mod_clear;
 }
 
-void sam_vdg_fsync(_Bool level) {
+void sam_vdg_fsync(struct MC6883 *samp, _Bool level) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
 	if (!level)
 		return;
-	vdg_address = vdg_base;
-	vdg_xcount = 0;
-	vdg_ycount = 0;
+	sam->vdg_address = sam->vdg_base;
+	sam->vdg_xcount = 0;
+	sam->vdg_ycount = 0;
 }
 
 /* Called with the number of bytes of video data required, this implements the
@@ -211,58 +215,69 @@ void sam_vdg_fsync(_Bool level) {
  * bytes available.  As the next byte may not be sequential, continue calling
  * until all required data is fetched. */
 
-int sam_vdg_bytes(int nbytes, uint16_t *V, _Bool *valid) {
-	uint16_t b3_0 = vdg_address & 0xf;
-	_Bool is_valid = !mpu_rate_fast;
+int sam_vdg_bytes(struct MC6883 *samp, int nbytes, uint16_t *V, _Bool *valid) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	uint16_t b3_0 = sam->vdg_address & 0xf;
+	_Bool is_valid = !sam->mpu_rate_fast;
 	if (valid) *valid = is_valid;
 	if (is_valid && V)
-		*V = VRAM_TRANSLATE(vdg_address);
+		*V = VRAM_TRANSLATE(sam->vdg_address);
 	if ((b3_0 + nbytes) < 16) {
-		vdg_address += nbytes;
+		sam->vdg_address += nbytes;
 		return nbytes;
 	}
 	nbytes = 16 - b3_0;
-	vdg_address_add(nbytes);
+	vdg_address_add(sam, nbytes);
 	return nbytes;
 }
 
-void sam_set_register(unsigned int value) {
-	sam_register = value;
-	update_from_register();
+uint16_t sam_vdg_translate(struct MC6883 const *samp, uint16_t V) {
+	struct MC6883_private const *sam = (struct MC6883_private const *)samp;
+	return VRAM_TRANSLATE(V);
 }
 
-unsigned int sam_get_register(void) {
-	return sam_register;
+void sam_set_register(struct MC6883 *samp, unsigned int value) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	unsigned old_register = sam->reg;
+	sam->reg = value;
+	update_from_register(sam);
+	if ((old_register ^ sam->reg) & SAM_MAP_BITS)
+		DELEGATE_CALL0(samp->map_changed);
 }
 
-static void update_from_register(void) {
-	int vdg_mode = sam_register & 7;
-	vdg_base = (sam_register & 0x03f8) << 6;
-	vdg_mod_xdiv = vdg_mod_xdivs[vdg_mode];
-	vdg_mod_ydiv = vdg_mod_ydivs[vdg_mode];
-	vdg_mod_add = vdg_mod_adds[vdg_mode];
-	vdg_mod_clear = vdg_mod_clears[vdg_mode];
-
-	int memory_size = (sam_register >> 13) & 3;
-	ram_row_mask = ram_row_masks[memory_size];
-	ram_col_shift = ram_col_shifts[memory_size];
-	ram_col_mask = ram_col_masks[memory_size];
-	ram_ras1_bit = ram_ras1_bits[memory_size];
+unsigned int sam_get_register(struct MC6883 const *samp) {
+	struct MC6883_private const *sam = (struct MC6883_private const *)samp;
+	return sam->reg;
+}
+
+static void update_from_register(struct MC6883_private *sam) {
+	int vdg_mode = sam->reg & 7;
+	sam->vdg_base = (sam->reg & 0x03f8) << 6;
+	sam->vdg_mod_xdiv = vdg_mod_xdivs[vdg_mode];
+	sam->vdg_mod_ydiv = vdg_mod_ydivs[vdg_mode];
+	sam->vdg_mod_add = vdg_mod_adds[vdg_mode];
+	sam->vdg_mod_clear = vdg_mod_clears[vdg_mode];
+
+	int memory_size = (sam->reg >> 13) & 3;
+	sam->ram_row_mask = ram_row_masks[memory_size];
+	sam->ram_col_shift = ram_col_shifts[memory_size];
+	sam->ram_col_mask = ram_col_masks[memory_size];
+	sam->ram_ras1_bit = ram_ras1_bits[memory_size];
 	switch (memory_size) {
 		case 0: /* 4K */
 		case 1: /* 16K */
-			ram_page_bit = 0;
-			ram_ras1 = 0x8080;
+			sam->ram_page_bit = 0;
+			sam->ram_ras1 = 0x8080;
 			break;
 		default:
 		case 2:
 		case 3: /* 64K */
-			ram_page_bit = (sam_register & 0x0400) << 5;
-			ram_ras1 = 0;
+			sam->ram_page_bit = (sam->reg & 0x0400) << 5;
+			sam->ram_ras1 = 0;
 			break;
 	}
 
-	map_type_1 = ((sam_register & 0x8000) != 0);
-	mpu_rate_fast = sam_register & 0x1000;
-	mpu_rate_ad = !map_type_1 && (sam_register & 0x800);
+	sam->map_type_1 = ((sam->reg & 0x8000) != 0);
+	sam->mpu_rate_fast = sam->reg & 0x1000;
+	sam->mpu_rate_ad = !sam->map_type_1 && (sam->reg & 0x800);
 }
@@ -8,16 +8,63 @@
 
 #include <stdint.h>
 
+#include "delegate.h"
+
 #define SAM_CPU_SLOW_DIVISOR 16
 #define SAM_CPU_FAST_DIVISOR 8
 
-#define sam_init()
-void sam_reset(void);
-_Bool sam_run(uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles);
-void sam_vdg_hsync(_Bool level);
-void sam_vdg_fsync(_Bool level);
-int sam_vdg_bytes(int nbytes, uint16_t *V, _Bool *valid);
-void sam_set_register(unsigned int value);
-unsigned int sam_get_register(void);
+struct MC6883 {
+	/* MPU rate state.  Exposed so that sam_cycle_ncycles() can be inlined
+	 * into the machine's memory access fast path. */
+	_Bool running_fast;
+	/* Internal cycle flag, for determining when a slow CPU cycle needs to
+	 * be extended to interleave with VDG properly. */
+	_Bool odd_cycle;
+
+	/* Called whenever a change to the control register affects address
+	 * decode, memory size or MPU rate. */
+	DELEGATE_T0(void) map_changed;
+};
+
+struct MC6883 *sam_new(void);
+void sam_free(struct MC6883 *sam);
+
+void sam_reset(struct MC6883 *sam);
+_Bool sam_run(struct MC6883 *sam, uint16_t A, _Bool RnW, int *S, uint16_t *Z, int *ncycles);
+_Bool sam_is_fast_cycle(struct MC6883 const *sam, uint16_t A);
+void sam_vdg_hsync(struct MC6883 *sam, _Bool level);
+void sam_vdg_fsync(struct MC6883 *sam, _Bool level);
+int sam_vdg_bytes(struct MC6883 *sam, int nbytes, uint16_t *V, _Bool *valid);
+/* Translate a video address as sam_vdg_bytes() would, without touching the
+ * video address counter. */
+uint16_t sam_vdg_translate(struct MC6883 const *sam, uint16_t V);
+void sam_set_register(struct MC6883 *sam, unsigned int value);
+unsigned int sam_get_register(struct MC6883 const *sam);
+
+/* Number of SAM cycles taken by the next CPU cycle, given whether it is to
+ * be a fast cycle (see sam_is_fast_cycle()).  Updates rate state. */
+
+static inline int sam_cycle_ncycles(struct MC6883 *sam, _Bool fast_cycle) {
+	if (sam->running_fast) {
+		if (fast_cycle) {
+			// Fast cycle, may become un-interleaved
+			sam->odd_cycle = !sam->odd_cycle;
+			return SAM_CPU_FAST_DIVISOR;
+		}
+		// Transition fast to slow
+		sam->running_fast = 0;
+		if (sam->odd_cycle) {
+			// Re-interleave
+			sam->odd_cycle = 0;
+			return SAM_CPU_SLOW_DIVISOR + SAM_CPU_FAST_DIVISOR;
+		}
+		return SAM_CPU_SLOW_DIVISOR;
+	}
+	if (fast_cycle) {
+		// Transition slow to fast
+		sam->running_fast = 1;
+	}
+	return SAM_CPU_SLOW_DIVISOR;
+}
 
 #endif  /* XROAR_SAM_H_ */
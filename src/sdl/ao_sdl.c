@@ -17,10 +17,10 @@
  */
 
 /* SDL processes audio in a separate thread, using a callback to request more
- * data.  When the configured number of audio fragments (nfragments) is 1,
- * write directly into the buffer provided by SDL.  When nfragments > 1,
- * maintain a queue of fragment buffers; the callback takes the next filled
- * buffer from the queue and copies its data into place. */
+ * data.  Filled fragments are queued in a lock-free ring holding up to
+ * nfragments fragments, and the callback copies out as much as it needs.  The
+ * callback never waits: if the ring runs dry, the rest is filled with
+ * silence. */
 
 #include "config.h"
 
@@ -37,6 +37,7 @@
 #include "machine.h"
 #include "module.h"
 #include "sound.h"
+#include "sound_ring.h"
 #include "xroar.h"
 
 static _Bool init(void);
@@ -51,23 +52,15 @@ SoundModule sound_sdl_module = {
 
 static SDL_AudioSpec audiospec;
 
-static void *callback_buffer;
-static _Bool shutting_down;
-
 static unsigned nfragments;
-static unsigned fragment_nbytes;
-
-static SDL_mutex *fragment_mutex;
-static SDL_cond *fragment_cv;
-static void **fragment_buffer;
-static unsigned fragment_queue_length;
-static unsigned write_fragment;
-static unsigned play_fragment;
+static unsigned fragment_nframes;
+static unsigned frame_nbytes;
+static void *audio_buffer;
+static struct sound_ring *ring;
 
 static unsigned timeout_ms;
 
 static void callback(void *, Uint8 *, int);
-static void callback_1(void *, Uint8 *, int);
 
 static _Bool init(void) {
 	static SDL_AudioSpec desired;
@@ -85,7 +78,6 @@ static _Bool init(void) {
 
 	unsigned rate = 48000;
 	unsigned nchannels = 2;
-	unsigned fragment_nframes;
 	unsigned buffer_nframes;
 	unsigned sample_nbytes;
 	enum sound_fmt sample_fmt;
@@ -118,7 +110,7 @@ static _Bool init(void) {
 	desired.freq = rate;
 	desired.channels = nchannels;
 	desired.samples = fragment_nframes;
-	desired.callback = (nfragments == 1) ? callback_1 : callback;
+	desired.callback = callback;
 	desired.userdata = NULL;
 
 	switch (xroar_cfg.ao_format) {
@@ -167,28 +159,12 @@ static _Bool init(void) {
 	timeout_ms = (fragment_nframes * 1500) / rate;
 
 	buffer_nframes = fragment_nframes * nfragments;
-	fragment_nbytes = fragment_nframes * nchannels * sample_nbytes;
-
-	fragment_mutex = SDL_CreateMutex();
-	fragment_cv = SDL_CreateCond();
+	frame_nbytes = nchannels * sample_nbytes;
 
-	shutting_down = 0;
-	fragment_queue_length = 0;
-	write_fragment = 0;
-	play_fragment = 0;
-	callback_buffer = NULL;
-
-	// allocate fragment buffers
-	fragment_buffer = xmalloc(nfragments * sizeof(void *));
-	if (nfragments == 1) {
-		fragment_buffer[0] = NULL;
-	} else {
-		for (unsigned i = 0; i < nfragments; i++) {
-			fragment_buffer[i] = xzalloc(fragment_nbytes);
-		}
-	}
+	ring = sound_ring_new(buffer_nframes, frame_nbytes, rate, audiospec.silence);
+	audio_buffer = xzalloc(fragment_nframes * frame_nbytes);
 
-	sound_init(fragment_buffer[0], sample_fmt, rate, nchannels, fragment_nframes);
+	sound_init(audio_buffer, sample_fmt, rate, nchannels, fragment_nframes);
 	LOG_DEBUG(1, "\t%u frags * %u frames/frag = %u frames buffer (%.1fms)\n", nfragments, fragment_nframes, buffer_nframes, (float)(buffer_nframes * 1000) / rate);
 
 	SDL_PauseAudio(0);
@@ -201,114 +177,24 @@ failed:
 }
 
 static void _shutdown(void) {
-	shutting_down = 1;
-
 	// no more audio
 	SDL_PauseAudio(1);
-
-	// unblock audio thread
-	SDL_LockMutex(fragment_mutex);
-	fragment_queue_length = 1;
-	SDL_CondSignal(fragment_cv);
-	SDL_UnlockMutex(fragment_mutex);
-
 	SDL_CloseAudio();
 	SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
-	SDL_DestroyCond(fragment_cv);
-	SDL_DestroyMutex(fragment_mutex);
-
-	if (nfragments > 1) {
-		for (unsigned i = 0; i < nfragments; i++) {
-			free(fragment_buffer[i]);
-		}
-	}
-
-	free(fragment_buffer);
+	sound_ring_log_stats(ring, "SDL audio");
+	sound_ring_free(ring);
+	ring = NULL;
+	free(audio_buffer);
+	audio_buffer = NULL;
 }
 
 static void *write_buffer(void *buffer) {
-	(void)buffer;
-
-	SDL_LockMutex(fragment_mutex);
-
-	/* For nfragments == 1, a non-NULL buffer means we've finished writing
-	 * to the buffer provided by the callback.  Otherwise, one fragment
-	 * buffer is now full.  Either way, signal the callback in case it is
-	 * waiting for data to be available. */
-
-	if (buffer) {
-		write_fragment = (write_fragment + 1) % nfragments;
-		fragment_queue_length++;
-		SDL_CondSignal(fragment_cv);
-	}
-
-	if (xroar_noratelimit) {
-		SDL_UnlockMutex(fragment_mutex);
-		return NULL;
-	}
-
-	if (nfragments == 1) {
-		// for nfragments == 1, wait for callback to send buffer
-		while (callback_buffer == NULL) {
-			if (SDL_CondWaitTimeout(fragment_cv, fragment_mutex, timeout_ms) == SDL_MUTEX_TIMEDOUT) {
-				SDL_UnlockMutex(fragment_mutex);
-				return NULL;
-			}
-		}
-		fragment_buffer[0] = callback_buffer;
-		callback_buffer = NULL;
-	} else {
-		// for nfragments > 1, wait until a fragment buffer is available
-		while (fragment_queue_length == nfragments) {
-			if (SDL_CondWaitTimeout(fragment_cv, fragment_mutex, timeout_ms) == SDL_MUTEX_TIMEDOUT) {
-				SDL_UnlockMutex(fragment_mutex);
-				return NULL;
-			}
-		}
-	}
-
-	SDL_UnlockMutex(fragment_mutex);
-	return fragment_buffer[write_fragment];
+	sound_ring_queue(ring, buffer, fragment_nframes, timeout_ms);
+	return buffer;
 }
 
 static void callback(void *userdata, Uint8 *stream, int len) {
 	(void)userdata;  /* unused */
-	if (shutting_down)
-		return;
-	SDL_LockMutex(fragment_mutex);
-
-	// wait until at least one fragment buffer is filled
-	while (fragment_queue_length == 0)
-		SDL_CondWait(fragment_cv, fragment_mutex);
-
-	// copy it to callback buffer
-	memcpy(stream, fragment_buffer[play_fragment], fragment_nbytes);
-	play_fragment = (play_fragment + 1) % nfragments;
-
-	// signal main thread that a fragment buffer is available
-	fragment_queue_length--;
-	SDL_CondSignal(fragment_cv);
-
-	SDL_UnlockMutex(fragment_mutex);
-}
-
-static void callback_1(void *userdata, Uint8 *stream, int len) {
-	(void)userdata;  /* unused */
-	if (shutting_down)
-		return;
-	SDL_LockMutex(fragment_mutex);
-
-	// pass callback buffer to main thread
-	callback_buffer = stream;
-	SDL_CondSignal(fragment_cv);
-
-	// wait until main thread signals filled buffer
-	while (fragment_queue_length == 0)
-		SDL_CondWait(fragment_cv, fragment_mutex);
-
-	// set to 0 so next callback will wait
-	fragment_queue_length = 0;
-
-	SDL_UnlockMutex(fragment_mutex);
+	sound_ring_read(ring, stream, len / frame_nbytes);
 }
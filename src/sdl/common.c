@@ -55,6 +55,8 @@ VideoModule * const sdl_video_module_list[] = {
 	&video_sdl_module,
 #endif
 	&video_null_module,
+	&video_capture_module,
+	&video_crc_module,
 	NULL
 };
 
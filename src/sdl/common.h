@@ -16,6 +16,8 @@ extern VideoModule video_sdlgl_module;
 extern VideoModule video_sdlyuv_module;
 extern VideoModule video_sdl_module;
 extern VideoModule video_null_module;
+extern VideoModule video_capture_module;
+extern VideoModule video_crc_module;
 extern KeyboardModule keyboard_sdl_module;
 
 extern struct joystick_interface sdl_js_if_physical;
@@ -230,6 +230,9 @@ static void emulator_command(SDLKey sym) {
 	case SDLK_a:
 		xroar_set_cross_colour(1, XROAR_CYCLE);
 		break;
+	case SDLK_b:
+		xroar_rewind();
+		break;
 	case SDLK_c:
 	case SDLK_q:
 		xroar_quit();
@@ -242,7 +245,7 @@ static void emulator_command(SDLKey sym) {
 		break;
 	case SDLK_h:
 		if (shift)
-			machine_toggle_pause();
+			machine_toggle_pause(xroar_machine);
 		break;
 	case SDLK_i:
 		if (shift)
@@ -357,7 +360,7 @@ void sdl_keypress(SDL_keysym *keysym) {
 		}
 	}
 	if (sym == SDLK_PAUSE) {
-		machine_toggle_pause();
+		machine_toggle_pause(xroar_machine);
 		return;
 	}
 	if (control) {
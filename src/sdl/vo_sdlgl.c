@@ -46,6 +46,7 @@ VideoModule video_sdlgl_module = {
 	.refresh = refresh,
 	.vsync = vsync,
 	.render_scanline = vo_opengl_render_scanline,
+	.render_unchanged = vo_opengl_render_unchanged,
 	.resize = resize, .set_fullscreen = set_fullscreen,
 	.update_cross_colour_phase = vo_opengl_update_cross_colour_phase,
 };
@@ -36,6 +36,7 @@ static void shutdown(void);
 static void alloc_colours(void);
 static void vsync(void);
 static void render_scanline(uint8_t const *scanline_data);
+static void render_unchanged(void);
 static void resize(unsigned int w, unsigned int h);
 static int set_fullscreen(_Bool fullscreen);
 static void update_cross_colour_phase(void);
@@ -46,6 +47,7 @@ VideoModule video_sdlyuv_module = {
 	.update_palette = alloc_colours,
 	.vsync = vsync,
 	.render_scanline = render_scanline,
+	.render_unchanged = render_unchanged,
 	.resize = resize, .set_fullscreen = set_fullscreen,
 	.update_cross_colour_phase = update_cross_colour_phase,
 };
@@ -18,10 +18,21 @@
 
 #include "config.h"
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef WINDOWS32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "xalloc.h"
+
 #include "cart.h"
 #include "fs.h"
 #include "keyboard.h"
@@ -60,6 +71,26 @@
 #define SNAPSHOT_VERSION_MAJOR 1
 #define SNAPSHOT_VERSION_MINOR 7
 
+/* Fast snapshots trade flexibility for speed of restore.  Everything but RAM
+ * is at a fixed offset within the first page, and RAM starts on the next page
+ * boundary, so the file can be mapped and RAM copied in one go.  Multi-byte
+ * values are big-endian, as in the chunked format.  Only the current version
+ * is understood: a fast snapshot is a cache, not an archive. */
+
+#define FAST_MAGIC "XRoar fastsnap\012\000"
+#define FAST_VERSION 1
+
+#define FAST_OFF_MAGIC   (0x000)  // 16 bytes
+#define FAST_OFF_VERSION (0x010)  // 16-bit
+#define FAST_OFF_MACHINE (0x020)  // 8 bytes, as ID_MACHINECONFIG
+#define FAST_OFF_RAMSIZE (0x030)  // 32-bit
+#define FAST_OFF_CPU     (0x040)  // 27 bytes, as ID_HD6309_STATE
+#define FAST_OFF_PIA     (0x080)  // 12 bytes, as ID_PIA_REGISTERS
+#define FAST_OFF_SAM     (0x090)  // 16-bit
+#define FAST_OFF_RAM     (0x1000)
+
+static int read_snapshot_fast(const char *filename);
+
 static void write_chunk_header(FILE *fd, unsigned id, unsigned size) {
 	fs_write_uint8(fd, id);
 	fs_write_uint16(fd, size);
@@ -155,20 +186,20 @@ int write_snapshot(const char *filename) {
 	}
 	fs_write_uint8(fd, xroar_machine_config->cross_colour_phase);
 	// RAM page 0
-	unsigned ram0_size = machine_ram_size > 0x8000 ? 0x8000 : machine_ram_size;
+	unsigned ram0_size = xroar_machine->ram_size > 0x8000 ? 0x8000 : xroar_machine->ram_size;
 	write_chunk_header(fd, ID_RAM_PAGE0, ram0_size);
-	fwrite(machine_ram, 1, ram0_size, fd);
+	fwrite(xroar_machine->ram, 1, ram0_size, fd);
 	// RAM page 1
-	if (machine_ram_size > 0x8000) {
-		unsigned ram1_size = machine_ram_size - 0x8000;
+	if (xroar_machine->ram_size > 0x8000) {
+		unsigned ram1_size = xroar_machine->ram_size - 0x8000;
 		write_chunk_header(fd, ID_RAM_PAGE1, ram1_size);
-		fwrite(machine_ram + 0x8000, 1, ram1_size, fd);
+		fwrite(xroar_machine->ram + 0x8000, 1, ram1_size, fd);
 	}
 	// PIA state written before CPU state because PIA may have
 	// unacknowledged interrupts pending already cleared in the CPU state
 	write_chunk_header(fd, ID_PIA_REGISTERS, 3 * 4);
 	for (int i = 0; i < 2; i++) {
-		struct MC6821 *pia = machine_get_pia(i);
+		struct MC6821 *pia = machine_get_pia(xroar_machine, i);
 		fs_write_uint8(fd, pia->a.direction_register);
 		fs_write_uint8(fd, pia->a.output_register);
 		fs_write_uint8(fd, pia->a.control_register);
@@ -177,7 +208,7 @@ int write_snapshot(const char *filename) {
 		fs_write_uint8(fd, pia->b.control_register);
 	}
 	// CPU state
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	switch (xroar_machine_config->cpu) {
 	case CPU_MC6809: default:
 		write_mc6809(fd, cpu);
@@ -188,7 +219,7 @@ int write_snapshot(const char *filename) {
 	}
 	// SAM
 	write_chunk_header(fd, ID_SAM_REGISTERS, 2);
-	fs_write_uint16(fd, sam_get_register());
+	fs_write_uint16(fd, sam_get_register(machine_get_sam(xroar_machine, 0)));
 	// Attached virtual disk filenames
 	{
 		for (unsigned drive = 0; drive < VDRIVE_MAX_DRIVES; drive++) {
@@ -214,7 +245,7 @@ static const int old_arch_mapping[4] = {
 };
 
 static void old_set_registers(uint8_t *regs) {
-	struct MC6809 *cpu = machine_get_cpu(0);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	cpu->reg_cc = regs[0];
 	MC6809_REG_A(cpu) = regs[1];
 	MC6809_REG_B(cpu) = regs[2];
@@ -234,7 +265,7 @@ static void old_set_registers(uint8_t *regs) {
 
 static uint16_t *tfm_reg_ptr(struct HD6309 *hcpu, unsigned reg) {
 	struct MC6809 *cpu = &hcpu->mc6809;
-	switch (reg >> 4) {
+	switch (reg) {
 	case 0:
 		return &cpu->reg_d;
 	case 1:
@@ -267,6 +298,10 @@ int read_snapshot(const char *filename) {
 		fclose(fd);
 		return -1;
 	}
+	if (0 == memcmp(buffer, FAST_MAGIC, 16)) {
+		fclose(fd);
+		return read_snapshot_fast(filename);
+	}
 	if (strncmp((char *)buffer, "XRoar snapshot.\012\000", 17)) {
 		// Very old-style snapshot.  Register dump always came first.
 		// Also, it used to be written out as only taking 12 bytes.
@@ -279,8 +314,8 @@ int read_snapshot(const char *filename) {
 	}
 	// Default to Dragon 64 for old snapshots
 	xroar_machine_config = machine_config_by_arch(ARCH_DRAGON64);
-	machine_configure(xroar_machine_config);
-	machine_reset(RESET_HARD);
+	machine_configure(xroar_machine, xroar_machine_config);
+	machine_reset(xroar_machine, RESET_HARD);
 	// If old snapshot, buffer contains register dump
 	if (buffer[0] != 'X') {
 		old_set_registers(buffer + 3);
@@ -295,8 +330,8 @@ int read_snapshot(const char *filename) {
 				tmp = fs_read_uint8(fd);
 				tmp %= 4;
 				xroar_machine_config->architecture = old_arch_mapping[tmp];
-				machine_configure(xroar_machine_config);
-				machine_reset(RESET_HARD);
+				machine_configure(xroar_machine, xroar_machine_config);
+				machine_reset(xroar_machine, RESET_HARD);
 				size--;
 				break;
 			case ID_KEYBOARD_MAP:
@@ -321,7 +356,7 @@ int read_snapshot(const char *filename) {
 						LOG_WARN("CPU mismatch - skipping MC6809 chunk\n");
 						break;
 					}
-					struct MC6809 *cpu = machine_get_cpu(0);
+					struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 					cpu->reg_cc = fs_read_uint8(fd);
 					MC6809_REG_A(cpu) = fs_read_uint8(fd);
 					MC6809_REG_B(cpu) = fs_read_uint8(fd);
@@ -370,7 +405,7 @@ int read_snapshot(const char *filename) {
 						LOG_WARN("CPU mismatch - skipping HD6309 chunk\n");
 						break;
 					}
-					struct MC6809 *cpu = machine_get_cpu(0);
+					struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 					struct HD6309 *hcpu = (struct HD6309 *)cpu;
 					cpu->reg_cc = fs_read_uint8(fd);
 					MC6809_REG_A(cpu) = fs_read_uint8(fd);
@@ -424,13 +459,13 @@ int read_snapshot(const char *filename) {
 					xroar_machine_config->cross_colour_phase = fs_read_uint8(fd);
 					size--;
 				}
-				machine_configure(xroar_machine_config);
-				machine_reset(RESET_HARD);
+				machine_configure(xroar_machine, xroar_machine_config);
+				machine_reset(xroar_machine, RESET_HARD);
 				break;
 
 			case ID_PIA_REGISTERS:
 				for (int i = 0; i < 2; i++) {
-					struct MC6821 *pia = machine_get_pia(i);
+					struct MC6821 *pia = machine_get_pia(xroar_machine, i);
 					if (size < 3) break;
 					pia->a.direction_register = fs_read_uint8(fd);
 					pia->a.output_register = fs_read_uint8(fd);
@@ -446,17 +481,19 @@ int read_snapshot(const char *filename) {
 				break;
 
 			case ID_RAM_PAGE0:
-				if (size <= (int)sizeof(machine_ram)) {
-					size -= fread(machine_ram, 1, size, fd);
+				memset(xroar_machine->ram_dirty, 1, sizeof(xroar_machine->ram_dirty));
+				if (size <= (int)sizeof(xroar_machine->ram)) {
+					size -= fread(xroar_machine->ram, 1, size, fd);
 				} else {
-					size -= fread(machine_ram, 1, sizeof(machine_ram), fd);
+					size -= fread(xroar_machine->ram, 1, sizeof(xroar_machine->ram), fd);
 				}
 				break;
 			case ID_RAM_PAGE1:
-				if (size <= (int)(sizeof(machine_ram) - 0x8000)) {
-					size -= fread(machine_ram + 0x8000, 1, size, fd);
+				memset(xroar_machine->ram_dirty, 1, sizeof(xroar_machine->ram_dirty));
+				if (size <= (int)(sizeof(xroar_machine->ram) - 0x8000)) {
+					size -= fread(xroar_machine->ram + 0x8000, 1, size, fd);
 				} else {
-					size -= fread(machine_ram + 0x8000, 1, sizeof(machine_ram) - 0x8000, fd);
+					size -= fread(xroar_machine->ram + 0x8000, 1, sizeof(xroar_machine->ram) - 0x8000, fd);
 				}
 				break;
 			case ID_SAM_REGISTERS:
@@ -464,7 +501,7 @@ int read_snapshot(const char *filename) {
 				if (size < 2) break;
 				tmp = fs_read_uint16(fd);
 				size -= 2;
-				sam_set_register(tmp);
+				sam_set_register(machine_get_sam(xroar_machine, 0), tmp);
 				break;
 
 			case ID_SNAPVERSION:
@@ -512,3 +549,220 @@ int read_snapshot(const char *filename) {
 	fclose(fd);
 	return 0;
 }
+
+/* Fast snapshots */
+
+static void put_uint16(uint8_t *p, unsigned v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static unsigned get_uint16(uint8_t const *p) {
+	return (p[0] << 8) | p[1];
+}
+
+int write_snapshot_fast(const char *filename) {
+	uint8_t header[FAST_OFF_RAM];
+	memset(header, 0, sizeof(header));
+	memcpy(header + FAST_OFF_MAGIC, FAST_MAGIC, 16);
+	put_uint16(header + FAST_OFF_VERSION, FAST_VERSION);
+
+	uint8_t *p = header + FAST_OFF_MACHINE;
+	p[0] = xroar_machine_config->index;
+	p[1] = xroar_machine_config->architecture;
+	p[2] = xroar_machine_config->cpu;
+	p[3] = xroar_machine_config->keymap;
+	p[4] = xroar_machine_config->tv_standard;
+	p[5] = xroar_machine_config->ram;
+	p[6] = xroar_cart ? xroar_cart->config->type : 0;
+	p[7] = xroar_machine_config->cross_colour_phase;
+
+	p = header + FAST_OFF_RAMSIZE;
+	put_uint16(p, xroar_machine->ram_size >> 16);
+	put_uint16(p + 2, xroar_machine->ram_size);
+
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
+	p = header + FAST_OFF_CPU;
+	p[0] = cpu->reg_cc;
+	p[1] = MC6809_REG_A(cpu);
+	p[2] = MC6809_REG_B(cpu);
+	p[3] = cpu->reg_dp;
+	put_uint16(p + 4, cpu->reg_x);
+	put_uint16(p + 6, cpu->reg_y);
+	put_uint16(p + 8, cpu->reg_u);
+	put_uint16(p + 10, cpu->reg_s);
+	put_uint16(p + 12, cpu->reg_pc);
+	p[14] = cpu->halt;
+	p[15] = cpu->nmi;
+	p[16] = cpu->firq;
+	p[17] = cpu->irq;
+	p[18] = cpu->state;
+	p[19] = cpu->nmi_armed;
+	if (xroar_machine_config->cpu == CPU_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		p[18] = hcpu->state;
+		p[20] = HD6309_REG_E(hcpu);
+		p[21] = HD6309_REG_F(hcpu);
+		put_uint16(p + 22, hcpu->reg_v);
+		p[24] = hcpu->reg_md;
+		p[25] = (tfm_reg(hcpu, hcpu->tfm_src) << 4) | tfm_reg(hcpu, hcpu->tfm_dest);
+		p[26] = ((hcpu->tfm_src_mod & 15) << 4) | (hcpu->tfm_dest_mod & 15);
+	}
+
+	p = header + FAST_OFF_PIA;
+	for (int i = 0; i < 2; i++) {
+		struct MC6821 *pia = machine_get_pia(xroar_machine, i);
+		*(p++) = pia->a.direction_register;
+		*(p++) = pia->a.output_register;
+		*(p++) = pia->a.control_register;
+		*(p++) = pia->b.direction_register;
+		*(p++) = pia->b.output_register;
+		*(p++) = pia->b.control_register;
+	}
+
+	put_uint16(header + FAST_OFF_SAM, sam_get_register(machine_get_sam(xroar_machine, 0)));
+
+	FILE *fd;
+	if (!(fd = fopen(filename, "wb")))
+		return -1;
+	int ret = 0;
+	if (fwrite(header, 1, sizeof(header), fd) != sizeof(header)
+	    || fwrite(xroar_machine->ram, 1, xroar_machine->ram_size, fd) != xroar_machine->ram_size) {
+		LOG_WARN("Failed to write snapshot '%s'\n", filename);
+		ret = -1;
+	}
+	fclose(fd);
+	return ret;
+}
+
+/* Only reconfigures the machine if it doesn't already match the snapshot, as
+ * that is by far the most expensive part of a restore. */
+
+static int restore_snapshot_fast(uint8_t const *data, size_t size) {
+	if (get_uint16(data + FAST_OFF_VERSION) != FAST_VERSION) {
+		LOG_WARN("Fast snapshot version %u not supported.\n", get_uint16(data + FAST_OFF_VERSION));
+		return -1;
+	}
+	uint8_t const *p = data + FAST_OFF_RAMSIZE;
+	unsigned ram_size = (get_uint16(p) << 16) | get_uint16(p + 2);
+	if (ram_size > sizeof(xroar_machine->ram) || size < FAST_OFF_RAM + ram_size) {
+		LOG_WARN("Fast snapshot truncated.\n");
+		return -1;
+	}
+
+	p = data + FAST_OFF_MACHINE;
+	// Prefer the config the snapshot was taken with, if it still exists
+	struct machine_config *mc = machine_config_index(p[0]);
+	if (!mc || mc->architecture != p[1])
+		mc = machine_config_by_arch(p[1]);
+	if (!mc)
+		return -1;
+	_Bool reconfigure = (mc != xroar_machine_config
+			     || mc->cpu != p[2]
+			     || mc->keymap != p[3]
+			     || mc->tv_standard != p[4]
+			     || mc->ram != p[5]
+			     || mc->cross_colour_phase != p[7]);
+	xroar_machine_config = mc;
+	mc->cpu = p[2];
+	mc->keymap = p[3];
+	mc->tv_standard = p[4];
+	mc->ram = p[5];
+	mc->cross_colour_phase = p[7];
+	if (p[6] != (xroar_cart ? xroar_cart->config->type : 0))
+		xroar_set_dos(p[6]);
+	if (reconfigure)
+		machine_configure(xroar_machine, mc);
+	machine_reset(xroar_machine, RESET_HARD);
+	if (xroar_machine->ram_size != ram_size) {
+		LOG_WARN("RAM size mismatch in fast snapshot.\n");
+		return -1;
+	}
+
+	memcpy(xroar_machine->ram, data + FAST_OFF_RAM, ram_size);
+	memset(xroar_machine->ram_dirty, 1, sizeof(xroar_machine->ram_dirty));
+
+	p = data + FAST_OFF_PIA;
+	for (int i = 0; i < 2; i++) {
+		struct MC6821 *pia = machine_get_pia(xroar_machine, i);
+		pia->a.direction_register = *(p++);
+		pia->a.output_register = *(p++);
+		pia->a.control_register = *(p++);
+		pia->b.direction_register = *(p++);
+		pia->b.output_register = *(p++);
+		pia->b.control_register = *(p++);
+		mc6821_update_state(pia);
+	}
+
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
+	p = data + FAST_OFF_CPU;
+	cpu->reg_cc = p[0];
+	MC6809_REG_A(cpu) = p[1];
+	MC6809_REG_B(cpu) = p[2];
+	cpu->reg_dp = p[3];
+	cpu->reg_x = get_uint16(p + 4);
+	cpu->reg_y = get_uint16(p + 6);
+	cpu->reg_u = get_uint16(p + 8);
+	cpu->reg_s = get_uint16(p + 10);
+	cpu->reg_pc = get_uint16(p + 12);
+	cpu->halt = p[14];
+	cpu->nmi = p[15];
+	cpu->firq = p[16];
+	cpu->irq = p[17];
+	cpu->state = p[18];
+	cpu->nmi_armed = p[19];
+	if (xroar_machine_config->cpu == CPU_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		hcpu->state = p[18];
+		HD6309_REG_E(hcpu) = p[20];
+		HD6309_REG_F(hcpu) = p[21];
+		hcpu->reg_v = get_uint16(p + 22);
+		hcpu->reg_md = p[24];
+		hcpu->tfm_src = tfm_reg_ptr(hcpu, p[25] >> 4);
+		hcpu->tfm_dest = tfm_reg_ptr(hcpu, p[25] & 15);
+		hcpu->tfm_src_mod = sex4(p[26] >> 4);
+		hcpu->tfm_dest_mod = sex4(p[26] & 15);
+	}
+
+	sam_set_register(machine_get_sam(xroar_machine, 0), get_uint16(data + FAST_OFF_SAM));
+	return 0;
+}
+
+#ifndef WINDOWS32
+
+static int read_snapshot_fast(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < FAST_OFF_RAM) {
+		close(fd);
+		return -1;
+	}
+	size_t size = st.st_size;
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+	int ret = restore_snapshot_fast(data, size);
+	munmap(data, size);
+	return ret;
+}
+
+#else
+
+static int read_snapshot_fast(const char *filename) {
+	FILE *fd;
+	if (!(fd = fopen(filename, "rb")))
+		return -1;
+	uint8_t *data = xmalloc(FAST_OFF_RAM + sizeof(xroar_machine->ram));
+	size_t size = fread(data, 1, FAST_OFF_RAM + sizeof(xroar_machine->ram), fd);
+	fclose(fd);
+	int ret = -1;
+	if (size >= FAST_OFF_RAM)
+		ret = restore_snapshot_fast(data, size);
+	free(data);
+	return ret;
+}
+
+#endif
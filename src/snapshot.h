@@ -6,7 +6,12 @@
 #ifndef XROAR_SNAPSHOT_H_
 #define XROAR_SNAPSHOT_H_
 
+/* read_snapshot() recognises either format.  The fast format is for restoring
+ * the same state many times over (e.g. in batch runs), and doesn't record
+ * attached disks. */
+
 int write_snapshot(const char *filename);
+int write_snapshot_fast(const char *filename);
 int read_snapshot(const char *filename);
 
 #endif  /* XROAR_SNAPSHOT_H_ */
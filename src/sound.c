@@ -18,7 +18,7 @@
 
 #include "config.h"
 
-#include <limits.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,12 +32,44 @@
 #include "tape.h"
 #include "xroar.h"
 
+/* Level changes are not written to the buffer as they happen.  Instead, each
+ * is logged along with the tick at which it occurred, and the log is rendered
+ * into the buffer when the flush event fires (or the log fills).
+ *
+ * Each change is rendered as a band-limited step (BLEP): the ideal step, plus
+ * a short residual taken from a table indexed by the sub-frame phase of the
+ * change.  This removes most of the aliasing a sample-and-hold step would
+ * introduce, at the cost of a fixed delay of BLEP_WIDTH/2 frames.  Between
+ * steps, the held level is written out as a simple fill. */
+
+#define BLEP_WIDTH (32)
+#define BLEP_MASK (BLEP_WIDTH - 1)
+#define BLEP_PHASES (64)
+// Cutoff as a fraction of sample rate
+#define BLEP_CUTOFF (0.41)
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+#define STEP_LOG_SIZE (1024)
+
+/* With adaptive rate control, the most the length of an output frame will be
+ * nudged by, and the weight given to each new fill level report. */
+#define MAX_RATE_ADJUST (0.005)
+#define FILL_SMOOTHING (0.05)
+
 union sample_t {
 	uint8_t as_int8[2];
 	uint16_t as_int16[2];
 	float as_float[2];
 };
 
+struct sound_step {
+	event_ticks tick;
+	float level[2];
+};
+
 /* Describes the buffer: */
 static enum sound_fmt buffer_fmt;
 static int buffer_nchannels;
@@ -46,12 +78,37 @@ static void *buffer = NULL;
 /* Current index into the buffer */
 static unsigned buffer_frame = 0;
 
+/* Output rate, and the exact time of the next frame to be rendered, as a
+ * tick plus a remainder in units of 1/sample_rate ticks.  The length of a
+ * frame in those units is OSCILLATOR_RATE, unless adjusted to track the
+ * output device's clock. */
+static unsigned sample_rate;
+static event_ticks cursor_tick;
+static unsigned cursor_rem;
+static unsigned frame_ticks;
+static unsigned frame_ticks_next;
+static float fill_error;
+
+/* Mixer output, and the last level logged */
 static float output_level[2];
-static union sample_t last_sample;
-static event_ticks last_cycle;
-static float ticks_per_frame;
-static unsigned ticks_per_buffer;
-static float error_f = 0.0;
+static float last_level[2];
+
+static struct sound_step step_log[STEP_LOG_SIZE];
+static unsigned step_log_length;
+
+/* Residual of a band-limited step over the ideal step for each phase */
+static float blep_resid[BLEP_PHASES][BLEP_WIDTH];
+
+/* Render state: the level of the last step rendered, the level currently
+ * held, pending residuals and held level changes, and the number of frames
+ * still affected by a step. */
+static float step_level[2];
+static float held_level[2];
+static float blep_ring[BLEP_WIDTH][2];
+static float held_next[BLEP_WIDTH][2];
+static _Bool held_set[BLEP_WIDTH];
+static unsigned ring_pos;
+static unsigned blep_pending;
 
 enum sound_source {
 	SOURCE_DAC,
@@ -97,6 +154,8 @@ static const float source_offset_v[NUM_SOURCES][3] = {
 // Computed by set_volume().  Defaults to scale at full volume.
 static unsigned scale = 6971;
 
+static void init_blep(void);
+static void schedule_flush(void);
 static void flush_frame(void *);
 static struct event flush_event;
 
@@ -176,19 +235,31 @@ void sound_init(void *buf, enum sound_fmt fmt, unsigned rate, unsigned nchannels
 		}
 		LOG_DEBUG(1, "%uHz\n", rate);
 	}
-	output_level[0] = output_level[1] = 0.0;
+	for (int i = 0; i < 2; i++) {
+		output_level[i] = last_level[i] = 0.0;
+		step_level[i] = held_level[i] = 0.0;
+	}
+	memset(blep_ring, 0, sizeof(blep_ring));
+	memset(held_set, 0, sizeof(held_set));
+	ring_pos = 0;
+	blep_pending = 0;
+	step_log_length = 0;
+	if (fmt != SOUND_FMT_NULL)
+		init_blep();
 
 	buffer = buf;
+	buffer_frame = 0;
 	buffer_nframes = nframes;
 	buffer_fmt = fmt;
 	buffer_nchannels = nchannels;
-	ticks_per_frame = (float)OSCILLATOR_RATE / (float)rate;
-	ticks_per_buffer = ticks_per_frame * nframes;
-	last_cycle = event_current_tick;
+	sample_rate = rate;
+	cursor_tick = event_current_tick;
+	cursor_rem = 0;
+	frame_ticks = frame_ticks_next = OSCILLATOR_RATE;
+	fill_error = 0.0;
 
 	event_init(&flush_event, DELEGATE_AS0(void, flush_frame, NULL));
-	flush_event.at_tick = event_current_tick + ticks_per_buffer;
-	event_queue(&MACHINE_EVENT_LIST, &flush_event);
+	schedule_flush();
 }
 
 void sound_set_volume(int v) {
@@ -197,76 +268,159 @@ void sound_set_volume(int v) {
 	scale = (unsigned)((327.67 * (float)v) / full_scale_v);
 }
 
-static void fill_int8(int nframes) {
-	while (nframes > 0) {
-		int count;
-		if ((buffer_frame + nframes) > buffer_nframes)
-			count = buffer_nframes - buffer_frame;
-		else
-			count = nframes;
-		nframes -= count;
-		if (buffer) {
-			uint8_t *ptr = (uint8_t *)buffer + buffer_frame * buffer_nchannels;
-			if (buffer_nchannels == 1) {
-				/* special case for single channel 8-bit */
-				memset(ptr, last_sample.as_int8[0], count);
-			} else {
-				for (int i = 0; i < count; i++) {
-					for (int j = 0; j < buffer_nchannels; j++) {
-						*(ptr++) = last_sample.as_int8[j];
-					}
-				}
+/* Build the residual table.  The band-limited step is the running sum of a
+ * Blackman-windowed sinc, normalised so each phase sums to exactly one step;
+ * the ideal step it is measured against always lands at frame BLEP_WIDTH/2. */
+
+static void init_blep(void) {
+	for (int p = 0; p < BLEP_PHASES; p++) {
+		double h[BLEP_WIDTH];
+		double sum = 0.0;
+		double centre = (BLEP_WIDTH - 1) / 2.0 + (double)p / BLEP_PHASES;
+		for (int j = 0; j < BLEP_WIDTH; j++) {
+			double x = j - centre;
+			double w = 0.0;
+			if (fabs(x) < BLEP_WIDTH / 2.0) {
+				double a = 2.0 * M_PI * x / BLEP_WIDTH;
+				w = 0.42 + 0.5 * cos(a) + 0.08 * cos(2.0 * a);
 			}
+			double s = 2.0 * BLEP_CUTOFF;
+			if (x != 0.0)
+				s = sin(2.0 * M_PI * BLEP_CUTOFF * x) / (M_PI * x);
+			h[j] = w * s;
+			sum += h[j];
 		}
-		buffer_frame += count;
-		if (buffer_frame >= buffer_nframes) {
-			buffer = sound_module->write_buffer(buffer);
-			buffer_frame = 0;
+		double step = 0.0;
+		for (int j = 0; j < BLEP_WIDTH; j++) {
+			step += h[j] / sum;
+			blep_resid[p][j] = step - ((j >= BLEP_WIDTH / 2) ? 1.0 : 0.0);
 		}
 	}
 }
 
-static void fill_int16(int nframes) {
-	while (nframes > 0) {
-		int count;
-		if ((buffer_frame + nframes) > buffer_nframes)
-			count = buffer_nframes - buffer_frame;
-		else
-			count = nframes;
-		nframes -= count;
-		if (buffer) {
-			uint16_t *ptr = (uint16_t *)buffer + buffer_frame * buffer_nchannels;
-			for (int i = 0; i < count; i++) {
-				for (int j = 0; j < buffer_nchannels; j++) {
-					*(ptr++) = last_sample.as_int16[j];
+/* Convert a level to an output sample */
+
+static void set_sample(union sample_t *sample, float const *level) {
+	for (int i = 0; i < buffer_nchannels; i++) {
+		int output = level[i] * scale;
+		// Band-limited steps may overshoot
+		if (output > 32767)
+			output = 32767;
+		else if (output < -32768)
+			output = -32768;
+		switch (buffer_fmt) {
+		case SOUND_FMT_U8:
+			sample->as_int8[i] = (output >> 8) + 0x80;
+			break;
+		case SOUND_FMT_S8:
+			sample->as_int8[i] = output >> 8;
+			break;
+		case SOUND_FMT_S16_HE:
+			sample->as_int16[i] = output;
+			break;
+		case SOUND_FMT_S16_SE:
+			sample->as_int16[i] = (output & 0xff) << 8 | ((output >> 8) & 0xff);
+			break;
+		case SOUND_FMT_FLOAT:
+			sample->as_float[i] = (float)output / 32767.;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Write a number of identical frames at the current buffer position.  Never
+ * called with more frames than remain in the buffer. */
+
+static void fill_frames(union sample_t const *sample, unsigned count) {
+	if (buffer) {
+		switch (buffer_fmt) {
+		case SOUND_FMT_U8:
+		case SOUND_FMT_S8:
+			{
+				uint8_t *ptr = (uint8_t *)buffer + buffer_frame * buffer_nchannels;
+				if (buffer_nchannels == 1) {
+					/* special case for single channel 8-bit */
+					memset(ptr, sample->as_int8[0], count);
+				} else {
+					for (unsigned i = 0; i < count; i++) {
+						for (int j = 0; j < buffer_nchannels; j++) {
+							*(ptr++) = sample->as_int8[j];
+						}
+					}
 				}
 			}
-		}
-		buffer_frame += count;
-		if (buffer_frame >= buffer_nframes) {
-			buffer = sound_module->write_buffer(buffer);
-			buffer_frame = 0;
+			break;
+		case SOUND_FMT_S16_HE:
+		case SOUND_FMT_S16_SE:
+			{
+				uint16_t *ptr = (uint16_t *)buffer + buffer_frame * buffer_nchannels;
+				for (unsigned i = 0; i < count; i++) {
+					for (int j = 0; j < buffer_nchannels; j++) {
+						*(ptr++) = sample->as_int16[j];
+					}
+				}
+			}
+			break;
+		case SOUND_FMT_FLOAT:
+			{
+				float *ptr = (float *)buffer + buffer_frame * buffer_nchannels;
+				for (unsigned i = 0; i < count; i++) {
+					for (int j = 0; j < buffer_nchannels; j++) {
+						*(ptr++) = sample->as_float[j];
+					}
+				}
+			}
+			break;
+		default:
+			break;
 		}
 	}
+	buffer_frame += count;
 }
 
-static void fill_float(int nframes) {
+/* Render frames from the cursor, passing the buffer to the sound module each
+ * time it fills. */
+
+static void render_frames(unsigned nframes) {
+	uint64_t t = (uint64_t)nframes * frame_ticks + cursor_rem;
+	cursor_tick += t / sample_rate;
+	cursor_rem = t % sample_rate;
+
 	while (nframes > 0) {
-		int count;
-		if ((buffer_frame + nframes) > buffer_nframes)
-			count = buffer_nframes - buffer_frame;
-		else
+		unsigned count = buffer_nframes - buffer_frame;
+		if (count > nframes)
 			count = nframes;
 		nframes -= count;
-		if (buffer) {
-			float *ptr = (float *)buffer + buffer_frame * buffer_nchannels;
-			for (int i = 0; i < count; i++) {
-				for (int j = 0; j < buffer_nchannels; j++) {
-					*(ptr++) = last_sample.as_float[j];
+		if (buffer_fmt == SOUND_FMT_NULL) {
+			buffer_frame += count;
+		} else {
+			union sample_t sample;
+			// Frames still affected by a step
+			for ( ; count > 0 && blep_pending > 0; count--) {
+				float level[2];
+				if (held_set[ring_pos]) {
+					held_level[0] = held_next[ring_pos][0];
+					held_level[1] = held_next[ring_pos][1];
+					held_set[ring_pos] = 0;
+				}
+				for (int i = 0; i < buffer_nchannels; i++) {
+					level[i] = held_level[i] + blep_ring[ring_pos][i];
+					blep_ring[ring_pos][i] = 0.0;
 				}
+				set_sample(&sample, level);
+				fill_frames(&sample, 1);
+				ring_pos = (ring_pos + 1) & BLEP_MASK;
+				blep_pending--;
+			}
+			// The rest hold a constant level
+			if (count > 0) {
+				set_sample(&sample, held_level);
+				fill_frames(&sample, count);
+				ring_pos = (ring_pos + count) & BLEP_MASK;
 			}
 		}
-		buffer_frame += count;
 		if (buffer_frame >= buffer_nframes) {
 			buffer = sound_module->write_buffer(buffer);
 			buffer_frame = 0;
@@ -274,72 +428,50 @@ static void fill_float(int nframes) {
 	}
 }
 
-static void null_frames(int nframes) {
-	buffer_frame += nframes;
-	while (buffer_frame >= buffer_nframes) {
-		buffer = sound_module->write_buffer(buffer);
-		buffer_frame -= buffer_nframes;
-	}
+/* Frame (relative to the cursor) and phase within that frame of a tick */
+
+static unsigned tick_to_frame(event_ticks tick, unsigned *phase) {
+	int64_t t = (int64_t)(int)(tick - cursor_tick) * sample_rate - cursor_rem;
+	if (t < 0)
+		t = 0;
+	*phase = (t % frame_ticks) * BLEP_PHASES / frame_ticks;
+	return t / frame_ticks;
 }
 
-/* Fill sound buffer to current point in time, call sound module's
- * update() function if buffer is full. */
-static void sound_update(void) {
-	unsigned elapsed = (event_current_tick - last_cycle);
-	unsigned nframes = 0;
-	if (elapsed <= (UINT_MAX/2)) {
-		float nframes_f = elapsed / ticks_per_frame;
-		nframes = nframes_f;
-		error_f += (nframes_f - nframes);
-		unsigned error = error_f;
-		nframes += error;
-		error_f -= error;
-	}
+/* Add a band-limited step to a new level, starting at the cursor */
 
-	/* Update output samples */
+static void add_step(float const *level, unsigned phase) {
+	float const *resid = blep_resid[phase];
 	for (int i = 0; i < buffer_nchannels; i++) {
-		unsigned output = output_level[i] * scale;
-		switch (buffer_fmt) {
-		case SOUND_FMT_U8:
-			last_sample.as_int8[i] = (output >> 8) + 0x80;
-			break;
-		case SOUND_FMT_S8:
-			last_sample.as_int8[i] = output >> 8;
-			break;
-		case SOUND_FMT_S16_HE:
-			last_sample.as_int16[i] = output;
-			break;
-		case SOUND_FMT_S16_SE:
-			last_sample.as_int16[i] = (output & 0xff) << 8 | ((output >> 8) & 0xff);
-			break;
-		case SOUND_FMT_FLOAT:
-			last_sample.as_float[i] = (float)output / 32767.;
-			break;
-		default:
-			break;
+		float delta = level[i] - step_level[i];
+		step_level[i] = level[i];
+		for (int j = 0; j < BLEP_WIDTH; j++) {
+			blep_ring[(ring_pos + j) & BLEP_MASK][i] += delta * resid[j];
 		}
 	}
+	unsigned held_pos = (ring_pos + BLEP_WIDTH / 2) & BLEP_MASK;
+	held_next[held_pos][0] = level[0];
+	held_next[held_pos][1] = level[1];
+	held_set[held_pos] = 1;
+	blep_pending = BLEP_WIDTH;
+}
 
-	/* Fill buffer */
-	switch (buffer_fmt) {
-	case SOUND_FMT_U8:
-	case SOUND_FMT_S8:
-		fill_int8(nframes);
-		break;
-	case SOUND_FMT_S16_HE:
-	case SOUND_FMT_S16_SE:
-		fill_int16(nframes);
-		break;
-	case SOUND_FMT_FLOAT:
-		fill_float(nframes);
-		break;
-	default:
-		null_frames(nframes);
-		break;
+/* Render all logged steps, then the held level up to the current time */
+
+static void render_steps(void) {
+	unsigned phase;
+	for (unsigned i = 0; i < step_log_length; i++) {
+		struct sound_step *step = &step_log[i];
+		render_frames(tick_to_frame(step->tick, &phase));
+		add_step(step->level, phase);
 	}
+	step_log_length = 0;
+	render_frames(tick_to_frame(event_current_tick, &phase));
+}
 
-	last_cycle = event_current_tick;
+/* Mix sources to find the output level, logging a step if it has changed */
 
+static void sound_update(void) {
 	/* Mix internal sound sources to bus */
 	float bus_level = 0.0;
 	unsigned sindex = sbs_enabled ? (sbs_level ? 2 : 1) : 0;
@@ -383,6 +515,34 @@ static void sound_update(void) {
 	if (buffer_nchannels == 1)
 		output_level[0] = (output_level[0] + output_level[1]) / 2.0;
 
+	if (buffer_fmt == SOUND_FMT_NULL)
+		return;
+	if (output_level[0] == last_level[0] && output_level[1] == last_level[1])
+		return;
+	if (step_log_length >= STEP_LOG_SIZE)
+		render_steps();
+	struct sound_step *step = &step_log[step_log_length++];
+	step->tick = event_current_tick;
+	step->level[0] = last_level[0] = output_level[0];
+	step->level[1] = last_level[1] = output_level[1];
+}
+
+/* Proportional control on a smoothed fill level: a fuller ring makes frames
+ * longer, so fewer are produced per emulated second.  Frames are rendered
+ * from exact tick timings, so this resamples without further filtering.  A
+ * new length takes effect from the next flush. */
+
+void sound_report_fill(unsigned fill, unsigned target) {
+	if (target == 0)
+		return;
+	float error = ((float)fill - (float)target) / (float)target;
+	fill_error += (error - fill_error) * FILL_SMOOTHING;
+	float adjust = fill_error * MAX_RATE_ADJUST;
+	if (adjust > MAX_RATE_ADJUST)
+		adjust = MAX_RATE_ADJUST;
+	else if (adjust < -MAX_RATE_ADJUST)
+		adjust = -MAX_RATE_ADJUST;
+	frame_ticks_next = OSCILLATOR_RATE * (1.0 + adjust);
 }
 
 void sound_enable_external(void) {
@@ -458,6 +618,25 @@ void sound_set_external_right(float level) {
 static void flush_frame(void *data) {
 	(void)data;
 	sound_update();
-	flush_event.at_tick += ticks_per_buffer;
+	frame_ticks = frame_ticks_next;
+	render_steps();
+	schedule_flush();
+}
+
+/* Render up to the current time as a flush would, but leave a partly filled
+ * buffer with the module instead of waiting for it to fill.  Levels are
+ * logged as they change, so the mixer needn't be consulted again. */
+
+unsigned sound_render_pending(void) {
+	render_steps();
+	schedule_flush();
+	return buffer_frame;
+}
+
+/* The next flush is due at the first tick by which the buffer will be full */
+
+static void schedule_flush(void) {
+	uint64_t t = (uint64_t)(buffer_nframes - buffer_frame) * frame_ticks + cursor_rem;
+	flush_event.at_tick = cursor_tick + (t + sample_rate - 1) / sample_rate;
 	event_queue(&MACHINE_EVENT_LIST, &flush_event);
 }
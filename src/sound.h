@@ -24,6 +24,15 @@ extern DELEGATE_T1(void, bool) sound_sbs_feedback;
 void sound_init(void *buf, enum sound_fmt fmt, unsigned rate, unsigned nchannels, unsigned nframes);
 void sound_set_volume(int v);
 
+/* For adaptive rate control (-ao-adaptive): report how full the output ring
+ * is after a write, and the fill level to aim for, both in frames. */
+void sound_report_fill(unsigned fill, unsigned target);
+
+/* Render output up to the current time, returning how many frames of the
+ * module's current buffer are filled.  For modules that need the partial
+ * buffer at shutdown. */
+unsigned sound_render_pending(void);
+
 void sound_enable_external(void);
 void sound_disable_external(void);
 
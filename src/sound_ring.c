@@ -0,0 +1,312 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Head and tail are free-running frame counts, each only ever written by one
+ * side (head by the producer, tail by the consumer), so their difference is
+ * always the fill level.  Storage is rounded up to a power of two so that the
+ * counts can simply be masked to find a position.
+ *
+ * The output thread waits for a whole period to be queued before passing it
+ * on.  While it waits the device plays out what it already has, and if
+ * emulation falls far enough behind for that to run dry, the module's xrun
+ * handling recovers.  Padding a short period with silence instead would
+ * insert a gap every time emulation was merely a little late. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WINDOWS32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <time.h>
+#endif
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "logging.h"
+#include "pacer.h"
+#include "sound.h"
+#include "sound_ring.h"
+#include "xroar.h"
+
+#ifdef __GNUC__
+#define LOAD(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define STORE(v,n) __atomic_store_n(&(v), (n), __ATOMIC_RELEASE)
+#else
+#define LOAD(v) (*(volatile unsigned *)&(v))
+#define STORE(v,n) (*(volatile unsigned *)&(v) = (n))
+#endif
+
+struct sound_ring {
+	uint8_t *data;
+	unsigned size;  // power of 2
+	unsigned limit;
+	unsigned target;  // fill level aimed for with -ao-adaptive
+	unsigned frame_nbytes;
+	unsigned rate;
+	uint8_t silence;
+
+	unsigned head;  // only written by producer
+	unsigned tail;  // only written by consumer
+
+	// Stats, each only written by one side
+	unsigned fill_min;
+	unsigned fill_max;
+	unsigned underruns;
+	unsigned overruns;
+
+#ifdef HAVE_PTHREADS
+	_Bool threaded;
+	unsigned quit;
+	pthread_t thread;
+	unsigned period_nframes;
+	void *period;
+	void (*write)(void const *);
+#endif
+};
+
+#ifdef HAVE_PTHREADS
+static void *output_thread_run(void *data);
+#endif
+
+struct sound_ring *sound_ring_new(unsigned limit, unsigned frame_nbytes, unsigned rate, uint8_t silence) {
+	struct sound_ring *ring = xzalloc(sizeof(*ring));
+	if (limit < 1)
+		limit = 1;
+	ring->target = limit;
+	if (xroar_cfg.ao_adaptive)
+		limit *= 2;
+	ring->size = 1;
+	while (ring->size < limit)
+		ring->size <<= 1;
+	ring->limit = limit;
+	ring->frame_nbytes = frame_nbytes;
+	ring->rate = rate;
+	ring->silence = silence;
+	ring->data = xzalloc(ring->size * frame_nbytes);
+	ring->fill_min = limit;
+	return ring;
+}
+
+void sound_ring_free(struct sound_ring *ring) {
+	if (!ring)
+		return;
+	sound_ring_stop_thread(ring);
+	free(ring->data);
+	free(ring);
+}
+
+/* Sleep for a fraction of the time the device takes to play 'nframes', so
+ * that neither side overshoots by much.  Returns the time asked for, which
+ * is only approximately the time slept, but enough to bound a wait. */
+
+static unsigned sleep_frames(struct sound_ring *ring, unsigned nframes) {
+	unsigned us = ((uint64_t)nframes * 1000000) / ring->rate / 4;
+	if (us < 250)
+		us = 250;
+	if (us > 5000)
+		us = 5000;
+#ifdef WINDOWS32
+	Sleep((us + 999) / 1000);
+#else
+	struct timespec ts, rem;
+	ts.tv_sec = 0;
+	ts.tv_nsec = us * 1000;
+	while (nanosleep(&ts, &rem) != 0 && errno == EINTR)
+		ts = rem;
+#endif
+	return us;
+}
+
+unsigned sound_ring_fill(struct sound_ring *ring) {
+	return LOAD(ring->head) - LOAD(ring->tail);
+}
+
+_Bool sound_ring_write(struct sound_ring *ring, void const *src, unsigned nframes, _Bool wait, unsigned timeout_ms) {
+	unsigned head = ring->head;
+	unsigned timeout_us = timeout_ms * 1000;
+	unsigned waited_us = 0;
+	for (;;) {
+		unsigned fill = head - LOAD(ring->tail);
+		if (fill + nframes <= ring->limit)
+			break;
+		if (!wait || waited_us >= timeout_us) {
+			if (wait)
+				STORE(ring->overruns, ring->overruns + 1);
+			return 0;
+		}
+		waited_us += sleep_frames(ring, fill + nframes - ring->limit);
+	}
+
+	unsigned pos = head & (ring->size - 1);
+	unsigned count = ring->size - pos;
+	if (count > nframes)
+		count = nframes;
+	memcpy(ring->data + pos * ring->frame_nbytes, src, count * ring->frame_nbytes);
+	if (count < nframes) {
+		memcpy(ring->data, (uint8_t const *)src + count * ring->frame_nbytes, (nframes - count) * ring->frame_nbytes);
+	}
+	head += nframes;
+	STORE(ring->head, head);
+
+	unsigned fill = head - LOAD(ring->tail);
+	if (fill > ring->fill_max)
+		STORE(ring->fill_max, fill);
+	return 1;
+}
+
+void sound_ring_queue(struct sound_ring *ring, void const *src, unsigned nframes, unsigned timeout_ms) {
+	if (!xroar_cfg.ao_adaptive) {
+		sound_ring_write(ring, src, nframes, !xroar_noratelimit, timeout_ms);
+		return;
+	}
+	if (xroar_noratelimit) {
+		sound_ring_write(ring, src, nframes, 0, 0);
+		pacer_wait();
+		return;
+	}
+	sound_ring_write(ring, src, nframes, 1, 0);
+	unsigned fill = sound_ring_fill(ring);
+	sound_report_fill(fill, ring->target);
+	// Running well behind the device: let emulation catch up
+	if (fill < ring->target / 2)
+		pacer_reset();
+	else
+		pacer_wait();
+}
+
+_Bool sound_ring_wait_fill(struct sound_ring *ring, unsigned nframes, unsigned timeout_ms) {
+	if (nframes > ring->limit)
+		nframes = ring->limit;
+	unsigned timeout_us = timeout_ms * 1000;
+	unsigned waited_us = 0;
+	for (;;) {
+		unsigned fill = LOAD(ring->head) - ring->tail;
+		if (fill >= nframes)
+			return 1;
+		if (waited_us >= timeout_us)
+			return 0;
+		waited_us += sleep_frames(ring, nframes - fill);
+	}
+}
+
+unsigned sound_ring_read(struct sound_ring *ring, void *dest, unsigned nframes) {
+	unsigned tail = ring->tail;
+	unsigned fill = LOAD(ring->head) - tail;
+	if (fill < ring->fill_min)
+		STORE(ring->fill_min, fill);
+	unsigned nread = nframes;
+	if (fill < nframes) {
+		STORE(ring->underruns, ring->underruns + 1);
+		nread = fill;
+		memset((uint8_t *)dest + fill * ring->frame_nbytes, ring->silence, (nframes - fill) * ring->frame_nbytes);
+	}
+	nframes = nread;
+
+	unsigned pos = tail & (ring->size - 1);
+	unsigned count = ring->size - pos;
+	if (count > nframes)
+		count = nframes;
+	memcpy(dest, ring->data + pos * ring->frame_nbytes, count * ring->frame_nbytes);
+	if (count < nframes) {
+		memcpy((uint8_t *)dest + count * ring->frame_nbytes, ring->data, (nframes - count) * ring->frame_nbytes);
+	}
+	STORE(ring->tail, tail + nframes);
+	return nframes;
+}
+
+#ifdef HAVE_PTHREADS
+
+static void *output_thread_run(void *data) {
+	struct sound_ring *ring = data;
+	// Only bounds each wait, so that a request to quit is noticed
+	unsigned timeout_ms = (ring->period_nframes * 1000) / ring->rate + 1;
+	while (!LOAD(ring->quit)) {
+		if (!sound_ring_wait_fill(ring, ring->period_nframes, timeout_ms))
+			continue;
+		if (LOAD(ring->quit))
+			break;
+		sound_ring_read(ring, ring->period, ring->period_nframes);
+		ring->write(ring->period);
+	}
+	return NULL;
+}
+
+#endif
+
+_Bool sound_ring_start_thread(struct sound_ring *ring, unsigned nframes, void (*write)(void const *)) {
+#ifdef HAVE_PTHREADS
+	if (ring->threaded)
+		return 1;
+	ring->period_nframes = (nframes < ring->limit) ? nframes : ring->limit;
+	ring->period = xmalloc(ring->period_nframes * ring->frame_nbytes);
+	ring->write = write;
+	ring->quit = 0;
+	if (pthread_create(&ring->thread, NULL, output_thread_run, ring) != 0) {
+		LOG_WARN("Audio: failed to start output thread\n");
+		free(ring->period);
+		ring->period = NULL;
+		return 0;
+	}
+	ring->threaded = 1;
+	return 1;
+#else
+	(void)ring;
+	(void)nframes;
+	(void)write;
+	return 0;
+#endif
+}
+
+void sound_ring_stop_thread(struct sound_ring *ring) {
+#ifdef HAVE_PTHREADS
+	if (!ring->threaded)
+		return;
+	STORE(ring->quit, 1);
+	pthread_join(ring->thread, NULL);
+	free(ring->period);
+	ring->period = NULL;
+	ring->threaded = 0;
+#else
+	(void)ring;
+#endif
+}
+
+void sound_ring_get_stats(struct sound_ring *ring, struct sound_ring_stats *stats) {
+	stats->fill = sound_ring_fill(ring);
+	stats->fill_min = LOAD(ring->fill_min);
+	stats->fill_max = LOAD(ring->fill_max);
+	stats->underruns = LOAD(ring->underruns);
+	stats->overruns = LOAD(ring->overruns);
+}
+
+void sound_ring_log_stats(struct sound_ring *ring, const char *name) {
+	struct sound_ring_stats stats;
+	sound_ring_get_stats(ring, &stats);
+	LOG_DEBUG(1, "%s: ring of %u frames (%.1fms): fill %u-%u, %u underruns, %u overruns\n", name, ring->limit, (float)(ring->limit * 1000) / ring->rate, stats.fill_min, stats.fill_max, stats.underruns, stats.overruns);
+}
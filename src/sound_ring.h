@@ -0,0 +1,76 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_SOUND_RING_H_
+#define XROAR_SOUND_RING_H_
+
+/* Lock-free audio ring for sound modules that hand audio to another thread
+ * (a callback, or an output thread doing blocking device writes).
+ *
+ * There must be exactly one producer (the emulation thread, from
+ * write_buffer()) and one consumer.  Neither side ever takes a lock, so the
+ * consumer can't be held up by the producer being descheduled, and vice
+ * versa.  Where a side has to wait, it sleeps briefly and polls.
+ *
+ * The ring holds at most 'limit' frames, which sets the latency it adds.
+ * With -ao-adaptive, it holds up to twice that, and emulation is paced by the
+ * system clock instead of by waiting for room in the ring.  The length of an
+ * output frame is then adjusted to keep the fill level near 'limit'.
+ *
+ * For modules whose device writes block, the ring can also run the consumer
+ * as an output thread that passes fixed-size periods to the device. */
+
+#include <stdint.h>
+
+struct sound_ring;
+
+struct sound_ring_stats {
+	unsigned fill;       // frames currently queued
+	unsigned fill_min;   // lowest fill seen by the consumer before a read
+	unsigned fill_max;   // highest fill seen by the producer after a write
+	unsigned underruns;  // reads the ring couldn't satisfy in full
+	unsigned overruns;   // writes dropped because the ring stayed full
+};
+
+/* 'silence' is the byte value used to pad short reads */
+struct sound_ring *sound_ring_new(unsigned limit, unsigned frame_nbytes, unsigned rate, uint8_t silence);
+void sound_ring_free(struct sound_ring *ring);
+
+/* Frames currently queued.  Safe to call from either side. */
+unsigned sound_ring_fill(struct sound_ring *ring);
+
+/* Producer: queue 'nframes' frames (no more than the limit).  If there is
+ * not enough room and 'wait' is set, waits up to timeout_ms for the consumer
+ * to make some.  If there is still no room, the frames are dropped and false
+ * returned; this only counts as an overrun if 'wait' was set. */
+_Bool sound_ring_write(struct sound_ring *ring, void const *src, unsigned nframes, _Bool wait, unsigned timeout_ms);
+
+/* Producer: queue a fragment from a module's write_buffer(), waiting or
+ * pacing as configured. */
+void sound_ring_queue(struct sound_ring *ring, void const *src, unsigned nframes, unsigned timeout_ms);
+
+/* Consumer: wait up to timeout_ms until at least 'nframes' are queued.
+ * Returns false on timeout. */
+_Bool sound_ring_wait_fill(struct sound_ring *ring, unsigned nframes, unsigned timeout_ms);
+
+/* Consumer: dequeue 'nframes' frames, returning the number that were
+ * available.  A short read counts as an underrun, and the rest of 'dest' is
+ * filled with silence. */
+unsigned sound_ring_read(struct sound_ring *ring, void *dest, unsigned nframes);
+
+/* Start an output thread that repeatedly reads 'nframes' and passes them to
+ * write(), which may block.  Returns false if no thread could be started, in
+ * which case the module should write to the device itself. */
+_Bool sound_ring_start_thread(struct sound_ring *ring, unsigned nframes, void (*write)(void const *));
+
+/* Stop the output thread, if running */
+void sound_ring_stop_thread(struct sound_ring *ring);
+
+void sound_ring_get_stats(struct sound_ring *ring, struct sound_ring_stats *stats);
+
+/* Log stats at debug level, prefixed by the module's name */
+void sound_ring_log_stats(struct sound_ring *ring, const char *name);
+
+#endif  /* XROAR_SOUND_RING_H_ */
@@ -499,14 +499,14 @@ static uint8_t op_sub(struct MC6809 *cpu, uint8_t v1, uint8_t v2) {
 }
 
 #define BSR(f) do { pskip += 7; f(cpu); } while (0)
-#define CLR(a) do { pskip += 6; machine_write_byte((a), 0); } while (0)
-#define DEC(a) do { pskip += 6; machine_write_byte((a), machine_read_byte(a) - 1); } while (0)
-#define INC(a) do { pskip += 6; machine_write_byte((a), machine_read_byte(a) + 1); } while (0)
+#define CLR(a) do { pskip += 6; machine_write_byte(xroar_machine, (a), 0); } while (0)
+#define DEC(a) do { pskip += 6; machine_write_byte(xroar_machine, (a), machine_read_byte(xroar_machine, a) - 1); } while (0)
+#define INC(a) do { pskip += 6; machine_write_byte(xroar_machine, (a), machine_read_byte(xroar_machine, a) + 1); } while (0)
 
 static void motor_on(struct MC6809 *cpu) {
 	int delay = IS_DRAGON ? 0x95 : 0x8a;
 	pskip += 5;  /* LDX <$95 */
-	int i = (machine_read_byte(delay) << 8) | machine_read_byte(delay+1);
+	int i = (machine_read_byte(xroar_machine, delay) << 8) | machine_read_byte(xroar_machine, delay+1);
 	if (IS_DRAGON)
 		pskip += 5;  /* LBRA delay_X */
 	for (; i; i--) {
@@ -578,7 +578,7 @@ static void L_BDC3(struct MC6809 *cpu) {
 	int maxpw1200 = IS_DRAGON ? 0x94 : 0x90;
 	pskip += 4;  /* LDB <$82 */
 	pskip += 4;  /* CMPB <$94 */
-	op_sub(cpu, machine_read_byte(pwcount), machine_read_byte(maxpw1200));
+	op_sub(cpu, machine_read_byte(xroar_machine, pwcount), machine_read_byte(xroar_machine, maxpw1200));
 	pskip += 3;  /* BHI L_BDCC */
 	if (!(cpu->reg_cc & 0x05)) {
 		CLR(bcount);
@@ -587,7 +587,7 @@ static void L_BDC3(struct MC6809 *cpu) {
 		return;
 	}
 	pskip += 4;  /* CMPB <$93 */
-	op_sub(cpu, machine_read_byte(pwcount), machine_read_byte(minpw1200));
+	op_sub(cpu, machine_read_byte(xroar_machine, pwcount), machine_read_byte(xroar_machine, minpw1200));
 	pskip += 5;  /* RTS */
 }
 
@@ -629,7 +629,7 @@ L_BDF3:
 	INC(bcount);
 	pskip += 4;  /* LDA <$83 */
 	pskip += 2;  /* CMPA #$60 */
-	store = machine_read_byte(bcount);
+	store = machine_read_byte(xroar_machine, bcount);
 	op_sub(cpu, store, 0x60);
 	pskip += 3;  /* BRA L_BE0D */
 	goto L_BE0D;
@@ -648,13 +648,13 @@ L_BE03:
 	DEC(bcount);
 	pskip += 4;  /* LDA <$83 */
 	pskip += 2;  /* ADDA #$60 */
-	store = op_add(cpu, machine_read_byte(bcount), 0x60);
+	store = op_add(cpu, machine_read_byte(xroar_machine, bcount), 0x60);
 L_BE0D:
 	pskip += 3;  /* BNE L_BDED */
 	if (!(cpu->reg_cc & 0x04))
 		goto L_BDED;
 	pskip += 4;  /* STA <$84 */
-	machine_write_byte(0x84, store);
+	machine_write_byte(xroar_machine, 0x84, store);
 	pskip += 5;  /* RTS */
 }
 
@@ -663,7 +663,7 @@ static void tape_wait_2p(struct MC6809 *cpu) {
 	CLR(pwcount);
 	pskip += 6;  /* TST <$84 */
 	pskip += 3;  /* BNE tape_wait_p1_p0 */
-	if (machine_read_byte(0x84)) {
+	if (machine_read_byte(xroar_machine, 0x84)) {
 		tape_wait_p1_p0(cpu);
 	} else {
 		tape_wait_p0_p1(cpu);
@@ -677,7 +677,7 @@ static void bitin(struct MC6809 *cpu) {
 	pskip += 4;  /* LDB <$82 */
 	pskip += 2;  /* DECB */
 	pskip += 4;  /* CMPB <$92 */
-	op_sub(cpu, machine_read_byte(pwcount) - 1, machine_read_byte(mincw1200));
+	op_sub(cpu, machine_read_byte(xroar_machine, pwcount) - 1, machine_read_byte(xroar_machine, mincw1200));
 	pskip += 5;  /* RTS */
 }
 
@@ -696,37 +696,37 @@ static void cbin(struct MC6809 *cpu) {
 	}
 	pskip += 5;  /* RTS */
 	MC6809_REG_A(cpu) = bin;
-	machine_write_byte(bcount, 0);
+	machine_write_byte(xroar_machine, bcount, 0);
 }
 
 static void fast_motor_on(struct MC6809 *cpu) {
 	if (!tape_pad) {
 		motor_on(cpu);
 	}
-	machine_op_rts(cpu);
+	machine_op_rts(xroar_machine);
 	pulse_skip();
 }
 
 static void fast_sync_leader(struct MC6809 *cpu) {
 	if (tape_pad) {
-		machine_write_byte(0x84, 0);
+		machine_write_byte(xroar_machine, 0x84, 0);
 	} else {
 		sync_leader(cpu);
 	}
-	machine_op_rts(cpu);
+	machine_op_rts(xroar_machine);
 	pulse_skip();
 }
 
 static void fast_bitin(struct MC6809 *cpu) {
 	bitin(cpu);
-	machine_op_rts(cpu);
+	machine_op_rts(xroar_machine);
 	pulse_skip();
 	if (tape_rewrite) rewrite_bitin(cpu);
 }
 
 static void fast_cbin(struct MC6809 *cpu) {
 	cbin(cpu);
-	machine_op_rts(cpu);
+	machine_op_rts(xroar_machine);
 	pulse_skip();
 }
 
@@ -770,8 +770,8 @@ static void rewrite_tape_on(struct MC6809 *cpu) {
 	tape_desync(256);
 	/* for audio files, when padding leaders, assume a phase */
 	if (tape_pad && input_skip_sync) {
-		machine_write_byte(0x84, 0);  /* phase */
-		machine_op_rts(cpu);
+		machine_write_byte(xroar_machine, 0x84, 0);  /* phase */
+		machine_op_rts(xroar_machine);
 	}
 }
 
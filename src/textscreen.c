@@ -0,0 +1,137 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging.h"
+#include "machine.h"
+#include "textscreen.h"
+#include "xroar.h"
+
+static FILE *log_file;
+static unsigned frame;
+static _Bool last_valid;
+static uint8_t last_vram[TEXTSCREEN_W * TEXTSCREEN_H];
+
+/* SG4 elements: bit 3 top left, bit 2 top right, bit 1 bottom left, bit 0
+ * bottom right. */
+static const uint16_t sg4_quadrants[16] = {
+	0x0020, 0x2597, 0x2596, 0x2584, 0x259d, 0x2590, 0x259e, 0x259f,
+	0x2598, 0x259a, 0x258c, 0x2599, 0x2580, 0x259c, 0x259b, 0x2588,
+};
+
+size_t textscreen_to_utf8(uint8_t const *vram, char *dest) {
+	char *p = dest;
+	for (int y = 0; y < TEXTSCREEN_H; y++) {
+		char *line_end = p;
+		for (int x = 0; x < TEXTSCREEN_W; x++) {
+			unsigned b = *(vram++);
+			if (b & 0x80) {
+				unsigned u = sg4_quadrants[b & 15];
+				if (u < 0x80) {
+					*(p++) = u;
+				} else {
+					*(p++) = 0xe0 | (u >> 12);
+					*(p++) = 0x80 | ((u >> 6) & 0x3f);
+					*(p++) = 0x80 | (u & 0x3f);
+					line_end = p;
+				}
+				continue;
+			}
+			unsigned c = b & 0x3f;
+			if (c < 0x20)
+				c += 0x40;
+			// INV clear: inverse video
+			if (!(b & 0x40) && c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			*(p++) = c;
+			if (c != ' ')
+				line_end = p;
+		}
+		p = line_end;
+		*(p++) = '\n';
+	}
+	*p = 0;
+	return p - dest;
+}
+
+_Bool textscreen_get(char *dest) {
+	uint8_t vram[TEXTSCREEN_W * TEXTSCREEN_H];
+	if (!machine_text_vram(xroar_machine, vram)) {
+		*dest = 0;
+		return 0;
+	}
+	textscreen_to_utf8(vram, dest);
+	return 1;
+}
+
+void textscreen_open_log(const char *filename) {
+	textscreen_close_log();
+	log_file = fopen(filename, "w");
+	if (!log_file) {
+		LOG_WARN("Failed to open text log '%s'\n", filename);
+		return;
+	}
+	frame = 0;
+	last_valid = 0;
+}
+
+void textscreen_close_log(void) {
+	if (log_file) {
+		fclose(log_file);
+		log_file = NULL;
+	}
+}
+
+void textscreen_dump(const char *filename) {
+	char text[TEXTSCREEN_UTF8_SIZE];
+	if (!textscreen_get(text)) {
+		LOG_WARN("Not in a text mode: '%s' not written\n", filename);
+		return;
+	}
+	FILE *fd = fopen(filename, "w");
+	if (!fd) {
+		LOG_WARN("Failed to open '%s' for writing\n", filename);
+		return;
+	}
+	fputs(text, fd);
+	fclose(fd);
+}
+
+void textscreen_frame(void) {
+	if (!log_file)
+		return;
+	uint8_t vram[TEXTSCREEN_W * TEXTSCREEN_H];
+	if (machine_text_vram(xroar_machine, vram)) {
+		if (!last_valid || memcmp(vram, last_vram, sizeof(vram)) != 0) {
+			char text[TEXTSCREEN_UTF8_SIZE];
+			textscreen_to_utf8(vram, text);
+			fprintf(log_file, "--- frame %u\n%s", frame, text);
+			memcpy(last_vram, vram, sizeof(vram));
+			last_valid = 1;
+		}
+	} else if (last_valid) {
+		fprintf(log_file, "--- frame %u (graphics)\n", frame);
+		last_valid = 0;
+	}
+	frame++;
+}
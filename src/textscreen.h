@@ -0,0 +1,45 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_TEXTSCREEN_H_
+#define XROAR_TEXTSCREEN_H_
+
+/* Text screen scraping.  The 32x16 alphanumeric screen is reconstructed
+ * directly from VRAM and the VDG/SAM mode, without rendering any pixels.
+ *
+ * Characters are converted to UTF-8: normal video as upper case ASCII,
+ * inverse video letters as lower case (as BASIC uses them), and
+ * semigraphics as Unicode quadrant blocks.  Trailing spaces are stripped
+ * from each line. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEXTSCREEN_W (32)
+#define TEXTSCREEN_H (16)
+
+/* Big enough for a whole screen: up to 3 bytes per character, plus a newline
+ * per line and a terminating NUL. */
+#define TEXTSCREEN_UTF8_SIZE (TEXTSCREEN_H * (TEXTSCREEN_W * 3 + 1) + 1)
+
+/* Convert 512 bytes of VRAM to a NUL-terminated string, returning its length.
+ * 'dest' must have room for TEXTSCREEN_UTF8_SIZE bytes. */
+size_t textscreen_to_utf8(uint8_t const *vram, char *dest);
+
+/* Fetch the current text screen as above.  Returns false (and an empty
+ * string) if the display is not in an alphanumeric mode. */
+_Bool textscreen_get(char *dest);
+
+/* Log the text screen to a file each frame it changes */
+void textscreen_open_log(const char *filename);
+void textscreen_close_log(void);
+
+/* Write the current text screen to a file */
+void textscreen_dump(const char *filename);
+
+/* Called by the machine at the end of each frame's active area */
+void textscreen_frame(void);
+
+#endif  /* XROAR_TEXTSCREEN_H_ */
@@ -33,8 +33,12 @@ static FileReqModule * const null_filereq_module_list[] = {
 };
 
 extern VideoModule video_null_module;
+extern VideoModule video_capture_module;
+extern VideoModule video_crc_module;
 static VideoModule * const null_video_module_list[] = {
 	&video_null_module,
+	&video_capture_module,
+	&video_crc_module,
 	NULL
 };
 
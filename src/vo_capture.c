@@ -0,0 +1,345 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Headless video capture.  Each frame is written to a file or pipe as raw
+ * VDG colour indices, packed RGB, or YUV4MPEG2 (4:4:4).  Nothing waits on
+ * the host display, so with -noratelimit this runs as fast as the emulation
+ * and the output can keep up.
+ *
+ * Where threads are available and there is more than one CPU, frames are
+ * handed to a writer thread through a small queue of buffers, so that slow
+ * writes (e.g., to an encoder on the other end of a pipe) overlap with
+ * emulation. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "xalloc.h"
+
+#include "logging.h"
+#include "machine.h"
+#include "mc6847.h"
+#include "module.h"
+#include "xroar.h"
+
+static _Bool init(void);
+static void shutdown(void);
+static void alloc_colours(void);
+static void vsync(void);
+static void render_scanline(uint8_t const *scanline_data);
+static void render_unchanged(void);
+static void set_render_scanline(void);
+
+VideoModule video_capture_module = {
+	.common = { .name = "capture", .description = "Video capture to file or pipe",
+	            .init = init, .shutdown = shutdown },
+	.update_palette = alloc_colours,
+	.vsync = vsync,
+	.render_scanline = render_scanline,
+	.render_unchanged = render_unchanged,
+	.update_cross_colour_phase = set_render_scanline,
+};
+
+/* Colours are stored as three bytes packed into a word: R, G, B or Y, U, V
+ * depending on output format. */
+
+typedef uint32_t Pixel;
+#define MAPCOLOUR(r,g,b) map_colour((r), (g), (b))
+#define XSTEP 1
+#define NEXTLINE 0
+#define LOCK_SURFACE
+#define UNLOCK_SURFACE
+
+static Pixel *screen;
+
+static Pixel map_colour(int r, int g, int b);
+
+#include "vo_generic_ops.c"
+
+#define FRAME_W (320)
+#define FRAME_H (240)
+#define FRAME_HEADER "FRAME\n"
+
+static FILE *output;
+static _Bool output_is_pipe;
+static _Bool output_failed;
+static size_t frame_size;
+
+#define NBUFFERS (8)
+static uint8_t *buffers[NBUFFERS];
+
+#ifdef HAVE_PTHREADS
+static _Bool threaded;
+static pthread_t writer_thread;
+static pthread_mutex_t queue_mt;
+static pthread_cond_t queue_fill_cv;
+static pthread_cond_t queue_space_cv;
+static unsigned queue_head;  // next buffer to fill
+static unsigned queue_tail;  // next buffer to write
+static unsigned queue_length;
+static _Bool queue_quit;
+
+static void *writer_thread_run(void *data);
+#endif
+
+static void write_frame(uint8_t const *buf);
+
+static unsigned gcd(unsigned a, unsigned b) {
+	while (b) {
+		unsigned t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static _Bool init(void) {
+	if (xroar_cfg.capture_pipe) {
+		output = popen(xroar_cfg.capture_pipe, "w");
+		output_is_pipe = 1;
+	} else if (xroar_cfg.capture_file) {
+		output = fopen(xroar_cfg.capture_file, "wb");
+		output_is_pipe = 0;
+	} else {
+		LOG_WARN("Capture: no -capture-file or -capture-pipe specified\n");
+		return 0;
+	}
+	if (!output) {
+		LOG_ERROR("Capture: failed to open output\n");
+		return 0;
+	}
+	output_failed = 0;
+	setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+	switch (xroar_cfg.capture_format) {
+	case XROAR_CAPTURE_RAW:
+		frame_size = FRAME_W * FRAME_H;
+		break;
+	case XROAR_CAPTURE_RGB:
+		frame_size = FRAME_W * FRAME_H * 3;
+		break;
+	default:
+		frame_size = strlen(FRAME_HEADER) + FRAME_W * FRAME_H * 3;
+		break;
+	}
+
+	if (xroar_cfg.capture_format == XROAR_CAPTURE_Y4M) {
+		// Frame rate follows the VDG: 262 lines per frame for NTSC,
+		// padded to 312 for PAL.
+		unsigned lines = (xroar_machine_config->tv_standard == TV_PAL) ? 312 : 262;
+		unsigned num = OSCILLATOR_RATE;
+		unsigned den = 2 * VDG_LINE_DURATION * lines * (xroar_frameskip + 1);
+		unsigned d = gcd(num, den);
+		fprintf(output, "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C444\n", FRAME_W, FRAME_H, num / d, den / d);
+	}
+
+	for (int i = 0; i < NBUFFERS; i++)
+		buffers[i] = xmalloc(frame_size);
+	screen = xzalloc(FRAME_W * FRAME_H * sizeof(Pixel));
+
+#ifdef HAVE_PTHREADS
+	threaded = 0;
+	long ncpus = 2;
+#ifdef _SC_NPROCESSORS_ONLN
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (ncpus > 1) {
+		queue_head = queue_tail = queue_length = 0;
+		queue_quit = 0;
+		pthread_mutex_init(&queue_mt, NULL);
+		pthread_cond_init(&queue_fill_cv, NULL);
+		pthread_cond_init(&queue_space_cv, NULL);
+		threaded = (pthread_create(&writer_thread, NULL, writer_thread_run, NULL) == 0);
+		if (!threaded) {
+			pthread_mutex_destroy(&queue_mt);
+			pthread_cond_destroy(&queue_fill_cv);
+			pthread_cond_destroy(&queue_space_cv);
+		}
+	}
+	LOG_DEBUG(2, "Capture: writing %s\n", threaded ? "from a separate thread" : "synchronously");
+#endif
+
+	alloc_colours();
+	video_module->scanline = 0;
+	video_module->window_x = VDG_ACTIVE_LINE_START - 32;
+	video_module->window_y = VDG_TOP_BORDER_START + 1;
+	video_module->window_w = FRAME_W;
+	video_module->window_h = FRAME_H;
+	pixel = screen;
+	set_render_scanline();
+	return 1;
+}
+
+static void shutdown(void) {
+#ifdef HAVE_PTHREADS
+	if (threaded) {
+		pthread_mutex_lock(&queue_mt);
+		queue_quit = 1;
+		pthread_cond_signal(&queue_fill_cv);
+		pthread_mutex_unlock(&queue_mt);
+		pthread_join(writer_thread, NULL);
+		pthread_mutex_destroy(&queue_mt);
+		pthread_cond_destroy(&queue_fill_cv);
+		pthread_cond_destroy(&queue_space_cv);
+		threaded = 0;
+	}
+#endif
+	if (output) {
+		if (output_is_pipe)
+			pclose(output);
+		else
+			fclose(output);
+		output = NULL;
+	}
+	for (int i = 0; i < NBUFFERS; i++) {
+		free(buffers[i]);
+		buffers[i] = NULL;
+	}
+	free(screen);
+	screen = NULL;
+}
+
+/* BT.601 studio range for YUV */
+static Pixel map_colour(int r, int g, int b) {
+	if (xroar_cfg.capture_format == XROAR_CAPTURE_Y4M) {
+		int y = 16 + (( 66 * r + 129 * g +  25 * b + 128) >> 8);
+		int u = 128 + ((-38 * r -  74 * g + 112 * b + 128) >> 8);
+		int v = 128 + ((112 * r -  94 * g -  18 * b + 128) >> 8);
+		return (y << 16) | (u << 8) | v;
+	}
+	return (r << 16) | (g << 8) | b;
+}
+
+/* Raw output skips colour mapping entirely: the screen holds VDG colour
+ * indices. */
+
+static void render_indexed(uint8_t const *scanline_data) {
+	if (video_module->scanline >= video_module->window_y &&
+	    video_module->scanline < (video_module->window_y + video_module->window_h)) {
+		scanline_data += video_module->window_x;
+		for (int i = video_module->window_w; i; i--) {
+			*(pixel++) = *(scanline_data++);
+		}
+	}
+	video_module->scanline++;
+}
+
+static void set_render_scanline(void) {
+	if (xroar_cfg.capture_format == XROAR_CAPTURE_RAW) {
+		video_module->render_scanline = render_indexed;
+	} else {
+		update_cross_colour_phase();
+	}
+}
+
+static void vsync(void) {
+	uint8_t *buf;
+#ifdef HAVE_PTHREADS
+	if (threaded) {
+		pthread_mutex_lock(&queue_mt);
+		while (queue_length == NBUFFERS)
+			pthread_cond_wait(&queue_space_cv, &queue_mt);
+		pthread_mutex_unlock(&queue_mt);
+		buf = buffers[queue_head];
+	} else
+#endif
+		buf = buffers[0];
+
+	uint8_t *out = buf;
+	Pixel const *p = screen;
+	switch (xroar_cfg.capture_format) {
+	case XROAR_CAPTURE_RAW:
+		for (int i = 0; i < FRAME_W * FRAME_H; i++)
+			*(out++) = *(p++);
+		break;
+	case XROAR_CAPTURE_RGB:
+		for (int i = 0; i < FRAME_W * FRAME_H; i++) {
+			*(out++) = *p >> 16;
+			*(out++) = *p >> 8;
+			*(out++) = *(p++);
+		}
+		break;
+	default:
+		memcpy(out, FRAME_HEADER, strlen(FRAME_HEADER));
+		out += strlen(FRAME_HEADER);
+		for (int i = 0; i < FRAME_W * FRAME_H; i++) {
+			out[i] = p[i] >> 16;
+			out[i + FRAME_W * FRAME_H] = p[i] >> 8;
+			out[i + 2 * FRAME_W * FRAME_H] = p[i];
+		}
+		break;
+	}
+
+#ifdef HAVE_PTHREADS
+	if (threaded) {
+		pthread_mutex_lock(&queue_mt);
+		queue_head = (queue_head + 1) % NBUFFERS;
+		queue_length++;
+		pthread_cond_signal(&queue_fill_cv);
+		pthread_mutex_unlock(&queue_mt);
+	} else
+#endif
+		write_frame(buf);
+
+	pixel = screen;
+	video_module->scanline = 0;
+}
+
+static void write_frame(uint8_t const *buf) {
+	if (output_failed)
+		return;
+	if (fwrite(buf, frame_size, 1, output) != 1) {
+		LOG_WARN("Capture: write failed, no further frames will be written\n");
+		output_failed = 1;
+	}
+}
+
+#ifdef HAVE_PTHREADS
+
+static void *writer_thread_run(void *data) {
+	(void)data;
+	pthread_mutex_lock(&queue_mt);
+	for (;;) {
+		while (queue_length == 0 && !queue_quit)
+			pthread_cond_wait(&queue_fill_cv, &queue_mt);
+		if (queue_length == 0)
+			break;
+		uint8_t const *buf = buffers[queue_tail];
+		pthread_mutex_unlock(&queue_mt);
+		write_frame(buf);
+		pthread_mutex_lock(&queue_mt);
+		queue_tail = (queue_tail + 1) % NBUFFERS;
+		queue_length--;
+		pthread_cond_signal(&queue_space_cv);
+	}
+	pthread_mutex_unlock(&queue_mt);
+	return NULL;
+}
+
+#endif
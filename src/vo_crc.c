@@ -0,0 +1,156 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Per-frame CRC, for regression testing.  No pixels are produced: the VDG
+ * colour indices of the same 320x240 window the other modules display are
+ * hashed instead.
+ *
+ * Each line is hashed as it arrives, and lines the VDG reports as unchanged
+ * keep their previous hash.  The frame CRC is then the CRC-32 of the 240 line
+ * CRCs (as big-endian words), so a mostly static screen costs very little.
+ *
+ * The log records a line "FRAME CRC" only for frames whose CRC differs from
+ * the previous one, plus the final frame on exit.  Frames are numbered from
+ * 0, counting only those presented (see -fskip). */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "logging.h"
+#include "mc6847.h"
+#include "module.h"
+#include "xroar.h"
+
+static _Bool init(void);
+static void shutdown(void);
+static void vsync(void);
+static void render_scanline(uint8_t const *scanline_data);
+static void render_unchanged(void);
+
+VideoModule video_crc_module = {
+	.common = { .name = "crc", .description = "Per-frame CRC log",
+	            .init = init, .shutdown = shutdown },
+	.vsync = vsync,
+	.render_scanline = render_scanline,
+	.render_unchanged = render_unchanged,
+};
+
+#define FRAME_W (320)
+#define FRAME_H (240)
+
+static FILE *log_file;
+static uint8_t line_crc[FRAME_H][4];
+static unsigned frame;
+static uint32_t last_crc;
+static _Bool last_logged;
+static _Bool stop_on_crc;
+static uint32_t stop_crc;
+
+static _Bool init(void) {
+	if (xroar_cfg.crc_log) {
+		if (strcmp(xroar_cfg.crc_log, "-") == 0) {
+			log_file = stdout;
+		} else {
+			log_file = fopen(xroar_cfg.crc_log, "w");
+			if (!log_file) {
+				LOG_ERROR("CRC: failed to open '%s'\n", xroar_cfg.crc_log);
+				return 0;
+			}
+		}
+	}
+	stop_on_crc = 0;
+	if (xroar_cfg.crc_stop) {
+		char *end;
+		stop_crc = strtoul(xroar_cfg.crc_stop, &end, 16);
+		if (*xroar_cfg.crc_stop == 0 || *end != 0) {
+			LOG_ERROR("CRC: invalid -crc-stop value '%s'\n", xroar_cfg.crc_stop);
+			shutdown();
+			return 0;
+		}
+		stop_on_crc = 1;
+	}
+	memset(line_crc, 0, sizeof(line_crc));
+	frame = 0;
+	last_crc = 0;
+	last_logged = 1;
+	video_module->scanline = 0;
+	video_module->window_x = VDG_ACTIVE_LINE_START - 32;
+	video_module->window_y = VDG_TOP_BORDER_START + 1;
+	video_module->window_w = FRAME_W;
+	video_module->window_h = FRAME_H;
+	// Lines must be hashed at least once
+	video_module->redraw = 1;
+	return 1;
+}
+
+static void shutdown(void) {
+	if (!log_file)
+		return;
+	if (frame > 0 && !last_logged)
+		fprintf(log_file, "%u %08x\n", frame - 1, (unsigned)last_crc);
+	if (log_file == stdout)
+		fflush(log_file);
+	else
+		fclose(log_file);
+	log_file = NULL;
+}
+
+static void vsync(void) {
+	uint32_t crc = crc32_block(CRC32_RESET, &line_crc[0][0], sizeof(line_crc));
+	_Bool changed = (frame == 0 || crc != last_crc);
+	last_logged = changed;
+	if (changed && log_file)
+		fprintf(log_file, "%u %08x\n", frame, (unsigned)crc);
+	last_crc = crc;
+	frame++;
+	video_module->scanline = 0;
+
+	if (stop_on_crc && crc == stop_crc) {
+		LOG_DEBUG(1, "CRC: frame %u matched %08x\n", frame - 1, (unsigned)crc);
+		xroar_quit();
+	}
+	if (xroar_cfg.crc_stop_frames > 0 && frame >= (unsigned)xroar_cfg.crc_stop_frames) {
+		if (stop_on_crc) {
+			LOG_WARN("CRC: %08x not matched within %u frames\n", (unsigned)stop_crc, frame);
+			xroar_shutdown();
+			exit(EXIT_FAILURE);
+		}
+		xroar_quit();
+	}
+}
+
+static void render_scanline(uint8_t const *scanline_data) {
+	unsigned y = video_module->scanline - video_module->window_y;
+	if (y < FRAME_H) {
+		uint32_t crc = crc32_block(CRC32_RESET, (uint8_t *)scanline_data + video_module->window_x, FRAME_W);
+		line_crc[y][0] = crc >> 24;
+		line_crc[y][1] = crc >> 16;
+		line_crc[y][2] = crc >> 8;
+		line_crc[y][3] = crc;
+	}
+	video_module->scanline++;
+}
+
+static void render_unchanged(void) {
+	video_module->scanline++;
+}
@@ -24,11 +24,155 @@
 #include "module.h"
 #include "vdg_palette.h"
 
+/* On x86, colour lookup can be done 16 pixels at a time with the SSSE3 byte
+ * shuffle.  Support is checked at runtime, and only contiguous output is
+ * handled.  Each routine still converts any remainder the normal way. */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && XSTEP == 1
+#define VO_SSSE3
+#include <tmmintrin.h>
+#define SSSE3 __attribute__((target("ssse3")))
+#endif
+
 static Pixel *pixel;
 static Pixel vdg_colour[12];
 static Pixel artifact_5bit[2][32];
 static Pixel artifact_simple[2][4];
 
+#ifdef VO_SSSE3
+
+static _Bool use_ssse3;
+
+/* Colours rearranged into 16-entry tables, one for each byte of a Pixel.
+ * ssse3_palette has the simple artifact colours in its spare entries, one
+ * table per phase.  ssse3_5bit is the VDG palette followed by both phases of
+ * the 5-bit artifact colours. */
+static uint8_t ssse3_palette[2][sizeof(Pixel)][16];
+static uint8_t ssse3_5bit[5][sizeof(Pixel)][16];
+
+static void set_ssse3_entry(uint8_t (*table)[16], int i, Pixel p) {
+	for (unsigned b = 0; b < sizeof(Pixel); b++)
+		table[b][i] = p >> (b * 8);
+}
+
+static void alloc_ssse3_colours(void) {
+	use_ssse3 = (sizeof(Pixel) == 1 || sizeof(Pixel) == 2 || sizeof(Pixel) == 4) && __builtin_cpu_supports("ssse3");
+	for (int i = 0; i < 12; i++)
+		set_ssse3_entry(ssse3_5bit[0], i, vdg_colour[i]);
+	for (int phase = 0; phase < 2; phase++) {
+		for (int i = 0; i < 12; i++)
+			set_ssse3_entry(ssse3_palette[phase], i, vdg_colour[i]);
+		for (int i = 0; i < 4; i++)
+			set_ssse3_entry(ssse3_palette[phase], 12 + i, artifact_simple[phase][i]);
+		for (int i = 0; i < 32; i++)
+			set_ssse3_entry(ssse3_5bit[1 + phase * 2 + (i >> 4)], i & 15, artifact_5bit[phase][i]);
+	}
+}
+
+/* Look up 16 colour indices in up to 'ntables' consecutive tables (the top
+ * four bits of each index select the table), and write out the resulting
+ * pixels.  Inlined into each of the routines below so that the table loads
+ * are hoisted out of their loops. */
+
+SSSE3 static inline void ssse3_lookup(Pixel *dest, __m128i idx, uint8_t (*tables)[sizeof(Pixel)][16], unsigned ntables) {
+	__m128i plane[4];
+	for (unsigned b = 0; b < sizeof(Pixel); b++)
+		plane[b] = _mm_setzero_si128();
+	__m128i block = _mm_and_si128(idx, _mm_set1_epi8(0xf0));
+	for (unsigned k = 0; k < ntables; k++) {
+		__m128i sel = _mm_cmpeq_epi8(block, _mm_set1_epi8(k << 4));
+		for (unsigned b = 0; b < sizeof(Pixel); b++) {
+			__m128i t = _mm_loadu_si128((__m128i const *)tables[k][b]);
+			plane[b] = _mm_or_si128(plane[b], _mm_and_si128(sel, _mm_shuffle_epi8(t, idx)));
+		}
+	}
+	__m128i *out = (__m128i *)dest;
+	switch (sizeof(Pixel)) {
+	case 1:
+		_mm_storeu_si128(out, plane[0]);
+		break;
+	case 2:
+		_mm_storeu_si128(out, _mm_unpacklo_epi8(plane[0], plane[1]));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi8(plane[0], plane[1]));
+		break;
+	case 4: {
+		__m128i lo01 = _mm_unpacklo_epi8(plane[0], plane[1]);
+		__m128i hi01 = _mm_unpackhi_epi8(plane[0], plane[1]);
+		__m128i lo23 = _mm_unpacklo_epi8(plane[2], plane[3]);
+		__m128i hi23 = _mm_unpackhi_epi8(plane[2], plane[3]);
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+		} break;
+	default:
+		break;
+	}
+}
+
+/* Each of these converts 'n' blocks of 16 pixels. */
+
+SSSE3 static void ssse3_render_palette(Pixel *dest, uint8_t const *src, int n) {
+	for (; n; n--) {
+		__m128i idx = _mm_loadu_si128((__m128i const *)src);
+		ssse3_lookup(dest, idx, ssse3_palette, 1);
+		src += 16;
+		dest += 16;
+	}
+}
+
+/* Pixel pairs starting black or white become the simple artifact colour
+ * indexed by whether each of the pair is black (table entries 12-15). */
+
+SSSE3 static void ssse3_render_ccr_simple(Pixel *dest, uint8_t const *src, int phase, int n) {
+	__m128i black = _mm_set1_epi16(VDG_BLACK);
+	__m128i white = _mm_set1_epi16(VDG_WHITE);
+	for (; n; n--) {
+		__m128i w = _mm_loadu_si128((__m128i const *)src);
+		__m128i c0 = _mm_and_si128(w, _mm_set1_epi16(0xff));
+		__m128i c1 = _mm_srli_epi16(w, 8);
+		__m128i c0_black = _mm_cmpeq_epi16(c0, black);
+		__m128i is_bw = _mm_or_si128(c0_black, _mm_cmpeq_epi16(c0, white));
+		__m128i aindex = _mm_or_si128(_mm_andnot_si128(c0_black, _mm_set1_epi16(2)),
+					      _mm_andnot_si128(_mm_cmpeq_epi16(c1, black), _mm_set1_epi16(1)));
+		aindex = _mm_add_epi16(aindex, _mm_set1_epi16(12));
+		aindex = _mm_or_si128(aindex, _mm_slli_epi16(aindex, 8));
+		__m128i idx = _mm_or_si128(_mm_and_si128(is_bw, aindex), _mm_andnot_si128(is_bw, w));
+		ssse3_lookup(dest, idx, ssse3_palette + phase, 1);
+		src += 16;
+		dest += 16;
+	}
+}
+
+/* Black or white pixels index the 5-bit artifact colours by whether each of
+ * the two pixels either side and the pixel itself is black.  Only valid from
+ * the fifth pixel of a line onwards (see render_ccr_5bit()). */
+
+SSSE3 static void ssse3_render_ccr_5bit(Pixel *dest, uint8_t const *src, int phase, int n) {
+	__m128i black = _mm_set1_epi8(VDG_BLACK);
+	__m128i white = _mm_set1_epi8(VDG_WHITE);
+	// Table offsets alternate with phase
+	int p0 = 16 + 32 * phase, p1 = 16 + 32 * (phase ^ 1);
+	__m128i base = _mm_set1_epi16((p1 << 8) | p0);
+	for (; n; n--) {
+		__m128i c = _mm_loadu_si128((__m128i const *)src);
+		__m128i c_black = _mm_cmpeq_epi8(c, black);
+		__m128i aindex = _mm_andnot_si128(c_black, _mm_set1_epi8(4));
+		aindex = _mm_or_si128(aindex, _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(src - 2)), black), _mm_set1_epi8(16)));
+		aindex = _mm_or_si128(aindex, _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(src - 1)), black), _mm_set1_epi8(8)));
+		aindex = _mm_or_si128(aindex, _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(src + 1)), black), _mm_set1_epi8(2)));
+		aindex = _mm_or_si128(aindex, _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(src + 2)), black), _mm_set1_epi8(1)));
+		aindex = _mm_add_epi8(aindex, base);
+		__m128i is_bw = _mm_or_si128(c_black, _mm_cmpeq_epi8(c, white));
+		__m128i idx = _mm_or_si128(_mm_and_si128(is_bw, aindex), _mm_andnot_si128(is_bw, c));
+		ssse3_lookup(dest, idx, ssse3_5bit, 5);
+		src += 16;
+		dest += 16;
+	}
+}
+
+#endif
+
 /* Map VDG palette entry */
 static Pixel map_palette_entry(int i) {
 	float R, G, B;
@@ -124,6 +268,11 @@ static void alloc_colours(void) {
 	artifact_5bit[1][0x1d] = MAPCOLOUR(0x64, 0xf0, 0xff);
 	artifact_5bit[1][0x1e] = MAPCOLOUR(0xff, 0xff, 0xff);
 	artifact_5bit[1][0x1f] = MAPCOLOUR(0xff, 0xff, 0xff);
+
+#ifdef VO_SSSE3
+	alloc_ssse3_colours();
+#endif
+	video_module->redraw = 1;
 }
 
 /* Render colour line using palette */
@@ -132,7 +281,17 @@ static void render_scanline(uint8_t const *scanline_data) {
 	    video_module->scanline < (video_module->window_y + video_module->window_h)) {
 		scanline_data += video_module->window_x;
 		LOCK_SURFACE;
-		for (int i = video_module->window_w; i; i--) {
+		int i = video_module->window_w;
+#ifdef VO_SSSE3
+		if (use_ssse3 && i >= 16) {
+			int n = i >> 4;
+			ssse3_render_palette(pixel, scanline_data, n);
+			scanline_data += n << 4;
+			pixel += n << 4;
+			i &= 15;
+		}
+#endif
+		for (; i; i--) {
 			*pixel = vdg_colour[*(scanline_data++)];
 			pixel += XSTEP;
 		}
@@ -149,7 +308,17 @@ static void render_ccr_simple(uint8_t const *scanline_data) {
 		int phase = xroar_machine_config->cross_colour_phase - 1;
 		scanline_data += video_module->window_x;
 		LOCK_SURFACE;
-		for (int i = video_module->window_w >> 1; i; i--) {
+		int i = video_module->window_w >> 1;
+#ifdef VO_SSSE3
+		if (use_ssse3 && i >= 8) {
+			int n = i >> 3;
+			ssse3_render_ccr_simple(pixel, scanline_data, phase, n);
+			scanline_data += n << 4;
+			pixel += n << 4;
+			i &= 7;
+		}
+#endif
+		for (; i; i--) {
 			uint8_t c0 = *(scanline_data++);
 			uint8_t c1 = *(scanline_data++);
 			if (c0 == VDG_BLACK || c0 == VDG_WHITE) {
@@ -179,6 +348,23 @@ static void render_ccr_5bit(uint8_t const *scanline_data) {
 		aindex |= (*(scanline_data - 1) != VDG_BLACK) ? 1 : 0;
 		LOCK_SURFACE;
 		for (int i = video_module->window_w; i; i--) {
+#ifdef VO_SSSE3
+			// From the fifth pixel, the artifact index depends only on
+			// the pixels either side, so 16 can be done at a time.
+			if (use_ssse3 && i >= 16 && i == video_module->window_w - 4) {
+				int n = i >> 4;
+				ssse3_render_ccr_5bit(pixel, scanline_data, phase, n);
+				scanline_data += n << 4;
+				pixel += n << 4;
+				i &= 15;
+				if (!i)
+					break;
+				aindex = (*(scanline_data - 2) != VDG_BLACK) ? 8 : 0;
+				aindex |= (*(scanline_data - 1) != VDG_BLACK) ? 4 : 0;
+				aindex |= (*scanline_data != VDG_BLACK) ? 2 : 0;
+				aindex |= (*(scanline_data + 1) != VDG_BLACK) ? 1 : 0;
+			}
+#endif
 			aindex = (aindex << 1) & 31;
 			if (*(scanline_data + 2) != VDG_BLACK)
 				aindex |= 1;
@@ -197,6 +383,15 @@ static void render_ccr_5bit(uint8_t const *scanline_data) {
 	video_module->scanline++;
 }
 
+/* Skip over a line already rendered in the previous frame */
+static void render_unchanged(void) {
+	if (video_module->scanline >= video_module->window_y &&
+	    video_module->scanline < (video_module->window_y + video_module->window_h)) {
+		pixel += video_module->window_w * XSTEP + NEXTLINE;
+	}
+	video_module->scanline++;
+}
+
 static void update_cross_colour_phase(void) {
 	if (xroar_machine_config->cross_colour_phase == CROSS_COLOUR_OFF) {
 		video_module->render_scanline = render_scanline;
@@ -207,4 +402,5 @@ static void update_cross_colour_phase(void) {
 			video_module->render_scanline = render_ccr_5bit;
 		}
 	}
+	video_module->redraw = 1;
 }
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 #if defined(__APPLE_CC__)
@@ -40,6 +41,7 @@
 #include <GL/glext.h>
 #endif
 
+#include "logging.h"
 #include "mc6847.h"
 #include "vo_opengl.h"
 #include "xroar.h"
@@ -56,16 +58,21 @@ typedef uint16_t Pixel;
 #define VIDEO_TOPLEFT VIDEO_SCREENBASE
 #define VIDEO_VIEWPORT_YOFFSET (0)
 #define LOCK_SURFACE
-#define UNLOCK_SURFACE
+#define UNLOCK_SURFACE (row_damaged[video_module->scanline - video_module->window_y] = 3)
 
 static Pixel *screen_tex;
 
+/* Rows of screen_tex written since they were last uploaded, one bit for each
+ * of the two textures.  Only these rows are uploaded each frame. */
+static uint8_t row_damaged[240];
+
 #include "vo_generic_ops.c"
 
 /*** ***/
 
 static unsigned window_width, window_height;
-static GLuint texnum = 0;
+static GLuint texnum[2];
+static unsigned curtex;
 int vo_opengl_x, vo_opengl_y;
 int vo_opengl_w, vo_opengl_h;
 
@@ -89,6 +96,13 @@ static GLfloat vertices[][2] = {
 	{ 0., 0. }
 };
 
+/* Statistics, reported on exit */
+static unsigned stat_nframes;
+static unsigned stat_nrows;
+static unsigned stat_nuploads;
+static double stat_upload_us;
+static double stat_frame_us;
+
 _Bool vo_opengl_init(void) {
 	screen_tex = xmalloc(320 * 240 * sizeof(Pixel));
 	window_width = 640;
@@ -118,7 +132,11 @@ _Bool vo_opengl_init(void) {
 }
 
 void vo_opengl_shutdown(void) {
-	glDeleteTextures(1, &texnum);
+	if (stat_nframes > 0) {
+		LOG_DEBUG(2, "OpenGL: %u frames, %.1f rows in %.1f uploads each on average\n", stat_nframes, (double)stat_nrows / stat_nframes, (double)stat_nuploads / stat_nframes);
+		LOG_DEBUG(2, "OpenGL: %.1fus uploading, %.1fus total per frame on average\n", stat_upload_us / stat_nframes, stat_frame_us / stat_nframes);
+	}
+	glDeleteTextures(2, texnum);
 	free(screen_tex);
 }
 
@@ -159,26 +177,32 @@ void vo_opengl_set_window_size(unsigned w, unsigned h) {
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClearDepth(1.0f);
 
-	glDeleteTextures(1, &texnum);
-	glGenTextures(1, &texnum);
-	glBindTexture(GL_TEXTURE_2D, texnum);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5, 512, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	if (filter == FILTER_NEAREST
-	    || (filter == FILTER_AUTO && (vo_opengl_w % 320) == 0 && (vo_opengl_h % 240) == 0)) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	} else {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	/* Two textures are used in turn, so that updating one need not wait for
+	 * drawing from the other to complete */
+	glDeleteTextures(2, texnum);
+	glGenTextures(2, texnum);
+	for (int t = 0; t < 2; t++) {
+		glBindTexture(GL_TEXTURE_2D, texnum[t]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5, 512, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		if (filter == FILTER_NEAREST
+		    || (filter == FILTER_AUTO && (vo_opengl_w % 320) == 0 && (vo_opengl_h % 240) == 0)) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		} else {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		/* Is there a better way of clearing the texture? */
+		memset(screen_tex, 0, 512 * sizeof(Pixel));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 320,   0,   1, 256,
+				GL_RGB, GL_UNSIGNED_SHORT_5_6_5, screen_tex);
+		glTexSubImage2D(GL_TEXTURE_2D, 0,   0, 240, 512,   1,
+				GL_RGB, GL_UNSIGNED_SHORT_5_6_5, screen_tex);
 	}
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	/* Is there a better way of clearing the texture? */
-	memset(screen_tex, 0, 512 * sizeof(Pixel));
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 320,   0,   1, 256,
-			GL_RGB, GL_UNSIGNED_SHORT_5_6_5, screen_tex);
-	glTexSubImage2D(GL_TEXTURE_2D, 0,   0, 240, 512,   1,
-			GL_RGB, GL_UNSIGNED_SHORT_5_6_5, screen_tex);
+	// New textures, so all of each needs uploading
+	memset(row_damaged, 3, sizeof(row_damaged));
 
 	glColor4f(1.0, 1.0, 1.0, 1.0);
 
@@ -197,13 +221,39 @@ void vo_opengl_set_window_size(unsigned w, unsigned h) {
 	glTexCoordPointer(2, GL_FLOAT, 0, tex_coords);
 }
 
+/* Upload each run of damaged rows with a single call */
+static void upload_damaged_rows(void) {
+	curtex ^= 1;
+	glBindTexture(GL_TEXTURE_2D, texnum[curtex]);
+	unsigned bit = 1 << curtex;
+	for (int y = 0; y < 240; y++) {
+		if (!(row_damaged[y] & bit))
+			continue;
+		int y0 = y;
+		while (y < 240 && (row_damaged[y] & bit)) {
+			row_damaged[y] &= ~bit;
+			y++;
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y0,
+				320, y - y0, GL_RGB,
+				GL_UNSIGNED_SHORT_5_6_5, screen_tex + y0 * 320);
+		stat_nrows += y - y0;
+		stat_nuploads++;
+	}
+}
+
 void vo_opengl_refresh(void) {
+	struct timeval t0, t1, t2;
+	gettimeofday(&t0, NULL);
+	upload_damaged_rows();
+	gettimeofday(&t1, NULL);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	/* Draw main window */
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-			320, 240, GL_RGB,
-			GL_UNSIGNED_SHORT_5_6_5, screen_tex);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	gettimeofday(&t2, NULL);
+	stat_nframes++;
+	stat_upload_us += (t1.tv_sec - t0.tv_sec) * 1000000. + (t1.tv_usec - t0.tv_usec);
+	stat_frame_us += (t2.tv_sec - t0.tv_sec) * 1000000. + (t2.tv_usec - t0.tv_usec);
 	/* Video module should now do whatever's required to swap buffers */
 }
 
@@ -217,6 +267,10 @@ void vo_opengl_render_scanline(uint8_t const *scanline_data) {
 	render_scanline(scanline_data);
 }
 
+void vo_opengl_render_unchanged(void) {
+	render_unchanged();
+}
+
 void vo_opengl_update_cross_colour_phase(void) {
 	update_cross_colour_phase();
 }
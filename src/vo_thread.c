@@ -0,0 +1,234 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The ring has a single producer (the emulation thread) and a single consumer
+ * (the render thread).  Each side only ever writes its own index, so no lock
+ * is needed to pass lines.  A mutex & condition variables are used only when
+ * one side has to sleep: the render thread when the ring is empty, the
+ * emulation thread when the ring is full or it is waiting for it to empty.
+ *
+ * To avoid waking the render thread for every line, it is only woken once a
+ * batch of lines is waiting, or when the emulation thread needs it to catch
+ * up. */
+
+#include "config.h"
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_PTHREADS) && defined(__GNUC__)
+#define VO_THREAD
+#include <pthread.h>
+#endif
+
+#include "logging.h"
+#include "mc6847.h"
+#include "module.h"
+#include "vo_thread.h"
+#include "xroar.h"
+
+#ifdef VO_THREAD
+
+#define RING_SIZE (128)  // must be a power of 2
+#define WAKE_BATCH (32)
+
+#define LOAD(v) __atomic_load_n(&(v), __ATOMIC_SEQ_CST)
+#define STORE(v,n) __atomic_store_n(&(v), (n), __ATOMIC_SEQ_CST)
+
+struct ring_line {
+	_Bool unchanged;
+	uint8_t data[VDG_LINE_DURATION];
+};
+
+static struct ring_line ring[RING_SIZE];
+static unsigned head;  // next line to write, only written by emulation thread
+static unsigned tail;  // next line to read, only written by render thread
+
+static _Bool running = 0;
+static _Bool quit;
+static pthread_t render_thread;
+static pthread_mutex_t ring_mt;
+static pthread_cond_t ring_fill_cv;  // render thread waits on this
+static pthread_cond_t ring_drain_cv;  // emulation thread waits on this
+static _Bool render_waiting;
+static _Bool emu_waiting;
+
+static void *render_thread_run(void *data);
+
+#endif
+
+void vo_thread_init(void) {
+	if (!xroar_cfg.render_thread)
+		return;
+#ifdef VO_THREAD
+#ifdef _SC_NPROCESSORS_ONLN
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		LOG_DEBUG(1, "Render thread: only one CPU, rendering synchronously\n");
+		return;
+	}
+#endif
+	head = tail = 0;
+	quit = 0;
+	render_waiting = emu_waiting = 0;
+	pthread_mutex_init(&ring_mt, NULL);
+	pthread_cond_init(&ring_fill_cv, NULL);
+	pthread_cond_init(&ring_drain_cv, NULL);
+	if (pthread_create(&render_thread, NULL, render_thread_run, NULL) != 0) {
+		LOG_WARN("Render thread: failed to start, rendering synchronously\n");
+		pthread_mutex_destroy(&ring_mt);
+		pthread_cond_destroy(&ring_fill_cv);
+		pthread_cond_destroy(&ring_drain_cv);
+		return;
+	}
+	running = 1;
+	LOG_DEBUG(2, "Render thread: started\n");
+#else
+	LOG_WARN("Render thread: not supported in this build, rendering synchronously\n");
+#endif
+}
+
+void vo_thread_shutdown(void) {
+#ifdef VO_THREAD
+	if (!running)
+		return;
+	vo_thread_sync();
+	pthread_mutex_lock(&ring_mt);
+	quit = 1;
+	pthread_cond_signal(&ring_fill_cv);
+	pthread_mutex_unlock(&ring_mt);
+	pthread_join(render_thread, NULL);
+	pthread_mutex_destroy(&ring_mt);
+	pthread_cond_destroy(&ring_fill_cv);
+	pthread_cond_destroy(&ring_drain_cv);
+	running = 0;
+#endif
+}
+
+_Bool vo_thread_running(void) {
+#ifdef VO_THREAD
+	return running;
+#else
+	return 0;
+#endif
+}
+
+#ifdef VO_THREAD
+
+static void wake_render_thread(void) {
+	if (LOAD(render_waiting)) {
+		pthread_mutex_lock(&ring_mt);
+		pthread_cond_signal(&ring_fill_cv);
+		pthread_mutex_unlock(&ring_mt);
+	}
+}
+
+/* Wait until at most 'nlines' lines remain in the ring */
+static void wait_for_render_thread(unsigned nlines) {
+	if (head - LOAD(tail) <= nlines)
+		return;
+	wake_render_thread();
+	pthread_mutex_lock(&ring_mt);
+	STORE(emu_waiting, 1);
+	while (head - LOAD(tail) > nlines) {
+		// The render thread may have gone to sleep before seeing the
+		// last line queued.
+		pthread_cond_signal(&ring_fill_cv);
+		pthread_cond_wait(&ring_drain_cv, &ring_mt);
+	}
+	STORE(emu_waiting, 0);
+	pthread_mutex_unlock(&ring_mt);
+}
+
+static struct ring_line *next_line(void) {
+	wait_for_render_thread(RING_SIZE - 1);
+	return &ring[head % RING_SIZE];
+}
+
+static void queue_line(void) {
+	STORE(head, head + 1);
+	if (head - LOAD(tail) >= WAKE_BATCH)
+		wake_render_thread();
+}
+
+static void *render_thread_run(void *data) {
+	(void)data;
+	for (;;) {
+		unsigned t = tail;
+		if (LOAD(head) == t) {
+			pthread_mutex_lock(&ring_mt);
+			STORE(render_waiting, 1);
+			while (LOAD(head) == t && !quit)
+				pthread_cond_wait(&ring_fill_cv, &ring_mt);
+			STORE(render_waiting, 0);
+			_Bool done = quit && LOAD(head) == t;
+			pthread_mutex_unlock(&ring_mt);
+			if (done)
+				break;
+			continue;
+		}
+		struct ring_line *line = &ring[t % RING_SIZE];
+		if (line->unchanged)
+			video_module->render_unchanged();
+		else
+			video_module->render_scanline(line->data);
+		STORE(tail, t + 1);
+		if (LOAD(emu_waiting)) {
+			pthread_mutex_lock(&ring_mt);
+			pthread_cond_signal(&ring_drain_cv);
+			pthread_mutex_unlock(&ring_mt);
+		}
+	}
+	return NULL;
+}
+
+#endif
+
+void vo_thread_render_scanline(uint8_t const *scanline_data) {
+#ifdef VO_THREAD
+	if (running) {
+		struct ring_line *line = next_line();
+		line->unchanged = 0;
+		memcpy(line->data, scanline_data, VDG_LINE_DURATION);
+		queue_line();
+		return;
+	}
+#endif
+	video_module->render_scanline(scanline_data);
+}
+
+void vo_thread_render_unchanged(void) {
+#ifdef VO_THREAD
+	if (running) {
+		struct ring_line *line = next_line();
+		line->unchanged = 1;
+		queue_line();
+		return;
+	}
+#endif
+	video_module->render_unchanged();
+}
+
+void vo_thread_sync(void) {
+#ifdef VO_THREAD
+	if (running)
+		wait_for_render_thread(0);
+#endif
+}
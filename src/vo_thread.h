@@ -0,0 +1,33 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_VO_THREAD_H_
+#define XROAR_VO_THREAD_H_
+
+/* Optional render thread.  Lines from the VDG are queued in a ring and
+ * converted by the video module in a second thread, leaving the emulation
+ * thread free to carry on.  Presentation (vsync) stays on the emulation
+ * thread, as toolkits and GL contexts generally require.
+ *
+ * When the thread is not running (not requested, no thread support, or only
+ * one CPU), lines are passed straight to the video module. */
+
+#include <stdint.h>
+
+void vo_thread_init(void);
+void vo_thread_shutdown(void);
+
+/* Nonzero if lines are being converted in the render thread */
+_Bool vo_thread_running(void);
+
+/* Queue a line, or tell the module it's unchanged (see VideoModule) */
+void vo_thread_render_scanline(uint8_t const *scanline_data);
+void vo_thread_render_unchanged(void);
+
+/* Wait for all queued lines to be converted.  Must be called before
+ * anything else touches the video module from the emulation thread. */
+void vo_thread_sync(void);
+
+#endif  /* XROAR_VO_THREAD_H_ */
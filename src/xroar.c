@@ -54,16 +54,20 @@
 #include "mc6809_trace.h"
 #include "mc6847.h"
 #include "module.h"
+#include "pacer.h"
 #include "path.h"
 #include "printer.h"
+#include "rewind.h"
 #include "romlist.h"
 #include "sam.h"
 #include "snapshot.h"
 #include "sound.h"
 #include "tape.h"
+#include "textscreen.h"
 #include "vdg_palette.h"
 #include "vdisk.h"
 #include "vdrive.h"
+#include "vo_thread.h"
 #include "xconfig.h"
 #include "xroar.h"
 
@@ -79,6 +83,8 @@ struct xroar_cfg xroar_cfg = {
 	.disk_auto_os9 = 1,
 	.gl_filter = ANY_AUTO,
 	.ccr = CROSS_COLOUR_5BIT,
+	.rewind_kb = 0,
+	.rewind_ms = 20,
 };
 
 // Private
@@ -143,6 +149,10 @@ struct private_cfg {
 
 	_Bool config_print;
 	char *timeout;
+	char *ram_dump;
+	char *snap_dump;
+	char *text_log;
+	char *text_dump;
 };
 
 static struct private_cfg private_cfg = {
@@ -186,6 +196,12 @@ static int load_disk_to_drive = 0;
 static int timeout_seconds;
 static int timeout_cycles;
 
+/* Emulation speed, reported on exit */
+static struct timeval speed_start_time;
+static event_ticks speed_last_tick;
+static double speed_total_ticks;
+static void update_speed_stats(void);
+
 static struct joystick_config *cur_joy_config = NULL;
 
 static struct xconfig_option const xroar_options[];
@@ -196,6 +212,7 @@ static struct xconfig_option const xroar_options[];
 _Bool xroar_noratelimit = 0;
 int xroar_frameskip = 0;
 
+struct machine *xroar_machine;
 struct machine_config *xroar_machine_config;
 static struct cart_config *selected_cart_config;
 struct cart *xroar_cart;
@@ -394,7 +411,7 @@ const char *xroar_conf_path = NULL;
 const char *xroar_rom_path = NULL;
 
 struct event *xroar_ui_events = NULL;
-struct event *xroar_machine_events = NULL;
+THREAD_LOCAL struct event **xroar_machine_events = NULL;
 
 static struct event load_file_event;
 static void do_load_file(void *);
@@ -403,10 +420,12 @@ static int autorun_loaded_file = 0;
 
 static struct event timeout_event;
 static void handle_timeout_event(void *);
+static void write_ram_dump(const char *filename);
+static int save_snapshot(const char *filename);
 
 char const * const xroar_disk_exts[] = { "DMK", "JVC", "OS9", "VDK", "DSK", NULL };
 char const * const xroar_tape_exts[] = { "CAS", NULL };
-char const * const xroar_snap_exts[] = { "SNA", NULL };
+char const * const xroar_snap_exts[] = { "SNA", "SNF", NULL };
 char const * const xroar_cart_exts[] = { "ROM", NULL };
 
 static struct {
@@ -650,6 +669,8 @@ _Bool xroar_init(int argc, char **argv) {
 
 	/* Initialise everything */
 	event_current_tick = 0;
+	xroar_machine = machine_new();
+	machine_select(xroar_machine);
 	/* ... modules */
 	module_init((struct module *)ui_module);
 	filereq_module = (FileReqModule *)module_init_from_list((struct module **)filereq_module_list, (struct module *)filereq_module);
@@ -675,6 +696,8 @@ _Bool xroar_init(int argc, char **argv) {
 	joystick_init();
 	machine_init();
 	printer_init();
+	rewind_init();
+	vo_thread_init();
 
 	// Default joystick mapping
 	if (private_cfg.joy_right) {
@@ -700,7 +723,7 @@ _Bool xroar_init(int argc, char **argv) {
 	xroar_set_kbd_translate(1, xroar_cfg.kbd_translate);
 
 	/* Configure machine */
-	machine_configure(xroar_machine_config);
+	machine_configure(xroar_machine, xroar_machine_config);
 	if (xroar_machine_config->cart_enabled) {
 		xroar_set_cart(xroar_machine_config->default_cart);
 	} else {
@@ -788,11 +811,16 @@ _Bool xroar_init(int argc, char **argv) {
 		keyboard_queue_basic(private_cfg.type_list->data);
 		private_cfg.type_list = slist_remove(private_cfg.type_list, private_cfg.type_list->data);
 	}
+	if (private_cfg.text_log) {
+		textscreen_open_log(private_cfg.text_log);
+	}
 	if (private_cfg.lp_file) {
 		printer_open_file(private_cfg.lp_file);
 	} else if (private_cfg.lp_pipe) {
 		printer_open_pipe(private_cfg.lp_pipe);
 	}
+	gettimeofday(&speed_start_time, NULL);
+	speed_last_tick = event_current_tick;
 	return 1;
 }
 
@@ -801,15 +829,40 @@ void xroar_shutdown(void) {
 	if (shutting_down)
 		return;
 	shutting_down = 1;
+	// Only report speed if initialisation got as far as starting the clock
+	if (speed_start_time.tv_sec != 0) {
+		struct timeval tv;
+		update_speed_stats();
+		gettimeofday(&tv, NULL);
+		double host_s = (tv.tv_sec - speed_start_time.tv_sec) + (tv.tv_usec - speed_start_time.tv_usec) / 1000000.;
+		double emu_s = speed_total_ticks / OSCILLATOR_RATE;
+		if (host_s > 0.) {
+			LOG_DEBUG(2, "Emulated %.2fs in %.2fs: %.3f MHz (%.2fx real time)\n", emu_s, host_s, (speed_total_ticks / 16.) / host_s / 1000000., emu_s / host_s);
+		}
+	}
+	if (private_cfg.ram_dump)
+		write_ram_dump(private_cfg.ram_dump);
+	if (private_cfg.snap_dump)
+		save_snapshot(private_cfg.snap_dump);
+	if (private_cfg.text_dump)
+		textscreen_dump(private_cfg.text_dump);
+	textscreen_close_log();
+	rewind_shutdown();
+	vo_thread_shutdown();
+	pacer_shutdown();
 #ifdef WANT_GDB_TARGET
 	if (private_cfg.gdb)
 		gdb_shutdown();
 	pthread_mutex_destroy(&run_state_mt);
 	pthread_cond_destroy(&run_state_cv);
 #endif
+	// Sound modules may render (and so schedule) the last of their audio
+	// as they shut down, which needs the machine's time base.
+	module_shutdown((struct module *)sound_module);
+	machine_free(xroar_machine);
+	xroar_machine = NULL;
 	machine_shutdown();
 	module_shutdown((struct module *)keyboard_module);
-	module_shutdown((struct module *)sound_module);
 	module_shutdown((struct module *)video_module);
 	module_shutdown((struct module *)filereq_module);
 	module_shutdown((struct module *)ui_module);
@@ -818,6 +871,18 @@ void xroar_shutdown(void) {
 #endif
 }
 
+/* Used for batch runs to compare the final state of memory. */
+static void write_ram_dump(const char *filename) {
+	FILE *fd = fopen(filename, "wb");
+	if (!fd) {
+		LOG_WARN("Failed to open RAM dump file '%s'\n", filename);
+		return;
+	}
+	if (fwrite(xroar_machine->ram, 1, xroar_machine->ram_size, fd) != xroar_machine->ram_size)
+		LOG_WARN("Failed to write RAM dump file '%s'\n", filename);
+	fclose(fd);
+}
+
 static struct vdg_palette *get_machine_palette(void) {
 	struct vdg_palette *vp;
 	vp = vdg_palette_by_name(xroar_machine_config->vdg_palette);
@@ -860,7 +925,9 @@ _Bool xroar_run(void) {
 	if (xroar_run_state == xroar_run_state_running) {
 #endif
 
-		int sig = machine_run(VDG_LINE_DURATION * 32);
+		// With a render thread, run a whole frame at a time so that
+		// it is kept busy between the syncs below.
+		int sig = machine_run(xroar_machine, VDG_LINE_DURATION * (vo_thread_running() ? VDG_FRAME_DURATION : 32));
 		(void)sig;
 
 #ifdef WANT_GDB_TARGET
@@ -869,7 +936,7 @@ _Bool xroar_run(void) {
 			gdb_handle_signal(sig);
 		}
 	} else if (xroar_run_state == xroar_run_state_single_step) {
-		machine_single_step();
+		machine_single_step(xroar_machine);
 		xroar_run_state = xroar_run_state_stopped;
 		gdb_handle_signal(XROAR_SIGTRAP);
 		pthread_cond_signal(&run_state_cv);
@@ -877,10 +944,21 @@ _Bool xroar_run(void) {
 	pthread_mutex_unlock(&run_state_mt);
 #endif
 
+	// Anything outside the emulation may use the video module
+	vo_thread_sync();
+	rewind_update();
+	update_speed_stats();
 	event_run_queue(&UI_EVENT_LIST);
 	return 1;
 }
 
+/* Accumulate emulated time.  Called often enough that the tick counter can't
+ * wrap in between. */
+static void update_speed_stats(void) {
+	speed_total_ticks += (event_ticks)(event_current_tick - speed_last_tick);
+	speed_last_tick = event_current_tick;
+}
+
 #ifdef WANT_GDB_TARGET
 void xroar_machine_continue(void) {
 	pthread_mutex_lock(&run_state_mt);
@@ -894,7 +972,7 @@ void xroar_machine_continue(void) {
 void xroar_machine_signal(int sig) {
 	pthread_mutex_lock(&run_state_mt);
 	if (xroar_run_state == xroar_run_state_running) {
-		machine_signal(sig);
+		machine_signal(xroar_machine, sig);
 		xroar_run_state = xroar_run_state_stopped;
 		gdb_handle_signal(sig);
 	}
@@ -913,7 +991,7 @@ void xroar_machine_single_step(void) {
 
 void xroar_machine_trap(void *data) {
 	(void)data;
-	machine_signal(XROAR_SIGTRAP);
+	machine_signal(xroar_machine, XROAR_SIGTRAP);
 }
 
 int xroar_filetype_by_ext(const char *filename) {
@@ -959,7 +1037,7 @@ int xroar_load_file_by_type(const char *filename, int autorun) {
 			return read_snapshot(filename);
 		case FILETYPE_ROM: {
 			struct cart_config *cc;
-			machine_remove_cart();
+			machine_remove_cart(xroar_machine);
 			cc = cart_config_by_name(filename);
 			if (cc) {
 				cc->autorun = autorun;
@@ -1030,8 +1108,8 @@ void xroar_set_trace(int mode) {
 			break;
 	}
 	xroar_cfg.trace_enabled = set_to;
-	machine_set_trace(xroar_cfg.trace_enabled);
-	struct MC6809 *cpu = machine_get_cpu(0);
+	machine_set_trace(xroar_machine, xroar_cfg.trace_enabled);
+	struct MC6809 *cpu = machine_get_cpu(xroar_machine, 0);
 	if (xroar_cfg.trace_enabled) {
 		switch (xroar_machine_config->cpu) {
 		case CPU_MC6809: default:
@@ -1154,7 +1232,7 @@ void xroar_set_vdg_inverted_text(_Bool notify, int action) {
 		xroar_cfg.vdg_inverted_text = action;
 		break;
 	}
-	machine_set_inverted_text(xroar_cfg.vdg_inverted_text);
+	machine_set_inverted_text(xroar_machine, xroar_cfg.vdg_inverted_text);
 	if (notify && ui_module->vdg_inverse_cb) {
 		ui_module->vdg_inverse_cb(xroar_cfg.vdg_inverted_text);
 	}
@@ -1307,9 +1385,9 @@ void xroar_set_machine(int machine_type) {
 			break;
 	}
 	if (new >= 0 && new < num_machine_types) {
-		machine_remove_cart();
+		machine_remove_cart(xroar_machine);
 		xroar_machine_config = machine_config_index(new);
-		machine_configure(xroar_machine_config);
+		machine_configure(xroar_machine, xroar_machine_config);
 		if (xroar_machine_config->cart_enabled) {
 			xroar_set_cart(xroar_machine_config->default_cart);
 		} else {
@@ -1343,7 +1421,7 @@ void xroar_set_cart(const char *cc_name) {
 	lock = 1;
 
 	assert(xroar_machine_config != NULL);
-	machine_remove_cart();
+	machine_remove_cart(xroar_machine);
 
 	if (!cc_name) {
 		xroar_machine_config->cart_enabled = 0;
@@ -1353,12 +1431,12 @@ void xroar_set_cart(const char *cc_name) {
 			xroar_machine_config->default_cart = xstrdup(cc_name);
 		}
 		xroar_machine_config->cart_enabled = 1;
-		machine_insert_cart(cart_new_named(cc_name));
+		machine_insert_cart(xroar_machine, cart_new_named(cc_name));
 	}
 
 	if (ui_module->cart_changed_cb) {
-		if (machine_cart) {
-			ui_module->cart_changed_cb(machine_cart->config->index);
+		if (xroar_machine->cart) {
+			ui_module->cart_changed_cb(xroar_machine->cart->config->index);
 		} else {
 			ui_module->cart_changed_cb(-1);
 		}
@@ -1383,13 +1461,25 @@ void xroar_set_dos(int dos_type) {
 	}
 }
 
+/* Snapshots saved with a .snf extension use the fast format. */
+static int save_snapshot(const char *filename) {
+	char *ext = strrchr(filename, '.');
+	if (ext && 0 == c_strcasecmp(ext, ".snf"))
+		return write_snapshot_fast(filename);
+	return write_snapshot(filename);
+}
+
 void xroar_save_snapshot(void) {
 	char *filename = filereq_module->save_filename(xroar_snap_exts);
 	if (filename) {
-		write_snapshot(filename);
+		save_snapshot(filename);
 	}
 }
 
+void xroar_rewind(void) {
+	rewind_back(1000);
+}
+
 void xroar_select_tape_input(void) {
 	char *filename = filereq_module->load_filename(xroar_tape_exts);
 	if (filename) {
@@ -1425,12 +1515,12 @@ void xroar_eject_tape_output(void) {
 }
 
 void xroar_soft_reset(void) {
-	machine_reset(RESET_SOFT);
+	machine_reset(xroar_machine, RESET_SOFT);
 }
 
 void xroar_hard_reset(void) {
 	printer_reset();
-	machine_reset(RESET_HARD);
+	machine_reset(xroar_machine, RESET_HARD);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1755,6 +1845,13 @@ static struct xconfig_enum gl_filter_list[] = {
 	{ XC_ENUM_END() }
 };
 
+static struct xconfig_enum capture_format_list[] = {
+	{ .value = XROAR_CAPTURE_Y4M, .name = "y4m", .description = "YUV4MPEG2 (4:4:4)" },
+	{ .value = XROAR_CAPTURE_RGB, .name = "rgb", .description = "Raw 24-bit RGB" },
+	{ .value = XROAR_CAPTURE_RAW, .name = "raw", .description = "Raw VDG colour indices" },
+	{ XC_ENUM_END() }
+};
+
 static struct xconfig_enum ccr_list[] = {
 	{ .value = CROSS_COLOUR_SIMPLE, .name = "simple", .description = "four colour palette" },
 	{ .value = CROSS_COLOUR_5BIT, .name = "5bit", .description = "5-bit lookup table" },
@@ -1873,10 +1970,20 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_STRING("geometry", &xroar_cfg.geometry) },
 	{ XC_SET_STRING("g", &xroar_cfg.geometry) },
 	{ XC_SET_BOOL("invert-text", &xroar_cfg.vdg_inverted_text) },
+	{ XC_SET_BOOL("render-thread", &xroar_cfg.render_thread) },
+	{ XC_SET_BOOL("vdg-deferred", &xroar_cfg.vdg_deferred) },
+	{ XC_SET_STRING("capture-file", &xroar_cfg.capture_file) },
+	{ XC_SET_STRING("capture-pipe", &xroar_cfg.capture_pipe) },
+	{ XC_SET_ENUM("capture-format", &xroar_cfg.capture_format, capture_format_list) },
+	{ XC_SET_STRING("crc-log", &xroar_cfg.crc_log) },
+	{ XC_SET_STRING("crc-stop", &xroar_cfg.crc_stop) },
+	{ XC_SET_INT("crc-stop-frames", &xroar_cfg.crc_stop_frames) },
 
 	/* Audio: */
 	{ XC_SET_STRING("ao", &private_cfg.ao) },
 	{ XC_SET_STRING("ao-device", &xroar_cfg.ao_device) },
+	{ XC_SET_STRING("ao-file", &xroar_cfg.ao_file) },
+	{ XC_SET_STRING("ao-pipe", &xroar_cfg.ao_pipe) },
 	{ XC_SET_ENUM("ao-format", &xroar_cfg.ao_format, ao_format_list) },
 	{ XC_SET_INT("ao-rate", &xroar_cfg.ao_rate) },
 	{ XC_SET_INT("ao-channels", &xroar_cfg.ao_channels) },
@@ -1885,6 +1992,7 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_INT("ao-fragment-frames", &xroar_cfg.ao_fragment_nframes) },
 	{ XC_SET_INT("ao-buffer-ms", &xroar_cfg.ao_buffer_ms) },
 	{ XC_SET_INT("ao-buffer-frames", &xroar_cfg.ao_buffer_nframes) },
+	{ XC_SET_BOOL("ao-adaptive", &xroar_cfg.ao_adaptive) },
 	{ XC_SET_INT("volume", &private_cfg.volume) },
 #ifndef FAST_SOUND
 	{ XC_SET_BOOL("fast-sound", &xroar_cfg.fast_sound) },
@@ -1910,6 +2018,10 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_STRING("lp-file", &private_cfg.lp_file) },
 	{ XC_SET_STRING("lp-pipe", &private_cfg.lp_pipe) },
 
+	/* Rewind: */
+	{ XC_SET_INT("rewind-mem", &xroar_cfg.rewind_kb) },
+	{ XC_SET_INT("rewind-interval", &xroar_cfg.rewind_ms) },
+
 	/* Debugging: */
 #ifdef WANT_GDB_TARGET
 	{ XC_SET_BOOL("gdb", &private_cfg.gdb) },
@@ -1926,6 +2038,12 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_INT("debug-gdb", &xroar_cfg.debug_gdb) },
 #endif
 	{ XC_SET_STRING("timeout", &private_cfg.timeout) },
+	{ XC_SET_BOOL("noratelimit", &xroar_noratelimit) },
+	{ XC_SET_INT("pacer-spin", &xroar_cfg.pacer_spin_us) },
+	{ XC_SET_STRING("ram-dump", &private_cfg.ram_dump) },
+	{ XC_SET_STRING("snap-dump", &private_cfg.snap_dump) },
+	{ XC_SET_STRING("text-log", &private_cfg.text_log) },
+	{ XC_SET_STRING("text-dump", &private_cfg.text_dump) },
 
 	/* Other options: */
 	{ XC_SET_BOOL("config-print", &private_cfg.config_print) },
@@ -1948,10 +2066,13 @@ static void helptext(void) {
 #ifdef LOGGING
 	puts(
 "Usage: xroar [-c CONFFILE] [OPTION]...\n"
+"  or:  xroar -batch MANIFEST [-batch-jobs N] [-batch-log DIR]\n"
+"               [-batch-timeout SECONDS] [OPTION]...\n"
 "XRoar is a Dragon emulator.  Due to hardware similarities, XRoar also\n"
 "emulates the Tandy Colour Computer (CoCo) models 1 & 2.\n"
 
 "\n  -c CONFFILE     specify a configuration file\n"
+"  -batch MANIFEST run headless jobs listed in MANIFEST, one per line\n"
 
 "\n Machines:\n"
 "  -default-machine NAME   default machine on startup\n"
@@ -2024,10 +2145,20 @@ static void helptext(void) {
 #endif
 "  -geometry WxH+X+Y     initial emulator geometry\n"
 "  -invert-text          start with text mode inverted\n"
+"  -render-thread        convert video in a separate thread\n"
+"  -vdg-deferred         render each frame from the VDG in one pass\n"
+"  -capture-file FILE    write video to FILE (with -vo capture)\n"
+"  -capture-pipe COMMAND pipe video to COMMAND (with -vo capture)\n"
+"  -capture-format FMT   video capture format (-capture-format help for list)\n"
+"  -crc-log FILE         log frame CRCs to FILE, - for stdout (with -vo crc)\n"
+"  -crc-stop CRC         exit when a frame's CRC matches (with -vo crc)\n"
+"  -crc-stop-frames N    exit after N frames, failing if -crc-stop not matched\n"
 
 "\n Audio:\n"
 "  -ao MODULE            audio module (-ao help for list)\n"
 "  -ao-device STRING     device to use for audio module\n"
+"  -ao-file FILE         write audio to FILE as WAV (with -ao wav)\n"
+"  -ao-pipe COMMAND      pipe WAV audio to COMMAND (with -ao wav)\n"
 "  -ao-format FMT        set audio sample format (-ao-format help for list)\n"
 "  -ao-rate HZ           set audio frame rate (if supported by module)\n"
 "  -ao-channels N        set number of audio channels, 1 or 2\n"
@@ -2036,6 +2167,7 @@ static void helptext(void) {
 "  -ao-fragment-frames N set audio fragment size in samples (if supported)\n"
 "  -ao-buffer-ms MS      set total audio buffer size in ms (if supported)\n"
 "  -ao-buffer-frames N   set total audio buffer size in samples (if supported)\n"
+"  -ao-adaptive          pace by system clock, adapting audio to the device\n"
 "  -volume VOLUME        audio volume (0 - 100)\n"
 #ifndef FAST_SOUND
 "  -fast-sound           faster but less accurate sound\n"
@@ -2059,6 +2191,10 @@ static void helptext(void) {
 "  -lp-file FILENAME     append Dragon printer output to FILENAME\n"
 "  -lp-pipe COMMAND      pipe Dragon printer output to COMMAND\n"
 
+"\n Rewind:\n"
+"  -rewind-mem KB        memory to use for rewinding, or 0 to disable [0]\n"
+"  -rewind-interval MS   emulated time between captures [20]\n"
+
 "\n Debugging:\n"
 #ifdef WANT_GDB_TARGET
 "  -gdb                  enable GDB target\n"
@@ -2075,6 +2211,12 @@ static void helptext(void) {
 "  -v, --verbose LEVEL   general debug verbosity (0-3) [1]\n"
 "  -q, --quiet           equivalent to --verbose 0\n"
 "  -timeout SECONDS      run for SECONDS then quit\n"
+"  -noratelimit          run as fast as possible (emulated speed shown with -v 2)\n"
+"  -pacer-spin US        poll the clock for the last US microseconds of a wait\n"
+"  -ram-dump FILENAME    write contents of RAM to FILENAME on exit\n"
+"  -snap-dump FILENAME   write snapshot to FILENAME on exit\n"
+"  -text-log FILENAME    log text screen to FILENAME each time it changes\n"
+"  -text-dump FILENAME   write text screen to FILENAME on exit\n"
 
 "\n Other options:\n"
 "  -config-print         print full configuration to standard output\n"
@@ -2187,11 +2329,26 @@ static void config_print_all(void) {
 	}
 	if (xroar_cfg.geometry) printf("geometry %s\n", xroar_cfg.geometry);
 	if (xroar_cfg.vdg_inverted_text) puts("invert-text");
+	if (xroar_cfg.render_thread) puts("render-thread");
+	if (xroar_cfg.vdg_deferred) puts("vdg-deferred");
+	if (xroar_cfg.capture_file) printf("capture-file %s\n", xroar_cfg.capture_file);
+	if (xroar_cfg.capture_pipe) printf("capture-pipe %s\n", xroar_cfg.capture_pipe);
+	switch (xroar_cfg.capture_format) {
+	// case XROAR_CAPTURE_Y4M: puts("capture-format y4m"); break;
+	case XROAR_CAPTURE_RGB: puts("capture-format rgb"); break;
+	case XROAR_CAPTURE_RAW: puts("capture-format raw"); break;
+	default: break;
+	}
+	if (xroar_cfg.crc_log) printf("crc-log %s\n", xroar_cfg.crc_log);
+	if (xroar_cfg.crc_stop) printf("crc-stop %s\n", xroar_cfg.crc_stop);
+	if (xroar_cfg.crc_stop_frames > 0) printf("crc-stop-frames %d\n", xroar_cfg.crc_stop_frames);
 	putchar('\n');
 
 	puts("# Audio");
 	if (private_cfg.ao) printf("ao %s\n", private_cfg.ao);
 	if (xroar_cfg.ao_device) printf("ao-device %s\n", xroar_cfg.ao_device);
+	if (xroar_cfg.ao_file) printf("ao-file %s\n", xroar_cfg.ao_file);
+	if (xroar_cfg.ao_pipe) printf("ao-pipe %s\n", xroar_cfg.ao_pipe);
 	switch (xroar_cfg.ao_format) {
 	case SOUND_FMT_U8: puts("ao-format u8"); break;
 	case SOUND_FMT_S8: puts("ao-format u8"); break;
@@ -2209,6 +2366,7 @@ static void config_print_all(void) {
 	if (xroar_cfg.ao_fragment_nframes != 0) printf("ao-fragment-frames %d\n", xroar_cfg.ao_fragment_nframes);
 	if (xroar_cfg.ao_buffer_ms != 0) printf("ao-buffer-ms %d\n", xroar_cfg.ao_buffer_ms);
 	if (xroar_cfg.ao_buffer_nframes != 0) printf("ao-buffer-frames %d\n", xroar_cfg.ao_buffer_nframes);
+	if (xroar_cfg.ao_adaptive) puts("ao-adaptive");
 	if (private_cfg.volume != 100) printf("volume %d\n", private_cfg.volume);
 #ifndef FAST_SOUND
 	if (xroar_cfg.fast_sound) puts("fast-sound");
@@ -2232,6 +2390,11 @@ static void config_print_all(void) {
 	if (private_cfg.lp_pipe) printf("lp-pipe %s\n", private_cfg.lp_pipe);
 	putchar('\n');
 
+	puts("# Rewind");
+	if (xroar_cfg.rewind_kb != 0) printf("rewind-mem %d\n", xroar_cfg.rewind_kb);
+	if (xroar_cfg.rewind_ms != 20) printf("rewind-interval %d\n", xroar_cfg.rewind_ms);
+	putchar('\n');
+
 	puts("# Debugging");
 #ifdef WANT_GDB_TARGET
 	if (private_cfg.gdb) puts("gdb");
@@ -2249,5 +2412,11 @@ static void config_print_all(void) {
 	if (xroar_cfg.debug_gdb != 0) printf("debug-gdb 0x%x\n", xroar_cfg.debug_gdb);
 #endif
 	if (private_cfg.timeout) printf("timeout %s\n", private_cfg.timeout);
+	if (xroar_noratelimit) puts("noratelimit");
+	if (xroar_cfg.pacer_spin_us != 0) printf("pacer-spin %d\n", xroar_cfg.pacer_spin_us);
+	if (private_cfg.ram_dump) printf("ram-dump %s\n", private_cfg.ram_dump);
+	if (private_cfg.snap_dump) printf("snap-dump %s\n", private_cfg.snap_dump);
+	if (private_cfg.text_log) printf("text-log %s\n", private_cfg.text_log);
+	if (private_cfg.text_dump) printf("text-dump %s\n", private_cfg.text_dump);
 	putchar('\n');
 }
@@ -13,6 +13,7 @@
 #include "xconfig.h"
 
 struct event;
+struct machine;
 struct machine_config;
 struct cart;
 struct vdg_palette;
@@ -71,6 +72,10 @@ extern int xroar_last_signal;
 #define XROAR_GL_FILTER_NEAREST (0)
 #define XROAR_GL_FILTER_LINEAR  (1)
 
+#define XROAR_CAPTURE_Y4M (0)
+#define XROAR_CAPTURE_RGB (1)
+#define XROAR_CAPTURE_RAW (2)
+
 struct xroar_cfg {
 	/* Emulator interface */
 	// Video
@@ -80,8 +85,18 @@ struct xroar_cfg {
 	int frameskip;
 	int ccr;
 	_Bool vdg_inverted_text;
+	_Bool render_thread;
+	_Bool vdg_deferred;
+	char *capture_file;
+	char *capture_pipe;
+	int capture_format;
+	char *crc_log;
+	char *crc_stop;
+	int crc_stop_frames;
 	// Audio
 	char *ao_device;
+	char *ao_file;
+	char *ao_pipe;
 	int ao_format;
 	int ao_rate;
 	int ao_channels;
@@ -90,6 +105,7 @@ struct xroar_cfg {
 	int ao_fragment_nframes;
 	int ao_buffer_ms;
 	int ao_buffer_nframes;
+	_Bool ao_adaptive;
 #ifndef FAST_SOUND
 	_Bool fast_sound;
 #endif
@@ -108,12 +124,16 @@ struct xroar_cfg {
 	// GDB target
 	char *gdb_ip;
 	char *gdb_port;
+	// Rewind
+	int rewind_kb;
+	int rewind_ms;
 	// Debugging
 	int trace_enabled;
 	unsigned debug_ui;
 	unsigned debug_file;
 	unsigned debug_fdc;
 	unsigned debug_gdb;
+	int pacer_spin_us;
 };
 
 extern struct xroar_cfg xroar_cfg;
@@ -136,10 +156,12 @@ extern int xroar_frameskip;
 extern const char *xroar_rom_path;
 
 #define UI_EVENT_LIST xroar_ui_events
-#define MACHINE_EVENT_LIST xroar_machine_events
+#define MACHINE_EVENT_LIST (*xroar_machine_events)
 extern struct event *xroar_ui_events;
-extern struct event *xroar_machine_events;
+/* Points to the event list of the machine selected on this thread */
+extern THREAD_LOCAL struct event **xroar_machine_events;
 
+extern struct machine *xroar_machine;
 extern struct machine_config *xroar_machine_config;
 extern struct cart *xroar_cart;
 extern struct vdg_palette *xroar_vdg_palette;
@@ -210,6 +232,7 @@ void xroar_toggle_cart(void);
 void xroar_set_cart(const char *cc_name);
 void xroar_set_dos(int dos_type);  /* for old snapshots only */
 void xroar_save_snapshot(void);
+void xroar_rewind(void);
 void xroar_select_tape_input(void);
 void xroar_eject_tape_input(void);
 void xroar_select_tape_output(void);
@@ -0,0 +1,295 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Replays a trace of event queue operations against events.c and against a
+ * plain sorted list (the way events.c used to work), checks that both
+ * dispatch events in the same order, and reports the time per operation.
+ *
+ * To record a trace, build XRoar with event tracing and run it:
+ *
+ *     make clean && make CPPFLAGS=-DEVENT_TRACE
+ *     XROAR_EVENT_TRACE=boot.trace src/xroar -vo null -ao null \
+ *         -noratelimit -timeout 30
+ *     make -C tools evbench && tools/evbench boot.trace
+ *
+ * Each traced event can be replayed as several copies, each due a tick later
+ * than the last, to see how things scale with deeper queues. */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "xalloc.h"
+
+#include "events.h"
+
+#include "evbench.h"
+
+#define MAX_LISTS (8)
+#define NUM_REPEATS (3)
+
+struct trace_op {
+	char op;
+	int list;
+	int event;
+	event_ticks at_tick;
+	event_ticks now;
+};
+
+static struct trace_op *ops;
+static int nops;
+static int nlists;
+static int nevents;
+
+/* Dispatch order is summarised as a running hash of event indices */
+
+static uint64_t hash_event(uint64_t hash, unsigned index) {
+	return (hash ^ index) * UINT64_C(0x100000001b3);
+}
+
+struct replay_result {
+	double seconds;
+	uint64_t order;
+	unsigned long dispatched;
+	unsigned long mismatches;
+};
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* With one copy, every dispatch in the trace should find the traced event at
+ * the front of its queue.  With more, each dispatch runs everything due. */
+
+static void replay_ref(int ncopies, struct replay_result *result) {
+	struct ref_event *lists[MAX_LISTS] = { NULL };
+	struct ref_event *events = xzalloc(nevents * ncopies * sizeof(*events));
+	uint64_t order = UINT64_C(0xcbf29ce484222325);
+	unsigned long dispatched = 0, mismatches = 0;
+	double t0 = now_s();
+	for (int i = 0; i < nops; i++) {
+		struct trace_op *o = &ops[i];
+		struct ref_event **list = &lists[o->list];
+		struct ref_event *e = &events[o->event * ncopies];
+		switch (o->op) {
+		case 'Q':
+			for (int k = 0; k < ncopies; k++) {
+				e[k].at_tick = o->at_tick + k;
+				ref_queue(list, &e[k]);
+			}
+			break;
+		case 'D':
+			for (int k = 0; k < ncopies; k++)
+				ref_dequeue(&e[k]);
+			break;
+		case 'X':
+			if (ncopies == 1) {
+				if (*list != e)
+					mismatches++;
+				if (*list) {
+					order = hash_event(order, ref_pop(list) - events);
+					dispatched++;
+				}
+				break;
+			}
+			while (ref_pending(list, o->now + ncopies)) {
+				order = hash_event(order, ref_pop(list) - events);
+				dispatched++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	result->seconds = now_s() - t0;
+	result->order = order;
+	result->dispatched = dispatched;
+	result->mismatches = mismatches;
+	free(events);
+}
+
+static void replay_events(int ncopies, struct replay_result *result) {
+	struct event *lists[MAX_LISTS] = { NULL };
+	struct event *events = xmalloc(nevents * ncopies * sizeof(*events));
+	for (int i = 0; i < nevents * ncopies; i++)
+		event_init(&events[i], DELEGATE_AS0(void, DELEGATE_DEFAULT_F0(void), NULL));
+	uint64_t order = UINT64_C(0xcbf29ce484222325);
+	unsigned long dispatched = 0, mismatches = 0;
+	double t0 = now_s();
+	for (int i = 0; i < nops; i++) {
+		struct trace_op *o = &ops[i];
+		struct event **list = &lists[o->list];
+		struct event *e = &events[o->event * ncopies];
+		switch (o->op) {
+		case 'Q':
+			for (int k = 0; k < ncopies; k++) {
+				e[k].at_tick = o->at_tick + k;
+				event_queue(list, &e[k]);
+			}
+			break;
+		case 'D':
+			for (int k = 0; k < ncopies; k++)
+				event_dequeue(&e[k]);
+			break;
+		case 'X':
+			if (ncopies == 1) {
+				if (*list != e)
+					mismatches++;
+				if (*list) {
+					order = hash_event(order, event_pop(list) - events);
+					dispatched++;
+				}
+				break;
+			}
+			event_current_tick = o->now + ncopies;
+			while (event_pending(list)) {
+				order = hash_event(order, event_pop(list) - events);
+				dispatched++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	result->seconds = now_s() - t0;
+	result->order = order;
+	result->dispatched = dispatched;
+	result->mismatches = mismatches;
+	free(events);
+}
+
+static void best_of(void (*replay)(int, struct replay_result *), int ncopies, struct replay_result *best) {
+	for (int rep = 0; rep < NUM_REPEATS; rep++) {
+		struct replay_result r;
+		replay(ncopies, &r);
+		if (rep == 0 || r.seconds < best->seconds)
+			*best = r;
+	}
+}
+
+/* Pointers in the trace are mapped to small indices */
+
+static int map_pointer(void ***map, int *nmap, void *p) {
+	for (int i = 0; i < *nmap; i++) {
+		if ((*map)[i] == p)
+			return i;
+	}
+	*map = xrealloc(*map, (*nmap + 1) * sizeof(**map));
+	(*map)[*nmap] = p;
+	return (*nmap)++;
+}
+
+static void read_trace(const char *filename) {
+	FILE *fd = fopen(filename, "r");
+	if (!fd) {
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+	void **list_map = NULL, **event_map = NULL;
+	int nalloc = 0;
+	char buf[256];
+	while (fgets(buf, sizeof(buf), fd)) {
+		char op;
+		void *list, *event;
+		unsigned at_tick, now;
+		if (sscanf(buf, "%c %p %p %u %u", &op, &list, &event, &at_tick, &now) != 5)
+			continue;
+		if (nops == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 65536;
+			ops = xrealloc(ops, nalloc * sizeof(*ops));
+		}
+		struct trace_op *o = &ops[nops++];
+		o->op = op;
+		o->list = map_pointer(&list_map, &nlists, list);
+		o->event = map_pointer(&event_map, &nevents, event);
+		o->at_tick = at_tick;
+		o->now = now;
+		if (nlists > MAX_LISTS) {
+			fprintf(stderr, "%s: too many event lists\n", filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	fclose(fd);
+	free(list_map);
+	free(event_map);
+}
+
+/* Mean number of events already in the queue when one is queued */
+
+static double mean_depth(void) {
+	_Bool *queued = xzalloc(nevents * sizeof(*queued));
+	int depth[MAX_LISTS] = { 0 };
+	int *event_list = xzalloc(nevents * sizeof(*event_list));
+	double total = 0.;
+	unsigned long nqueued = 0;
+	for (int i = 0; i < nops; i++) {
+		struct trace_op *o = &ops[i];
+		if (queued[o->event]) {
+			depth[event_list[o->event]]--;
+			queued[o->event] = 0;
+		}
+		if (o->op == 'Q') {
+			total += depth[o->list];
+			nqueued++;
+			depth[o->list]++;
+			queued[o->event] = 1;
+			event_list[o->event] = o->list;
+		}
+	}
+	free(queued);
+	free(event_list);
+	return nqueued ? total / nqueued : 0.;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s TRACE-FILE [COPIES]...\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	read_trace(argv[1]);
+	printf("%d operations on %d events in %d lists, mean depth %.1f\n", nops, nevents, nlists, mean_depth());
+
+	static const int default_copies[] = { 1, 4, 16 };
+	int ncopies_list = (argc > 2) ? argc - 2 : 3;
+	_Bool failed = 0;
+	printf("copies   list ns/op  events ns/op\n");
+	for (int c = 0; c < ncopies_list; c++) {
+		int ncopies = (argc > 2) ? atoi(argv[c + 2]) : default_copies[c];
+		if (ncopies < 1)
+			continue;
+		struct replay_result ref, ev;
+		best_of(replay_ref, ncopies, &ref);
+		best_of(replay_events, ncopies, &ev);
+		double nops_total = (double)nops * ncopies;
+		printf("%6d %12.1f %13.1f\n", ncopies, ref.seconds * 1e9 / nops_total, ev.seconds * 1e9 / nops_total);
+		if (ev.order != ref.order || ev.dispatched != ref.dispatched) {
+			printf("%6d: dispatch order differs from list\n", ncopies);
+			failed = 1;
+		}
+		if (ev.mismatches || ref.mismatches) {
+			printf("%6d: %lu dispatches didn't match the trace\n", ncopies, ev.mismatches);
+			failed = 1;
+		}
+	}
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*  XRoar - a Dragon/Tandy Coco emulator
+ *  Copyright (C) 2003-2014  Ciaran Anscomb
+ *
+ *  See COPYING.GPL for redistribution conditions. */
+
+#ifndef XROAR_EVBENCH_H_
+#define XROAR_EVBENCH_H_
+
+#include <limits.h>
+
+#include "events.h"
+
+/* Reference event queue for evbench: a sorted singly-linked list, as
+ * events.c used to be.  Queueing and dequeueing are kept in a separate file
+ * so that, like the real thing, they don't get inlined into the replay
+ * loop. */
+
+struct ref_event {
+	event_ticks at_tick;
+	_Bool queued;
+	struct ref_event **list;
+	struct ref_event *next;
+};
+
+void ref_queue(struct ref_event **list, struct ref_event *event);
+void ref_dequeue(struct ref_event *event);
+
+static inline _Bool ref_pending(struct ref_event **list, event_ticks now) {
+	return *list && (now - (*list)->at_tick) <= (UINT_MAX/2);
+}
+
+static inline struct ref_event *ref_pop(struct ref_event **list) {
+	struct ref_event *event = *list;
+	*list = event->next;
+	event->queued = 0;
+	return event;
+}
+
+#endif  /* XROAR_EVBENCH_H_ */
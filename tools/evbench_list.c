@@ -0,0 +1,58 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "evbench.h"
+
+void ref_queue(struct ref_event **list, struct ref_event *event) {
+	struct ref_event **entry;
+	if (event->queued)
+		ref_dequeue(event);
+	event->list = list;
+	event->queued = 1;
+	for (entry = list; *entry; entry = &((*entry)->next)) {
+		if ((int)((*entry)->at_tick - event->at_tick) > 0) {
+			event->next = *entry;
+			*entry = event;
+			return;
+		}
+	}
+	*entry = event;
+	event->next = NULL;
+}
+
+void ref_dequeue(struct ref_event *event) {
+	struct ref_event **list = event->list;
+	struct ref_event **entry;
+	event->queued = 0;
+	if (list == NULL)
+		return;
+	if (*list == event) {
+		*list = event->next;
+		return;
+	}
+	for (entry = list; *entry; entry = &((*entry)->next)) {
+		if ((*entry)->next == event) {
+			(*entry)->next = event->next;
+			return;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# test_ao_wav: capture a few seconds of audio with the WAV module and check
+# that XRoar exits cleanly with every frame accounted for in the header.
+
+XROAR="${1:-../src/xroar}"
+SECONDS_RUN=3
+RATE=48000
+CHANNELS=2
+
+tmp="${TMPDIR:-/tmp}/test_ao_wav.$$.wav"
+trap 'rm -f "$tmp"' EXIT
+
+"$XROAR" -ui null -vo null -ao wav -ao-file "$tmp" \
+	-ao-rate "$RATE" -ao-channels "$CHANNELS" -ao-format s16le \
+	-nobas -noextbas -noaltbas -timeout "$SECONDS_RUN" >/dev/null 2>&1
+status=$?
+if [ "$status" -ne 0 ]; then
+	echo "test_ao_wav: xroar exited with status $status" >&2
+	exit 1
+fi
+
+# Little-endian 32-bit value at byte offset $1
+le32() {
+	od -An -tu1 -j"$1" -N4 "$tmp" | {
+		read b0 b1 b2 b3
+		echo $(( b0 + (b1 << 8) + (b2 << 16) + (b3 << 24) ))
+	}
+}
+
+data_nbytes=$(le32 40)
+file_nbytes=$(wc -c < "$tmp")
+expect=$(( SECONDS_RUN * RATE * CHANNELS * 2 ))
+
+if [ "$data_nbytes" -ne "$expect" ]; then
+	echo "test_ao_wav: data chunk is $data_nbytes bytes, expected $expect" >&2
+	exit 1
+fi
+if [ "$file_nbytes" -ne $(( data_nbytes + 44 )) ]; then
+	echo "test_ao_wav: file is $file_nbytes bytes, header says $(( data_nbytes + 44 ))" >&2
+	exit 1
+fi
+if [ "$(le32 4)" -ne $(( file_nbytes - 8 )) ]; then
+	echo "test_ao_wav: RIFF chunk size does not match file size" >&2
+	exit 1
+fi
+
+echo "test_ao_wav: $(( data_nbytes / (CHANNELS * 2) )) frames OK"
@@ -0,0 +1,201 @@
+/*  Copyright 2003-2014 Ciaran Anscomb
+ *
+ *  This file is part of XRoar.
+ *
+ *  XRoar is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  XRoar is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XRoar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that the SSSE3 scanline renderers in vo_generic_ops.c produce
+ * exactly the same pixels as the scalar code.  Built once per Pixel size
+ * (PIXEL_BITS = 8, 16 or 32).  Each of the palette, simple and 5-bit
+ * cross-colour renderers is run over random lines and over lines made from
+ * the colours each VDG mode can produce, at several window widths and both
+ * cross-colour phases, with SSSE3 off and then on.
+ *
+ * Exits 0 if everything matches, or if SSSE3 isn't available to test. */
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "machine.h"
+#include "mc6847.h"
+#include "module.h"
+#include "vdg_palette.h"
+#include "xroar.h"
+
+#ifndef PIXEL_BITS
+#define PIXEL_BITS 32
+#endif
+
+#if PIXEL_BITS == 8
+typedef uint8_t Pixel;
+#elif PIXEL_BITS == 16
+typedef uint16_t Pixel;
+#else
+typedef uint32_t Pixel;
+#endif
+
+/* Give every byte of a Pixel something different to get wrong */
+#define MAPCOLOUR(r,g,b) map_colour((r), (g), (b))
+#define XSTEP 1
+#define NEXTLINE 0
+#define LOCK_SURFACE
+#define UNLOCK_SURFACE
+
+static Pixel map_colour(int r, int g, int b) {
+	uint32_t v = ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+	v ^= v >> 7;
+	v *= 0x9e3779b1;
+	return (Pixel)(v ^ (v >> 16));
+}
+
+// What vo_generic_ops.c expects from the rest of XRoar
+static struct machine_config test_machine_config;
+struct machine_config *xroar_machine_config = &test_machine_config;
+struct vdg_palette *xroar_vdg_palette = NULL;
+struct xroar_cfg xroar_cfg;
+static VideoModule test_video_module;
+VideoModule *video_module = &test_video_module;
+
+void vdg_palette_RGB(struct vdg_palette *vp, _Bool is_pal, int colour,
+                     float *Rout, float *Gout, float *Bout) {
+	(void)vp;
+	(void)is_pal;
+	*Rout = (float)((colour * 37) & 0xff) / 255.0;
+	*Gout = (float)((colour * 91 + 17) & 0xff) / 255.0;
+	*Bout = (float)((colour * 53 + 101) & 0xff) / 255.0;
+}
+
+#include "vo_generic_ops.c"
+
+#ifdef VO_SSSE3
+
+#define LINE_PAD (8)
+#define MAX_W (320)
+
+/* Colours each VDG mode can put on a line, borders included */
+static const struct {
+	const char *name;
+	int ncolours;
+	uint8_t colours[12];
+} mode_colours[] = {
+	{ "text css0", 3, { VDG_GREEN, VDG_DARK_GREEN, VDG_BLACK } },
+	{ "text css1", 3, { VDG_ORANGE, VDG_DARK_ORANGE, VDG_BLACK } },
+	{ "sg4/sg6", 9, { VDG_BLACK, VDG_GREEN, VDG_YELLOW, VDG_BLUE, VDG_RED, VDG_WHITE, VDG_CYAN, VDG_MAGENTA, VDG_ORANGE } },
+	{ "cg css0", 4, { VDG_GREEN, VDG_YELLOW, VDG_BLUE, VDG_RED } },
+	{ "cg css1", 4, { VDG_WHITE, VDG_CYAN, VDG_MAGENTA, VDG_ORANGE } },
+	{ "rg css0", 2, { VDG_BLACK, VDG_GREEN } },
+	{ "rg css1", 2, { VDG_BLACK, VDG_WHITE } },
+	{ "t1 inverse", 3, { VDG_BRIGHT_ORANGE, VDG_DARK_ORANGE, VDG_BLACK } },
+	{ "all", 12, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } },
+};
+#define NUM_MODES ((int)(sizeof(mode_colours) / sizeof(mode_colours[0])))
+
+static const int test_widths[] = { 16, 17, 20, 31, 33, 256, 319, 320 };
+#define NUM_WIDTHS ((int)(sizeof(test_widths) / sizeof(test_widths[0])))
+
+static const struct {
+	const char *name;
+	void (*render)(uint8_t const *);
+	int phase;
+} renderers[] = {
+	{ "palette", render_scanline, CROSS_COLOUR_OFF },
+	{ "ccr_simple", render_ccr_simple, 1 },
+	{ "ccr_simple", render_ccr_simple, 2 },
+	{ "ccr_5bit", render_ccr_5bit, 1 },
+	{ "ccr_5bit", render_ccr_5bit, 2 },
+};
+#define NUM_RENDERERS ((int)(sizeof(renderers) / sizeof(renderers[0])))
+
+static void render_line(int r, uint8_t const *line, Pixel *dest, int width, _Bool ssse3) {
+	use_ssse3 = ssse3;
+	xroar_machine_config->cross_colour_phase = renderers[r].phase;
+	video_module->scanline = 0;
+	video_module->window_x = LINE_PAD;
+	video_module->window_y = 0;
+	video_module->window_w = width;
+	video_module->window_h = 1;
+	pixel = dest;
+	renderers[r].render(line);
+}
+
+/* Runs one line through a renderer both ways.  Returns true if they wrote
+ * the same pixels and left the output pointer in the same place. */
+
+static _Bool check_line(int r, uint8_t const *line, int width) {
+	Pixel scalar[MAX_W + 1], vector[MAX_W + 1];
+	memset(scalar, 0xa5, sizeof(scalar));
+	memset(vector, 0xa5, sizeof(vector));
+	render_line(r, line, scalar, width, 0);
+	ptrdiff_t scalar_end = pixel - scalar;
+	render_line(r, line, vector, width, 1);
+	ptrdiff_t vector_end = pixel - vector;
+	return memcmp(scalar, vector, sizeof(scalar)) == 0
+	       && scalar_end == vector_end;
+}
+
+int main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+	(void)render_unchanged;
+	(void)update_cross_colour_phase;
+	xroar_machine_config->tv_standard = TV_PAL;
+	alloc_colours();
+	if (!use_ssse3) {
+		printf("test_vo_simd (%d-bit): SSSE3 not available, skipped\n", PIXEL_BITS);
+		return EXIT_SUCCESS;
+	}
+
+	srand(1);
+	unsigned nlines = 0, nbad = 0;
+	uint8_t line[LINE_PAD + MAX_W + LINE_PAD];
+	for (int r = 0; r < NUM_RENDERERS; r++) {
+		for (int w = 0; w < NUM_WIDTHS; w++) {
+			for (int m = 0; m < NUM_MODES; m++) {
+				unsigned mode_bad = 0;
+				for (int iter = 0; iter < 200; iter++) {
+					// Pad with border colours too
+					for (unsigned i = 0; i < sizeof(line); i++)
+						line[i] = mode_colours[m].colours[rand() % mode_colours[m].ncolours];
+					nlines++;
+					if (!check_line(r, line, test_widths[w]))
+						mode_bad++;
+				}
+				if (mode_bad) {
+					printf("%s phase %d width %d %s: %u lines differ\n", renderers[r].name, renderers[r].phase, test_widths[w], mode_colours[m].name, mode_bad);
+					nbad += mode_bad;
+				}
+			}
+		}
+	}
+
+	printf("test_vo_simd (%d-bit): %u lines, %u differ\n", PIXEL_BITS, nlines, nbad);
+	return nbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+int main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+	printf("test_vo_simd (%d-bit): no SSSE3 code on this platform, skipped\n", PIXEL_BITS);
+	return EXIT_SUCCESS;
+}
+
+#endif